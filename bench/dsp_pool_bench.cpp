@@ -0,0 +1,244 @@
+#include <dsp_pool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Many receiver instances at once, each a chain of DSP stages, run either the usual way with a thread per block and a
+// stream between each of them, or as one task per buffer on a shared DSPPool with a strand per instance.
+// Usage: dsp_pool_bench [pool threads], 0 or nothing for one per core.
+
+typedef std::chrono::high_resolution_clock Clock;
+
+const int BUFFER_SIZE = 2500;
+const int STAGES = 5;
+const int TAPS = 32;
+
+static float taps[TAPS];
+
+// Stand-in for a block's process(), a FIR so every stage costs about the same as a real filter would
+static void stage(const float* in, float* out, float* hist) {
+	float buf[TAPS - 1 + BUFFER_SIZE];
+	memcpy(buf, hist, (TAPS - 1) * sizeof(float));
+	memcpy(buf + TAPS - 1, in, BUFFER_SIZE * sizeof(float));
+	for (int i = 0; i < BUFFER_SIZE; i++) {
+		float acc = 0.0f;
+		for (int j = 0; j < TAPS; j++) { acc += buf[i + j] * taps[j]; }
+		out[i] = acc;
+	}
+	memcpy(hist, buf + BUFFER_SIZE, (TAPS - 1) * sizeof(float));
+}
+
+static void fillSource(float* buf, uint32_t& seed) {
+	for (int i = 0; i < BUFFER_SIZE; i++) {
+		seed = seed * 1664525u + 1013904223u;
+		buf[i] = (float)(seed >> 8) / (float)(1 << 24) - 0.5f;
+	}
+}
+
+struct Latencies {
+	std::mutex mtx;
+	std::vector<double> us;
+
+	void add(Clock::time_point sent) {
+		double t = std::chrono::duration<double, std::micro>(Clock::now() - sent).count();
+		std::lock_guard<std::mutex> lck(mtx);
+		us.push_back(t);
+	}
+
+	double percentile(double p) {
+		if (us.empty()) { return 0.0; }
+		std::sort(us.begin(), us.end());
+		return us[std::min<size_t>(us.size() - 1, us.size() * p)];
+	}
+};
+
+// Same handover as dsp::stream, the writer fills one buffer while the reader has the other and swap() waits for the
+// reader to be done
+struct Stream {
+	std::vector<float> bufs[2] = { std::vector<float>(BUFFER_SIZE), std::vector<float>(BUFFER_SIZE) };
+	float* writeBuf = bufs[0].data();
+	float* readBuf = bufs[1].data();
+	Clock::time_point writeTime, readTime;
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool ready = false;
+	bool canSwap = true;
+	bool last = false;
+
+	void swap(bool end) {
+		std::unique_lock<std::mutex> lck(mtx);
+		cv.wait(lck, [&]() { return canSwap; });
+		std::swap(writeBuf, readBuf);
+		readTime = writeTime;
+		last = end;
+		canSwap = false;
+		ready = true;
+		cv.notify_all();
+	}
+
+	// Returns false once the buffer read was the last one
+	bool read() {
+		std::unique_lock<std::mutex> lck(mtx);
+		cv.wait(lck, [&]() { return ready; });
+		return !last;
+	}
+
+	void flush() {
+		std::lock_guard<std::mutex> lck(mtx);
+		ready = false;
+		canSwap = true;
+		cv.notify_all();
+	}
+};
+
+// Source thread, a thread per stage, the sink on the last one
+static void runThreadPerBlock(int instances, int buffers, Latencies& lat) {
+	struct Instance {
+		Stream streams[STAGES];
+		float hist[STAGES][TAPS] = {};
+		std::vector<std::thread> threads;
+	};
+	std::vector<std::unique_ptr<Instance>> insts;
+	for (int n = 0; n < instances; n++) { insts.emplace_back(new Instance()); }
+
+	for (int n = 0; n < instances; n++) {
+		Instance* inst = insts[n].get();
+		inst->threads.emplace_back([=]() {
+			uint32_t seed = n;
+			for (int b = 0; b < buffers; b++) {
+				fillSource(inst->streams[0].writeBuf, seed);
+				inst->streams[0].writeTime = Clock::now();
+				inst->streams[0].swap(b == buffers - 1);
+			}
+		});
+		for (int s = 0; s < STAGES; s++) {
+			inst->threads.emplace_back([=, &lat]() {
+				Stream& in = inst->streams[s];
+				float scratch[BUFFER_SIZE];
+				while (true) {
+					bool more = in.read();
+					bool sink = (s == STAGES - 1);
+					stage(in.readBuf, sink ? scratch : inst->streams[s + 1].writeBuf, inst->hist[s]);
+					Clock::time_point sent = in.readTime;
+					in.flush();
+					if (sink) { lat.add(sent); }
+					else {
+						inst->streams[s + 1].writeTime = sent;
+						inst->streams[s + 1].swap(!more);
+					}
+					if (!more) { break; }
+				}
+			});
+		}
+	}
+
+	for (auto& inst : insts) {
+		for (auto& t : inst->threads) { t.join(); }
+	}
+}
+
+// A source thread per instance copying its buffers into jobs, every stage of a buffer in one task on the instance's
+// strand, the same as CoopExecutor with a pool set
+static void runPool(DSPPool* pool, int instances, int buffers, Latencies& lat) {
+	const int JOB_COUNT = 2;
+	struct Instance;
+	struct Job {
+		Instance* inst;
+		float in[BUFFER_SIZE];
+		Clock::time_point sent;
+	};
+	struct Instance {
+		DSPStrand strand;
+		Job jobs[JOB_COUNT];
+		float hist[STAGES][TAPS] = {};
+		float work[2][BUFFER_SIZE];
+		std::mutex mtx;
+		std::condition_variable cv;
+		int inFlight = 0;
+		Latencies* lat;
+	};
+	std::vector<std::unique_ptr<Instance>> insts;
+	for (int n = 0; n < instances; n++) {
+		insts.emplace_back(new Instance());
+		insts[n]->strand.init(pool);
+		insts[n]->lat = &lat;
+		for (int j = 0; j < JOB_COUNT; j++) { insts[n]->jobs[j].inst = insts[n].get(); }
+	}
+
+	auto runJob = [](void* ctx) {
+		Job* job = (Job*)ctx;
+		Instance* inst = job->inst;
+		const float* in = job->in;
+		for (int s = 0; s < STAGES; s++) {
+			stage(in, inst->work[s & 1], inst->hist[s]);
+			in = inst->work[s & 1];
+		}
+		inst->lat->add(job->sent);
+		{
+			std::lock_guard<std::mutex> lck(inst->mtx);
+			inst->inFlight--;
+		}
+		inst->cv.notify_all();
+	};
+
+	std::vector<std::thread> sources;
+	for (int n = 0; n < instances; n++) {
+		Instance* inst = insts[n].get();
+		sources.emplace_back([=]() {
+			uint32_t seed = n;
+			float buf[BUFFER_SIZE];
+			for (int b = 0; b < buffers; b++) {
+				fillSource(buf, seed);
+				Clock::time_point sent = Clock::now();
+				{
+					std::unique_lock<std::mutex> lck(inst->mtx);
+					inst->cv.wait(lck, [&]() { return inst->inFlight < JOB_COUNT; });
+					inst->inFlight++;
+				}
+				Job* job = &inst->jobs[b % JOB_COUNT];
+				memcpy(job->in, buf, sizeof(buf));
+				job->sent = sent;
+				inst->strand.submit({ runJob, job });
+			}
+		});
+	}
+	for (auto& t : sources) { t.join(); }
+	for (auto& inst : insts) { inst->strand.wait(); }
+}
+
+template <class F>
+static void measure(const char* name, int instances, int buffers, F func) {
+	Latencies lat;
+	auto start = Clock::now();
+	func(lat);
+	double secs = std::chrono::duration<double>(Clock::now() - start).count();
+	double total = (double)instances * buffers;
+	printf("%-16s %4d %12.0f %12.2f %12.2f\n", name, instances, total / secs, lat.percentile(0.5) / 1000.0, lat.percentile(0.99) / 1000.0);
+}
+
+int main(int argc, char** argv) {
+	int poolThreads = (argc > 1) ? atoi(argv[1]) : 0;
+	for (int i = 0; i < TAPS; i++) { taps[i] = 1.0f / TAPS; }
+
+	DSPPool pool(poolThreads);
+	printf("%d cores, %d pool threads, %d stages of %d taps per instance, %d samples per buffer\n\n",
+		std::thread::hardware_concurrency(), pool.getWorkerCount(), STAGES, TAPS, BUFFER_SIZE);
+	printf("%-16s %4s %12s %12s %12s\n", "Model", "Inst", "Buffers/s", "p50 ms", "p99 ms");
+
+	for (int instances = 1; instances <= 64; instances *= 2) {
+		// Enough buffers to keep every instance busy for a while, without the big counts taking forever
+		int buffers = std::max<int>(32, 2048 / instances);
+		measure("Thread/block", instances, buffers, [&](Latencies& lat) { runThreadPerBlock(instances, buffers, lat); });
+		measure("Shared pool", instances, buffers, [&](Latencies& lat) { runPool(&pool, instances, buffers, lat); });
+	}
+	printf("\n%llu tasks stolen\n", (unsigned long long)pool.getStealCount());
+
+	return 0;
+}
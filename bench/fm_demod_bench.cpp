@@ -0,0 +1,101 @@
+#include <broadcast_fm.h>
+#include <fm_kernels.h>
+#include <dsp/demod/quadrature.h>
+#include <dsp/demod/broadcast_fm.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// The module's discriminator against dsp::demod::Quadrature, then the whole of BroadcastFM against
+// dsp::demod::BroadcastFM, in mono and stereo, as CPU per channel at 250kHz. fm_kernels_bench has the kernels alone.
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static const double SAMPLERATE = 250000.0;
+static const double DEVIATION = 75000.0;
+static const int SECONDS = 10;
+static const int BUFFER_SIZE = 2500;
+
+// A stereo station with a tone in each channel, the pilot and some RDS, plus a little noise
+static std::vector<dsp::complex_t> makeStation() {
+	std::mt19937 rng(1234);
+	std::normal_distribution<float> noise(0.0f, 0.05f);
+	int count = (int)(SAMPLERATE * SECONDS);
+	std::vector<dsp::complex_t> iq(count);
+	double phase = 0.0;
+	for (int i = 0; i < count; i++) {
+		double t = (double)i / SAMPLERATE;
+		double left = sin(2.0 * M_PI * 1000.0 * t);
+		double right = sin(2.0 * M_PI * 1500.0 * t);
+		double rds = (((int)(t * 2375.0) * 2654435761u) >> 31) ? 1.0 : -1.0;
+		double mpx = 0.4 * (left + right) / 2.0 + 0.4 * (left - right) / 2.0 * cos(2.0 * M_PI * 38000.0 * t) +
+					 0.09 * cos(2.0 * M_PI * 19000.0 * t) + 0.04 * rds * cos(2.0 * M_PI * 57000.0 * t);
+		phase += 2.0 * M_PI * DEVIATION * mpx / SAMPLERATE;
+		iq[i] = { (float)cos(phase) + noise(rng), (float)sin(phase) + noise(rng) };
+	}
+	return iq;
+}
+
+static void printRow(const char* name, double secs, int samples, const char* note) {
+	double cpu = secs / ((double)samples / SAMPLERATE);
+	printf("%-22s %12.2f %13.2f%% %12.1f %s\n", name, secs * 1e9 / samples, 100.0 * cpu, 1.0 / cpu, note);
+}
+
+static void benchDiscriminator(const std::vector<dsp::complex_t>& iq) {
+	dsp::demod::Quadrature stock;
+	stock.init(NULL, DEVIATION, SAMPLERATE);
+	std::vector<float> ref(iq.size()), out(iq.size());
+	dsp::complex_t last = { 1.0f, 0.0f };
+	float gain = 1.0f / dsp::math::hzToRads(DEVIATION, SAMPLERATE);
+
+	double stockSecs = 0.0, kernelSecs = 0.0;
+	for (int i = 0; i + BUFFER_SIZE <= (int)iq.size(); i += BUFFER_SIZE) {
+		auto t0 = Clock::now();
+		stock.process(BUFFER_SIZE, (dsp::complex_t*)&iq[i], &ref[i]);
+		auto t1 = Clock::now();
+		fmDiscriminate(BUFFER_SIZE, (const float*)&iq[i], (float*)&last, gain, &out[i]);
+		auto t2 = Clock::now();
+		stockSecs += std::chrono::duration<double>(t1 - t0).count();
+		kernelSecs += std::chrono::duration<double>(t2 - t1).count();
+	}
+
+	// In MPX units, full deviation is 1
+	float maxErr = 0.0f;
+	for (size_t i = 0; i < iq.size(); i++) { maxErr = std::max<float>(maxErr, fabsf(out[i] - ref[i])); }
+	char note[64];
+	sprintf(note, "max error %.1e", maxErr);
+	printRow("Quadrature", stockSecs, iq.size(), "");
+	printRow("fmDiscriminate", kernelSecs, iq.size(), note);
+}
+
+static void benchBlock(bool stereo, const std::vector<dsp::complex_t>& iq) {
+	dsp::demod::BroadcastFM stock(NULL, DEVIATION, SAMPLERATE, stereo, true, false);
+	BroadcastFM ours(NULL, DEVIATION, SAMPLERATE, stereo, true, false);
+	std::vector<dsp::stereo_t> refOut(BUFFER_SIZE), out(BUFFER_SIZE);
+	double stockSecs = 0.0, oursSecs = 0.0;
+	for (int i = 0; i + BUFFER_SIZE <= (int)iq.size(); i += BUFFER_SIZE) {
+		int rdsCount = 0;
+		auto t0 = Clock::now();
+		stock.process(BUFFER_SIZE, (dsp::complex_t*)&iq[i], refOut.data(), rdsCount);
+		auto t1 = Clock::now();
+		ours.process(BUFFER_SIZE, (dsp::complex_t*)&iq[i], out.data(), rdsCount, NULL);
+		auto t2 = Clock::now();
+		stockSecs += std::chrono::duration<double>(t1 - t0).count();
+		oursSecs += std::chrono::duration<double>(t2 - t1).count();
+	}
+	printRow(stereo ? "SDR++ stereo" : "SDR++ mono", stockSecs, iq.size(), "");
+	printRow(stereo ? "BroadcastFM stereo" : "BroadcastFM mono", oursSecs, iq.size(), "");
+}
+
+int main() {
+	std::vector<dsp::complex_t> iq = makeStation();
+
+	printf("%-22s %12s %14s %12s\n", "kernel", "ns/sample", "CPU/channel", "channels");
+	benchDiscriminator(iq);
+	benchBlock(false, iq);
+	benchBlock(true, iq);
+
+	return 0;
+}
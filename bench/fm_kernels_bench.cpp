@@ -0,0 +1,122 @@
+#include <fm_kernels.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// The discriminator and stereo matrix kernels from fm_kernels.h on their own, against the scalar code they replace:
+// atan2f per sample and the difference of the phases, as a quadrature demodulator does, and the plain matrix loop.
+// Doesn't need SDR++, fm_demod_bench compares the whole of BroadcastFM against SDR++'s blocks.
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static const double SAMPLERATE = 250000.0;
+static const double DEVIATION = 75000.0;
+static const int SECONDS = 10;
+static const int BUFFER_SIZE = 2500;
+static const int RUNS = 5;
+
+// A stereo station with a tone in each channel, the pilot and some RDS, plus a little noise. Interleaved IQ.
+static std::vector<float> makeStation() {
+	std::mt19937 rng(1234);
+	std::normal_distribution<float> noise(0.0f, 0.05f);
+	int count = (int)(SAMPLERATE * SECONDS);
+	std::vector<float> iq(2 * count);
+	double phase = 0.0;
+	for (int i = 0; i < count; i++) {
+		double t = (double)i / SAMPLERATE;
+		double left = sin(2.0 * M_PI * 1000.0 * t);
+		double right = sin(2.0 * M_PI * 1500.0 * t);
+		double rds = (((int)(t * 2375.0) * 2654435761u) >> 31) ? 1.0 : -1.0;
+		double mpx = 0.4 * (left + right) / 2.0 + 0.4 * (left - right) / 2.0 * cos(2.0 * M_PI * 38000.0 * t) +
+					 0.09 * cos(2.0 * M_PI * 19000.0 * t) + 0.04 * rds * cos(2.0 * M_PI * 57000.0 * t);
+		phase += 2.0 * M_PI * DEVIATION * mpx / SAMPLERATE;
+		iq[2 * i] = (float)cos(phase) + noise(rng);
+		iq[2 * i + 1] = (float)sin(phase) + noise(rng);
+	}
+	return iq;
+}
+
+static void quadrature(int count, const float* iq, float& lastPhase, float gain, float* out) {
+	for (int i = 0; i < count; i++) {
+		float phase = atan2f(iq[2 * i + 1], iq[2 * i]);
+		float diff = phase - lastPhase;
+		if (diff > (float)M_PI) { diff -= 2.0f * (float)M_PI; }
+		else if (diff <= -(float)M_PI) { diff += 2.0f * (float)M_PI; }
+		out[i] = diff * gain;
+		lastPhase = phase;
+	}
+}
+
+static void matrix(int count, const float* mpx, const float* pilot, float* l, float* r) {
+	for (int i = 0; i < count; i++) {
+		float lmr = 2.0f * mpx[i] * (pilot[2 * i] * pilot[2 * i] - pilot[2 * i + 1] * pilot[2 * i + 1]);
+		l[i] = mpx[i] + lmr;
+		r[i] = mpx[i] - lmr;
+	}
+}
+
+// Best of a few runs over the whole signal, in buffers like the DSP thread gets them
+template <class F>
+static double bestOf(int count, F func) {
+	double best = 1e30;
+	for (int run = 0; run < RUNS; run++) {
+		auto start = Clock::now();
+		for (int i = 0; i + BUFFER_SIZE <= count; i += BUFFER_SIZE) { func(i); }
+		best = std::min<double>(best, std::chrono::duration<double>(Clock::now() - start).count());
+	}
+	return best;
+}
+
+static void printRow(const char* name, double secs, int samples, const char* note) {
+	double cpu = secs / ((double)samples / SAMPLERATE);
+	printf("%-18s %12.2f %13.3f%% %s\n", name, secs * 1e9 / samples, 100.0 * cpu, note);
+}
+
+int main() {
+#if defined(__AVX2__) && defined(__FMA__)
+	const char* isa = "AVX2+FMA";
+#elif defined(__SSE2__) || defined(_M_X64)
+	const char* isa = "SSE2";
+#elif defined(__ARM_NEON)
+	const char* isa = "NEON";
+#else
+	const char* isa = "scalar";
+#endif
+	std::vector<float> iq = makeStation();
+	int count = iq.size() / 2;
+	float gain = (float)(SAMPLERATE / (2.0 * M_PI * DEVIATION));
+	printf("kernels: %s, %d samples at %.0f kHz\n\n", isa, count, SAMPLERATE / 1e3);
+	printf("%-18s %12s %14s\n", "kernel", "ns/sample", "CPU/channel");
+
+	// In MPX units, full deviation is 1
+	std::vector<float> ref(count), out(count);
+	float lastPhase = 0.0f;
+	float last[2] = { 1.0f, 0.0f };
+	double refSecs = bestOf(count, [&](int i) { quadrature(BUFFER_SIZE, &iq[2 * i], lastPhase, gain, &ref[i]); });
+	double kernelSecs = bestOf(count, [&](int i) { fmDiscriminate(BUFFER_SIZE, &iq[2 * i], last, gain, &out[i]); });
+	float maxErr = 0.0f;
+	for (int i = 1; i < count; i++) { maxErr = std::max<float>(maxErr, fabsf(out[i] - ref[i])); }
+	char note[64];
+	snprintf(note, sizeof(note), "max error %.1e rad", maxErr / gain);
+	printRow("atan2f", refSecs, count, "");
+	printRow("fmDiscriminate", kernelSecs, count, note);
+
+	// Any unit phasor will do for the pilot, the cost doesn't depend on it
+	std::vector<float> pilot(2 * count), refL(count), refR(count), l(count), r(count);
+	for (int i = 0; i < count; i++) {
+		float ph = 2.0f * (float)M_PI * 19000.0f * (float)i / SAMPLERATE;
+		pilot[2 * i] = cosf(ph);
+		pilot[2 * i + 1] = sinf(ph);
+	}
+	refSecs = bestOf(count, [&](int i) { matrix(BUFFER_SIZE, &ref[i], &pilot[2 * i], &refL[i], &refR[i]); });
+	kernelSecs = bestOf(count, [&](int i) { stereoMatrix(BUFFER_SIZE, &ref[i], &pilot[2 * i], &l[i], &r[i]); });
+	maxErr = 0.0f;
+	for (int i = 0; i < count; i++) { maxErr = std::max<float>(maxErr, std::max<float>(fabsf(l[i] - refL[i]), fabsf(r[i] - refR[i]))); }
+	snprintf(note, sizeof(note), "max error %.1e", maxErr);
+	printRow("scalar matrix", refSecs, count, "");
+	printRow("stereoMatrix", kernelSecs, count, note);
+
+	return 0;
+}
@@ -0,0 +1,92 @@
+#include <broadcast_fm.h>
+#include <rds_demod.h>
+#include <rds.h>
+#include "rds_groups.h"
+#include <dsp/multirate/rational_resampler.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// CPU per channel of a whole broadcast FM receiver, BroadcastFM in stereo with RDS, the audio resampler to 48kHz and
+// RDSDemod feeding the decoder, at every IF rate the module offers and at 171kHz, which it doesn't offer yet. Then the
+// same without audio, as in RDS only mode. Also checks that every rate decodes the station.
+
+static const double AUDIO_SAMPLERATE = 48000.0;
+static const int SECONDS = 10;
+static const int BUFFER_SIZE = 2500;
+
+// A stereo station with a tone in each channel, the pilot and RDS at the usual levels
+static std::vector<dsp::complex_t> makeStation(double samplerate, const std::vector<uint8_t>& bits) {
+	std::mt19937 rng(1234);
+	std::normal_distribution<float> noise(0.0f, 0.05f);
+	int count = (int)(samplerate * SECONDS);
+	std::vector<dsp::complex_t> iq(count);
+	double phase = 0.0;
+	bool level = false;
+	int lastSymbol = -1;
+	int bitIdx = 0;
+	for (int i = 0; i < count; i++) {
+		double t = (double)i / samplerate;
+		int symbol = (int)(t * 2375.0);
+		if (symbol != lastSymbol) {
+			if (!(symbol & 1)) { level ^= bits[bitIdx++ % bits.size()]; }
+			lastSymbol = symbol;
+		}
+		double rds = ((symbol & 1) ^ level) ? 1.0 : -1.0;
+		double left = sin(2.0 * M_PI * 1000.0 * t);
+		double right = sin(2.0 * M_PI * 1500.0 * t);
+		double mpx = 0.4 * (left + right) / 2.0 + 0.4 * (left - right) / 2.0 * cos(2.0 * M_PI * 38000.0 * t) +
+					 0.09 * cos(2.0 * M_PI * 19000.0 * t) + 0.04 * rds * cos(2.0 * M_PI * 57000.0 * t);
+		phase += 2.0 * M_PI * 75000.0 * mpx / samplerate;
+		iq[i] = { (float)cos(phase) + noise(rng), (float)sin(phase) + noise(rng) };
+	}
+	return iq;
+}
+
+static void bench(double samplerate, bool audio, const std::vector<dsp::complex_t>& iq) {
+	BroadcastFM fm(NULL, 75000.0, samplerate, true, true, true);
+	fm.setAudio(audio);
+	dsp::multirate::RationalResampler<dsp::stereo_t> resamp;
+	resamp.init(NULL, samplerate, AUDIO_SAMPLERATE);
+	RDSDemod rdsDemod;
+	rdsDemod.init(NULL, RDS_OUTPUT_SOFT);
+	rds::Decoder decoder;
+
+	std::vector<dsp::stereo_t> af(BUFFER_SIZE), out(BUFFER_SIZE);
+	std::vector<dsp::complex_t> rdsBB(BUFFER_SIZE);
+	std::vector<float> soft(BUFFER_SIZE);
+	std::vector<uint8_t> hard(BUFFER_SIZE);
+	int audioCount = 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i + BUFFER_SIZE <= (int)iq.size(); i += BUFFER_SIZE) {
+		int rdsCount = 0;
+		int count = fm.process(BUFFER_SIZE, (dsp::complex_t*)&iq[i], af.data(), rdsCount, rdsBB.data());
+		if (count) { audioCount += resamp.process(count, af.data(), out.data()); }
+		int bits = rdsDemod.processBuffer(rdsCount, rdsBB.data(), soft.data(), hard.data());
+		decoder.processSoft(soft.data(), bits);
+	}
+	double secs = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	// CPU per channel is the share of one core needed to keep up with a real time channel
+	rds::RDSState st = decoder.getState();
+	double cpu = secs / SECONDS;
+	printf("%-10.0f %-8s %13.2f%% %12.1f %10.1f %6s %8.0f\n", samplerate / 1e3, audio ? "stereo" : "RDS only", 100.0 * cpu, 1.0 / cpu,
+		   (double)audioCount / SECONDS / 1e3, (st.piCode == 0x2345) ? "yes" : "NO", st.timeToFirstPIMs());
+}
+
+int main() {
+	const double RATES[] = { 250000.0, 228000.0, 171000.0 };
+	std::vector<uint8_t> bits = makeStream(104 * 1000);
+
+	printf("%-10s %-8s %14s %12s %10s %6s %8s\n", "IF kHz", "mode", "CPU/channel", "channels", "AF kS/s", "PI", "PI ms");
+	for (double sr : RATES) {
+		std::vector<dsp::complex_t> iq = makeStation(sr, bits);
+		bench(sr, true, iq);
+		bench(sr, false, iq);
+	}
+
+	return 0;
+}
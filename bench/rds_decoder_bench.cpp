@@ -0,0 +1,198 @@
+#include <rds.h>
+#include <rds_syndrome.h>
+#include "rds_groups.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+// Throughput and per-call cost of everything on the RDS decoding path.
+// Usage: rds_decoder_bench [recording], the recording holds one bit per byte (raw 0/1 or ASCII '0'/'1').
+
+static volatile uint64_t sink;
+
+template <class F>
+static void run(const char* name, const char* unit, double itemsPerCall, int calls, F func) {
+	// Warm up caches and branch predictors first
+	func();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < calls; i++) { func(); }
+	auto end = std::chrono::high_resolution_clock::now();
+	double secs = std::chrono::duration<double>(end - start).count();
+	double items = itemsPerCall * calls;
+	printf("%-32s %12.3f M%s/s %12.2f ns/%s\n", name, items / secs / 1e6, unit, secs * 1e9 / items, unit);
+}
+
+static std::vector<uint64_t> pack(const std::vector<uint8_t>& bits) {
+	std::vector<uint64_t> words(bits.size() / 64);
+	for (size_t i = 0; i < words.size() * 64; i++) { words[i / 64] = (words[i / 64] << 1) | (bits[i] & 1); }
+	return words;
+}
+
+// Undo the differential decoding and turn the bits into noisy soft symbols
+static std::vector<float> makeSoft(const std::vector<uint8_t>& bits, float sigma, std::mt19937& rng) {
+	std::normal_distribution<float> noise(0.0f, sigma);
+	std::vector<float> soft(bits.size());
+	bool level = false;
+	for (size_t i = 0; i < bits.size(); i++) {
+		level ^= bits[i] & 1;
+		soft[i] = (level ? 1.0f : -1.0f) + noise(rng);
+	}
+	return soft;
+}
+
+static void benchProcess(const char* name, const std::vector<uint8_t>& bits, int calls) {
+	rds::Decoder decoder;
+	run(name, "bit", bits.size(), calls, [&]() { decoder.process(bits.data(), bits.size()); });
+}
+
+int main(int argc, char** argv) {
+	const int BIT_COUNT = 1 << 18;
+	const int CALLS = 20;
+	std::mt19937 rng(1234);
+
+	std::vector<uint8_t> locked = makeStream(BIT_COUNT);
+
+	// Make sure the synthetic stream actually decodes before timing anything
+	{
+		rds::Decoder decoder;
+		decoder.process(locked.data(), locked.size());
+		rds::RDSState st = decoder.getState();
+		if (strcmp(st.psUTF8, "BENCH FM") || st.blockStats.uncorrectable) {
+			printf("Synthetic stream doesn't decode\n");
+			return 1;
+		}
+	}
+
+	std::vector<uint8_t> hunting(BIT_COUNT);
+	for (auto& b : hunting) { b = rng() & 1; }
+
+	std::vector<uint8_t> noisy = locked;
+	std::uniform_real_distribution<double> uni(0.0, 1.0);
+	for (auto& b : noisy) { if (uni(rng) < 0.01) { b ^= 1; } }
+
+	printf("Decoder::process\n");
+	benchProcess("locked", locked, CALLS);
+	benchProcess("hunting", hunting, CALLS);
+	benchProcess("noisy (BER 1e-2)", noisy, CALLS);
+	if (argc > 1) {
+		std::ifstream file(argv[1], std::ios::binary);
+		std::vector<uint8_t> recorded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (recorded.empty()) {
+			printf("Could not read %s\n", argv[1]);
+			return 1;
+		}
+		benchProcess(argv[1], recorded, CALLS);
+	}
+
+	printf("\nDecoder::processPacked\n");
+	{
+		std::vector<uint64_t> lockedWords = pack(locked), huntingWords = pack(hunting), noisyWords = pack(noisy);
+		rds::Decoder a, b, c;
+		run("locked", "bit", lockedWords.size() * 64, CALLS, [&]() { a.processPacked(lockedWords.data(), lockedWords.size()); });
+		run("hunting", "bit", huntingWords.size() * 64, CALLS, [&]() { b.processPacked(huntingWords.data(), huntingWords.size()); });
+		run("noisy (BER 1e-2)", "bit", noisyWords.size() * 64, CALLS, [&]() { c.processPacked(noisyWords.data(), noisyWords.size()); });
+	}
+
+	printf("\nDecoder::processSoft\n");
+	{
+		std::vector<float> clean = makeSoft(locked, 0.1f, rng), weak = makeSoft(locked, 0.5f, rng);
+		rds::Decoder a, b;
+		run("locked (sigma 0.1)", "bit", clean.size(), CALLS, [&]() { a.processSoft(clean.data(), clean.size()); });
+		run("noisy (sigma 0.5)", "bit", weak.size(), CALLS, [&]() { b.processSoft(weak.data(), weak.size()); });
+	}
+
+	printf("\nBlock level\n");
+	{
+		// Valid blocks of every type with a burst of up to 5 errors in half of them
+		const std::vector<uint16_t> checks = makeCheckTable();
+		const int BLOCK_COUNT = 1 << 16;
+		std::vector<uint32_t> blocks(BLOCK_COUNT);
+		std::vector<rds::BlockType> types(BLOCK_COUNT);
+		for (int i = 0; i < BLOCK_COUNT; i++) {
+			types[i] = (rds::BlockType)(rng() % rds::_BLOCK_TYPE_COUNT);
+			blocks[i] = encodeBlock(checks, rng() & 0xFFFF, types[i]);
+			if (i & 1) {
+				int len = 1 + rng() % rds::MAX_BURST_LEN;
+				uint32_t burst = (1u << (len - 1)) | 1 | ((rng() & ((1u << len) - 1)));
+				blocks[i] ^= burst << (rng() % (rds::BLOCK_LEN - len + 1));
+			}
+		}
+
+		run("calcSyndrome", "call", BLOCK_COUNT, CALLS * 10, [&]() {
+			uint16_t acc = 0;
+			for (uint32_t block : blocks) { acc ^= rds::Decoder::calcSyndrome(block); }
+			sink = acc;
+		});
+
+		static const char* POLICY_NAMES[rds::_CORRECTION_POLICY_COUNT] = { "correctErrors (detect only)", "correctErrors (single bit)", "correctErrors (burst)" };
+		for (int p = 0; p < rds::_CORRECTION_POLICY_COUNT; p++) {
+			run(POLICY_NAMES[p], "call", BLOCK_COUNT, CALLS * 10, [&]() {
+				uint32_t acc = 0;
+				for (int i = 0; i < BLOCK_COUNT; i++) {
+					bool recovered;
+					uint8_t corrected;
+					acc ^= rds::Decoder::correctErrors(blocks[i], types[i], (rds::CorrectionPolicy)p, recovered, corrected);
+					acc += recovered;
+				}
+				sink = acc;
+			});
+		}
+	}
+
+	printf("\nCallsigns\n");
+	run("decodeCallsign (all PIs)", "call", 0x10000, CALLS, [&]() {
+		size_t acc = 0;
+		for (uint32_t pi = 0; pi < 0x10000; pi++) { acc += rds::Decoder::decodeCallsign(pi).size(); }
+		sink = acc;
+	});
+	run("base26ToCall", "call", 39247 - 4096, CALLS, [&]() {
+		size_t acc = 0;
+		for (uint32_t pi = 4096; pi < 39247; pi++) { acc += rds::Decoder::base26ToCall(pi).size(); }
+		sink = acc;
+	});
+
+	printf("\nCharset\n");
+	{
+		// Radiotext with a sprinkle of extended characters
+		char rt[65];
+		for (int i = 0; i < 64; i++) { rt[i] = (i % 8 == 7) ? (char)(0x80 + i) : (char)('A' + i % 26); }
+		rt[64] = 0;
+		char out[64 * rds::UTF8_MAX_CHAR_LEN + 1];
+
+		run("convert_from_rdscharset (string)", "char", 64, CALLS * 10000, [&]() {
+			sink = rds::convert_from_rdscharset(rt).size();
+		});
+		run("convert_from_rdscharset (buffer)", "char", 64, CALLS * 10000, [&]() {
+			sink = rds::convert_from_rdscharset(rt, 64, out, sizeof(out));
+		});
+	}
+
+	printf("\nMenu\n");
+	{
+		// Everything WFM::showMenu and the waterfall overlay read each frame
+		rds::Decoder decoder;
+		decoder.process(locked.data(), locked.size());
+		run("getState + fields", "frame", 1, CALLS * 10000, [&]() {
+			rds::RDSState st = decoder.getState();
+			uint64_t acc = 0;
+			if (st.piCodeValid()) { acc += st.piCode + strlen(st.callsign); }
+			if (st.programTypeValid()) { acc += st.programType; }
+			if (st.afValid()) { acc += st.afs[0] + st.afCount; }
+			if (st.PSNameValid()) { acc += strlen(st.psUTF8); }
+			if (st.radioTextValid()) { acc += strlen(st.radioTextUTF8) + st.lastRTAB; }
+			if (st.programTypeNameValid()) { acc += strlen(st.programTypeNameUTF8); }
+			if (st.ertValid()) { acc += strlen(st.ertUTF8); }
+			if (st.tpValid() && st.taValid()) { acc += st.trafficProgram + st.trafficAnnouncement; }
+			if (st.CTReceived()) { acc += rds::Decoder::getMJDDay(st.clock_mjd); }
+			acc += st.blockStats.blocks;
+			sink = acc;
+		});
+	}
+
+	return 0;
+}
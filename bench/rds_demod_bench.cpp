@@ -0,0 +1,387 @@
+#include <rds_demod.h>
+#include <rds_front_end.h>
+#include <rds_diversity.h>
+#include <channelizer.h>
+#include <rds.h>
+#include "rds_groups.h"
+#include <dsp/taps/band_pass.h>
+#include <dsp/taps/low_pass.h>
+#include <dsp/filter/fir.h>
+#include <dsp/channel/frequency_xlator.h>
+#include <dsp/multirate/rational_resampler.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// CPU cost of one RDS channel through RDSDemod for a range of buffer sizes, both filter shapes and both timing modes.
+// Also compares the bit error rate of the two timing modes as the noise goes up, and measures how long it takes from a
+// retune to the first PI with fixed and gear shifted loops, and how many more blocks get through when several variants
+// are combined. Then the front end that would feed it from the MPX against the generic mixer and resampler BroadcastFM uses.
+// Last, the band monitor's channelizer against a translator and resampler for every channel.
+
+static const double RDS_SAMPLERATE = 5000.0;
+static const double RDS_SYMBOLRATE = 2375.0;
+
+// Biphase RDS baseband like BroadcastFM's rdsOut, with some carrier offset and noise. The bits go in bits if given,
+// they're random unless data is given.
+static std::vector<dsp::complex_t> makeSignal(int count, float sigma = 0.2f, std::vector<uint8_t>* bits = NULL, const std::vector<uint8_t>* data = NULL) {
+	std::mt19937 rng(1234);
+	std::normal_distribution<float> noise(0.0f, sigma);
+	std::vector<dsp::complex_t> sig(count);
+	bool bit = false;
+	bool level = false;
+	int lastSymbol = -1;
+	int bitIdx = 0;
+	for (int i = 0; i < count; i++) {
+		int symbol = (int)(i * RDS_SYMBOLRATE / RDS_SAMPLERATE);
+		if (symbol != lastSymbol) {
+			// Every bit is two symbols of opposite sign, the data is differentially encoded
+			if (!(symbol & 1)) {
+				bit = data ? (*data)[bitIdx++ % data->size()] : (rng() & 1);
+				level ^= bit;
+				if (bits) { bits->push_back(bit); }
+			}
+			lastSymbol = symbol;
+		}
+		float amp = ((symbol & 1) ^ level) ? 1.0f : -1.0f;
+		float phase = 2.0f * FL_M_PI * 1.5f * i / RDS_SAMPLERATE;
+		sig[i].re = amp * cosf(phase) + noise(rng);
+		sig[i].im = amp * sinf(phase) + noise(rng);
+	}
+	return sig;
+}
+
+static void bench(RDSFilterShape shape, RDSTimingMode timing, const char* name, int bufSize, const std::vector<dsp::complex_t>& sig) {
+	dsp::stream<dsp::complex_t> dummy;
+	RDSDemod demod;
+	demod.init(&dummy);
+	demod.setFilterShape(shape);
+	demod.setTimingMode(timing);
+
+	std::vector<float> soft(bufSize);
+	std::vector<uint8_t> hard(bufSize);
+	double secs = 0;
+
+	int sampleCount = sig.size();
+	for (int i = 0; i + bufSize <= sampleCount; i += bufSize) {
+		// The AGC may write in place
+		std::vector<dsp::complex_t> buf(sig.begin() + i, sig.begin() + i + bufSize);
+
+		auto t0 = std::chrono::high_resolution_clock::now();
+		demod.process(bufSize, buf.data(), soft.data(), hard.data());
+		secs += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+	}
+
+	// CPU per channel is the share of one core needed to keep up with a real time RDS channel
+	int processed = (sampleCount / bufSize) * bufSize;
+	double signalSecs = processed / RDS_SAMPLERATE;
+	printf("%-8s %-10d %12.2f %13.4f%%\n", name, bufSize, secs * 1e9 / processed, 100.0 * secs / signalSecs);
+}
+
+// Decoded bits against the sent ones. Aligned again every window, so a bit slip only costs the window it happens in.
+static double bitErrorRate(const std::vector<uint8_t>& sent, const std::vector<uint8_t>& decoded) {
+	const int SETTLE = 400;
+	const int WINDOW = 500;
+	int errors = 0, total = 0, offset = 0;
+	for (int start = SETTLE; start + WINDOW <= (int)decoded.size(); start += WINDOW) {
+		// Search wide for the first window, then just around the last offset
+		int range = total ? 8 : 100;
+		int bestErrors = WINDOW, bestOffset = offset;
+		for (int o = offset - range; o <= offset + range; o++) {
+			int err = 0;
+			for (int i = start; i < start + WINDOW; i++) {
+				int j = i + o;
+				err += (j < 0 || j >= (int)sent.size()) ? 1 : (decoded[i] != sent[j]);
+			}
+			if (err < bestErrors) {
+				bestErrors = err;
+				bestOffset = o;
+			}
+		}
+		offset = bestOffset;
+		errors += bestErrors;
+		total += WINDOW;
+	}
+	return total ? (double)errors / (double)total : 1.0;
+}
+
+static double sensitivity(RDSTimingMode timing, const std::vector<dsp::complex_t>& sig, const std::vector<uint8_t>& sent, RDSLoopGear gear = RDS_GEAR_FIXED) {
+	const int BUF_SIZE = 1000;
+	dsp::stream<dsp::complex_t> dummy;
+	RDSDemod demod;
+	demod.init(&dummy);
+	demod.setTimingMode(timing);
+	if (gear != RDS_GEAR_FIXED) {
+		demod.setGearShifting(true);
+		demod.requestGear(gear);
+	}
+
+	std::vector<float> soft(BUF_SIZE);
+	std::vector<uint8_t> hard(BUF_SIZE), decoded;
+	for (int i = 0; i + BUF_SIZE <= (int)sig.size(); i += BUF_SIZE) {
+		std::vector<dsp::complex_t> buf(sig.begin() + i, sig.begin() + i + BUF_SIZE);
+		int count = demod.process(BUF_SIZE, buf.data(), soft.data(), hard.data());
+		decoded.insert(decoded.end(), hard.begin(), hard.begin() + count);
+	}
+	return bitErrorRate(sent, decoded);
+}
+
+// Time from a retune to the first PI, as the median over retunes spread across the signal. Each retune starts the
+// demodulator and decoder from scratch at a random carrier phase and bit timing.
+static void acquisition(bool gearShifting, const std::vector<dsp::complex_t>& sig, double& piMs, double& syncMs, int& missed) {
+	const int BUF_SIZE = 250;
+	const int RETUNES = 40;
+	const int TIMEOUT = 5 * RDS_SAMPLERATE;
+	dsp::stream<dsp::complex_t> dummy;
+	std::vector<float> soft(BUF_SIZE);
+	std::vector<uint8_t> hard(BUF_SIZE);
+	std::vector<double> piTimes, syncTimes;
+	missed = 0;
+
+	int stride = (sig.size() - TIMEOUT) / RETUNES;
+	for (int r = 0; r < RETUNES; r++) {
+		RDSDemod demod;
+		rds::Decoder decoder;
+		demod.init(&dummy);
+		demod.setGearShifting(gearShifting);
+
+		rds::RDSState st;
+		int start = r * stride + r * 37;
+		for (int i = start; i + BUF_SIZE <= start + TIMEOUT; i += BUF_SIZE) {
+			std::vector<dsp::complex_t> buf(sig.begin() + i, sig.begin() + i + BUF_SIZE);
+			int count = demod.process(BUF_SIZE, buf.data(), soft.data(), hard.data());
+			decoder.process(hard.data(), count);
+
+			// Same as the module's decoder handlers
+			rds::SyncState sync = decoder.getSyncState();
+			if (sync == rds::SYNC_STATE_STABLE) { demod.requestGear(RDS_GEAR_TRACK); }
+			else if (sync == rds::SYNC_STATE_SEARCHING) { demod.requestGear(RDS_GEAR_ACQUIRE); }
+
+			st = decoder.getState();
+			if (st.firstPI) { break; }
+		}
+		if (!st.firstPI) {
+			missed++;
+			continue;
+		}
+		piTimes.push_back(st.timeToFirstPIMs());
+		syncTimes.push_back(st.timeToStableSyncMs() < 0 ? st.timeToFirstPIMs() : st.timeToStableSyncMs());
+	}
+
+	auto median = [](std::vector<double>& v) {
+		if (v.empty()) { return -1.0; }
+		std::sort(v.begin(), v.end());
+		return v[v.size() / 2];
+	};
+	piMs = median(piTimes);
+	syncMs = median(syncTimes);
+}
+
+// Share of the sent blocks that each diversity variant decodes on its own, and that the combiner gets out of all of them
+static void diversity(int variants, const std::vector<dsp::complex_t>& sig, int sentBlocks, double* single, double& combined) {
+	const int BUF_SIZE = 1000;
+	dsp::stream<dsp::complex_t> dummy;
+	RDSDemod demods[RDS_DIVERSITY_MAX_VARIANTS];
+	rds::Decoder out;
+	rds::DiversityCombiner combiner;
+	for (int v = 0; v < variants; v++) {
+		demods[v].init(&dummy, RDS_OUTPUT_SOFT);
+		configureDiversityVariant(demods[v], v);
+	}
+	combiner.init(variants, &out);
+
+	std::vector<dsp::complex_t> buf(BUF_SIZE);
+	std::vector<float> soft(BUF_SIZE);
+	std::vector<uint8_t> hard(BUF_SIZE);
+	for (int i = 0; i + BUF_SIZE <= (int)sig.size(); i += BUF_SIZE) {
+		for (int v = 0; v < variants; v++) {
+			std::copy(sig.begin() + i, sig.begin() + i + BUF_SIZE, buf.begin());
+			int count = demods[v].process(BUF_SIZE, buf.data(), soft.data(), hard.data());
+			combiner.processSoft(v, soft.data(), count);
+		}
+		combiner.combine();
+	}
+
+	rds::DiversityStats stats = combiner.getStats();
+	for (int v = 0; v < variants; v++) { single[v] = (double)stats.variantValid[v] / sentBlocks; }
+	combined = (double)stats.valid / sentBlocks;
+}
+
+int main() {
+	const int SECONDS = 60;
+	const int BUFFER_SIZES[] = { 50, 250, 1000, 5000, 50000 };
+
+	std::vector<dsp::complex_t> sig = makeSignal(SECONDS * RDS_SAMPLERATE);
+
+	printf("%-8s %-10s %12s %14s\n", "filter", "buffer", "ns/sample", "CPU/channel");
+	for (int bufSize : BUFFER_SIZES) { bench(RDS_FILTER_LOWPASS, RDS_TIMING_MM, "lowpass", bufSize, sig); }
+	for (int bufSize : BUFFER_SIZES) { bench(RDS_FILTER_MATCHED, RDS_TIMING_MM, "matched", bufSize, sig); }
+	for (int bufSize : BUFFER_SIZES) { bench(RDS_FILTER_LOWPASS, RDS_TIMING_GARDNER, "gardner", bufSize, sig); }
+
+	// Sensitivity of the 2 samples per bit Gardner path against MM at 5000 S/s, and of MM with the narrow tracking loops
+	printf("\n%-8s %12s %12s %14s\n", "sigma", "MM BER", "Gardner BER", "MM track BER");
+	for (float sigma : { 0.2f, 0.4f, 0.6f, 0.8f, 1.0f }) {
+		std::vector<uint8_t> sent;
+		std::vector<dsp::complex_t> noisy = makeSignal(SECONDS * RDS_SAMPLERATE, sigma, &sent);
+		printf("%-8.2f %12.2e %12.2e %14.2e\n", sigma, sensitivity(RDS_TIMING_MM, noisy, sent), sensitivity(RDS_TIMING_GARDNER, noisy, sent),
+			   sensitivity(RDS_TIMING_MM, noisy, sent, RDS_GEAR_TRACK));
+	}
+
+	// Lock time after a retune, fixed loops against starting wide and narrowing on stable sync
+	printf("\n%-8s %-8s %14s %14s %8s\n", "sigma", "loops", "first PI ms", "stable ms", "missed");
+	{
+		std::vector<uint8_t> groups = makeStream(104 * 1000);
+		for (float sigma : { 0.2f, 0.5f, 0.8f }) {
+			std::vector<dsp::complex_t> noisy = makeSignal(SECONDS * RDS_SAMPLERATE, sigma, NULL, &groups);
+			for (bool gear : { false, true }) {
+				double piMs, syncMs;
+				int missed;
+				acquisition(gear, noisy, piMs, syncMs, missed);
+				printf("%-8.2f %-8s %14.1f %14.1f %8d\n", sigma, gear ? "gear" : "fixed", piMs, syncMs, missed);
+			}
+		}
+	}
+
+	// Valid blocks from each variant alone against all of them combined
+	printf("\n%-8s", "sigma");
+	for (int v = 0; v < RDS_DIVERSITY_MAX_VARIANTS; v++) { printf(" %15s", RDS_DIVERSITY_VARIANTS[v].name); }
+	printf(" %10s %10s\n", "best", "combined");
+	{
+		std::vector<uint8_t> groups = makeStream(104 * 1000);
+		for (float sigma : { 0.6f, 0.8f, 1.0f }) {
+			std::vector<uint8_t> sent;
+			std::vector<dsp::complex_t> noisy = makeSignal(SECONDS * RDS_SAMPLERATE, sigma, &sent, &groups);
+			double single[RDS_DIVERSITY_MAX_VARIANTS], combined;
+			diversity(RDS_DIVERSITY_MAX_VARIANTS, noisy, sent.size() / rds::BLOCK_LEN, single, combined);
+			printf("%-8.2f", sigma);
+			for (int v = 0; v < RDS_DIVERSITY_MAX_VARIANTS; v++) { printf(" %14.1f%%", 100.0 * single[v]); }
+			printf(" %9.1f%% %9.1f%%\n", 100.0 * *std::max_element(single, single + RDS_DIVERSITY_MAX_VARIANTS), 100.0 * combined);
+		}
+	}
+
+	// The filter on its own against the complex band-pass FIR it replaced
+	printf("\n%-24s %12s\n", "filter only", "ns/sample");
+	{
+		const int BUF_SIZE = 1000;
+		std::vector<dsp::complex_t> out(BUF_SIZE);
+
+		dsp::tap<dsp::complex_t> taps = dsp::taps::bandPass<dsp::complex_t>(0, 2375, 100, 5000);
+		dsp::filter::FIR<dsp::complex_t, dsp::complex_t> fir;
+		fir.init(NULL, taps);
+		RDSFilter lowpass, matched, decimated;
+		lowpass.init(RDS_FILTER_LOWPASS);
+		matched.init(RDS_FILTER_MATCHED);
+		decimated.init(RDS_FILTER_LOWPASS);
+
+		auto time = [&](const char* name, auto func) {
+			auto start = std::chrono::high_resolution_clock::now();
+			int processed = 0;
+			for (int i = 0; i + BUF_SIZE <= (int)sig.size(); i += BUF_SIZE) {
+				func(&sig[i], out.data());
+				processed += BUF_SIZE;
+			}
+			double secs = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			printf("%-24s %12.2f\n", name, secs * 1e9 / processed);
+		};
+		time("complex band-pass FIR", [&](const dsp::complex_t* in, dsp::complex_t* o) { fir.process(BUF_SIZE, (dsp::complex_t*)in, o); });
+		time("RDSFilter lowpass", [&](const dsp::complex_t* in, dsp::complex_t* o) { lowpass.process(BUF_SIZE, in, o); });
+		time("RDSFilter matched", [&](const dsp::complex_t* in, dsp::complex_t* o) { matched.process(BUF_SIZE, in, o); });
+		time("RDSFilter lowpass 2375", [&](const dsp::complex_t* in, dsp::complex_t* o) { decimated.processDecimated(BUF_SIZE, in, o); });
+
+		dsp::taps::free(taps);
+	}
+
+	// From the 250kHz MPX to 5000 S/s, per MPX sample and as a share of one core per channel
+	printf("\n%-24s %12s %14s\n", "front end", "ns/sample", "CPU/channel");
+	{
+		const double MPX_SAMPLERATE = 250000.0;
+		const int BUF_SIZE = 12500;
+		const int MPX_SECONDS = 10;
+		std::mt19937 rng(1234);
+		std::normal_distribution<float> noise(0.0f, 0.5f);
+		std::vector<float> mpx(MPX_SECONDS * MPX_SAMPLERATE);
+		for (auto& v : mpx) { v = noise(rng); }
+		std::vector<dsp::complex_t> mpxc(BUF_SIZE), mixed(BUF_SIZE), out(BUF_SIZE);
+
+		dsp::channel::FrequencyXlator xlator;
+		dsp::multirate::RationalResampler<dsp::complex_t> resamp;
+		xlator.init(NULL, -57000.0, MPX_SAMPLERATE);
+		resamp.init(NULL, MPX_SAMPLERATE, 5000.0);
+		RDSFrontEnd front, frontMixed;
+		front.init(MPX_SAMPLERATE);
+		frontMixed.init(MPX_SAMPLERATE);
+
+		auto time = [&](const char* name, auto func) {
+			auto start = std::chrono::high_resolution_clock::now();
+			int processed = 0;
+			for (int i = 0; i + BUF_SIZE <= (int)mpx.size(); i += BUF_SIZE) {
+				func(&mpx[i]);
+				processed += BUF_SIZE;
+			}
+			double secs = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			printf("%-24s %12.2f %13.4f%%\n", name, secs * 1e9 / processed, 100.0 * secs / (processed / MPX_SAMPLERATE));
+		};
+		time("xlator + resampler", [&](const float* in) {
+			for (int i = 0; i < BUF_SIZE; i++) { mpxc[i] = { in[i], 0.0f }; }
+			xlator.process(BUF_SIZE, mpxc.data(), mixed.data());
+			resamp.process(BUF_SIZE, mixed.data(), out.data());
+		});
+		time("RDSFrontEnd", [&](const float* in) { front.process(BUF_SIZE, in, out.data()); });
+		// The decimation alone, what's left when the pilot does the mixing
+		for (int i = 0; i < BUF_SIZE; i++) { mixed[i] = { mpx[i], mpx[i] }; }
+		time("RDSFrontEnd mixed", [&](const float* in) { frontMixed.processMixed(BUF_SIZE, mixed.data(), out.data()); });
+		printf("%-24s %12.2f ms\n", "group delay", front.getGroupDelay() * 1e3);
+	}
+
+	// A 10MHz source split into 100kHz channels at 400kHz, per source sample and as a share of one core
+	printf("\n%-24s %12s %14s\n", "channelizer", "ns/sample", "CPU");
+	{
+		const double WIDE_SAMPLERATE = 10e6;
+		const int BUF_SIZE = 50000;
+		const int CHANNELS = 100;
+		const int DECIM = 25;
+		std::mt19937 rng(1234);
+		std::normal_distribution<float> noise(0.0f, 0.5f);
+		std::vector<dsp::complex_t> wide(WIDE_SAMPLERATE);
+		for (auto& v : wide) { v = { noise(rng), noise(rng) }; }
+		std::vector<dsp::complex_t> mixed(BUF_SIZE), out(BUF_SIZE);
+
+		dsp::tap<float> proto = dsp::taps::lowPass(150000.0, 100000.0, WIDE_SAMPLERATE);
+		PolyphaseChannelizer channelizer(CHANNELS, DECIM, proto.taps, proto.size);
+		dsp::taps::free(proto);
+		dsp::channel::FrequencyXlator xlator;
+		dsp::multirate::RationalResampler<dsp::complex_t> resamp;
+		xlator.init(NULL, 1.3e6, WIDE_SAMPLERATE);
+		resamp.init(NULL, WIDE_SAMPLERATE, WIDE_SAMPLERATE / DECIM);
+
+		auto time = [&](const char* name, auto func) {
+			auto start = std::chrono::high_resolution_clock::now();
+			int processed = 0;
+			for (int i = 0; i + BUF_SIZE <= (int)wide.size(); i += BUF_SIZE) {
+				func(&wide[i]);
+				processed += BUF_SIZE;
+			}
+			double secs = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			printf("%-24s %12.2f %13.4f%%\n", name, secs * 1e9 / processed, 100.0 * secs / (processed / WIDE_SAMPLERATE));
+			return secs;
+		};
+		// Every channel written out, the worst case for the monitor
+		std::vector<dsp::complex_t> chanOut(CHANNELS * (BUF_SIZE / DECIM + 1));
+		std::vector<int> chans(CHANNELS);
+		std::vector<dsp::complex_t*> outs(CHANNELS);
+		for (int k = 0; k < CHANNELS; k++) {
+			chans[k] = k;
+			outs[k] = &chanOut[k * (BUF_SIZE / DECIM + 1)];
+		}
+		double bank = time("polyphase FFT, 100 ch", [&](const dsp::complex_t* in) { channelizer.process(BUF_SIZE, in, CHANNELS, chans.data(), outs.data()); });
+		double single = time("xlator + resampler, 1 ch", [&](const dsp::complex_t* in) {
+			xlator.process(BUF_SIZE, (dsp::complex_t*)in, mixed.data());
+			resamp.process(BUF_SIZE, mixed.data(), out.data());
+		});
+		printf("%-24s %12.1f channels\n", "break even", bank / single);
+	}
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <rds.h>
+#include <rds_syndrome.h>
+#include <vector>
+
+// Synthetic RDS group streams shared by the benchmarks
+
+// Checkword that gives a valid block, inverse of the syndrome of the 10 check bits
+static std::vector<uint16_t> makeCheckTable() {
+	std::vector<uint16_t> table(1 << rds::POLY_LEN);
+	for (uint32_t c = 0; c < (1u << rds::POLY_LEN); c++) { table[rds::calcSyndromeSerial(c)] = c; }
+	return table;
+}
+
+static uint32_t encodeBlock(const std::vector<uint16_t>& checks, uint16_t data, rds::BlockType type) {
+	uint32_t block = (uint32_t)data << rds::POLY_LEN;
+	block |= checks[rds::calcSyndromeTable(block)];
+	return block ^ rds::OFFSET_WORDS[type];
+}
+
+static void pushGroup(std::vector<uint8_t>& bits, const std::vector<uint16_t>& checks, uint16_t a, uint16_t b, uint16_t c, uint16_t d) {
+	bool verB = (b >> 11) & 1;
+	uint32_t blocks[4] = {
+		encodeBlock(checks, a, rds::BLOCK_TYPE_A),
+		encodeBlock(checks, b, rds::BLOCK_TYPE_B),
+		encodeBlock(checks, c, verB ? rds::BLOCK_TYPE_CP : rds::BLOCK_TYPE_C),
+		encodeBlock(checks, d, rds::BLOCK_TYPE_D)
+	};
+	for (uint32_t block : blocks) {
+		for (int i = rds::BLOCK_LEN - 1; i >= 0; i--) { bits.push_back((block >> i) & 1); }
+	}
+}
+
+// PS and radiotext from a fictional station, the most common mix on air
+static std::vector<uint8_t> makeStream(int bitCount) {
+	const std::vector<uint16_t> checks = makeCheckTable();
+	const uint16_t pi = 0x2345;
+	const char* ps = "BENCH FM";
+	const char* rt = "Now playing: the quick brown fox jumps over the lazy dog 0123456";
+
+	std::vector<uint8_t> bits;
+	while ((int)bits.size() < bitCount) {
+		for (int s = 0; s < 4; s++) {
+			uint16_t b = (0 << 12) | (1 << 10) | (10 << 5) | (1 << 2) | s;
+			pushGroup(bits, checks, pi, b, (225 << 8) | 10, ((uint8_t)ps[s * 2] << 8) | (uint8_t)ps[s * 2 + 1]);
+		}
+		for (int s = 0; s < 16; s++) {
+			uint16_t b = (2 << 12) | (1 << 10) | (10 << 5) | s;
+			pushGroup(bits, checks, pi, b, ((uint8_t)rt[s * 4] << 8) | (uint8_t)rt[s * 4 + 1], ((uint8_t)rt[s * 4 + 2] << 8) | (uint8_t)rt[s * 4 + 3]);
+		}
+	}
+	bits.resize(bitCount);
+	return bits;
+}
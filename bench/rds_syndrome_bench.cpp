@@ -0,0 +1,87 @@
+#include <rds_syndrome.h>
+#include <stdio.h>
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+
+// Compares the sync hunting cost of the legacy bit-serial syndrome + std::map lookup
+// against the table driven and incremental syndrome engines in rds_syndrome.h
+
+static const std::map<uint16_t, rds::BlockType> LEGACY_SYNDROMES = {
+	{ 0b1111011000, rds::BLOCK_TYPE_A  },
+	{ 0b1111010100, rds::BLOCK_TYPE_B  },
+	{ 0b1001011100, rds::BLOCK_TYPE_C  },
+	{ 0b1111001100, rds::BLOCK_TYPE_CP },
+	{ 0b1001011000, rds::BLOCK_TYPE_D  }
+};
+
+template <class F>
+static void run(const char* name, const std::vector<uint8_t>& bits, int passes, F func) {
+	auto start = std::chrono::high_resolution_clock::now();
+	int found = 0;
+	for (int p = 0; p < passes; p++) { found += func(); }
+	auto end = std::chrono::high_resolution_clock::now();
+	double secs = std::chrono::duration<double>(end - start).count();
+	double bitsPerSec = ((double)bits.size() * passes) / secs;
+	printf("%-24s %10.2f Mbit/s  (%d matches)\n", name, bitsPerSec / 1e6, found);
+}
+
+int main() {
+	const int BIT_COUNT = 1 << 20;
+	const int PASSES = 20;
+
+	// Random bits, this is what the decoder sees while hunting for sync
+	std::vector<uint8_t> bits(BIT_COUNT);
+	std::mt19937 rng(1234);
+	for (auto& b : bits) { b = rng() & 1; }
+
+	// Make sure all implementations agree before timing anything
+	uint32_t reg = 0;
+	uint16_t syn = 0;
+	for (uint8_t b : bits) {
+		uint8_t outBit = (reg >> (rds::BLOCK_LEN - 1)) & 1;
+		reg = ((reg << 1) & rds::BLOCK_MASK) | b;
+		syn = rds::shiftSyndrome(syn, outBit, b);
+		uint16_t ref = rds::calcSyndromeSerial(reg);
+		if (ref != rds::calcSyndromeTable(reg) || ref != syn) {
+			printf("Syndrome mismatch for block %07X\n", reg);
+			return 1;
+		}
+	}
+
+	run("serial + std::map", bits, PASSES, [&]() {
+		uint32_t reg = 0;
+		int found = 0;
+		for (uint8_t b : bits) {
+			reg = ((reg << 1) & rds::BLOCK_MASK) | b;
+			found += LEGACY_SYNDROMES.find(rds::calcSyndromeSerial(reg)) != LEGACY_SYNDROMES.end();
+		}
+		return found;
+	});
+
+	run("byte tables + array", bits, PASSES, [&]() {
+		uint32_t reg = 0;
+		int found = 0;
+		for (uint8_t b : bits) {
+			reg = ((reg << 1) & rds::BLOCK_MASK) | b;
+			found += rds::SYNDROME_TO_TYPE[rds::calcSyndromeTable(reg)] != rds::_BLOCK_TYPE_COUNT;
+		}
+		return found;
+	});
+
+	run("incremental + array", bits, PASSES, [&]() {
+		uint32_t reg = 0;
+		uint16_t syn = 0;
+		int found = 0;
+		for (uint8_t b : bits) {
+			uint8_t outBit = (reg >> (rds::BLOCK_LEN - 1)) & 1;
+			reg = ((reg << 1) & rds::BLOCK_MASK) | b;
+			syn = rds::shiftSyndrome(syn, outBit, b);
+			found += rds::SYNDROME_TO_TYPE[syn] != rds::_BLOCK_TYPE_COUNT;
+		}
+		return found;
+	});
+
+	return 0;
+}
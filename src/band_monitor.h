@@ -0,0 +1,340 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <condition_variable>
+#include <math.h>
+#include <dsp/block.h>
+#include <dsp/taps/low_pass.h>
+#include "channelizer.h"
+#include "broadcast_fm.h"
+#include "rds_demod.h"
+#include "rds.h"
+#include "dsp_pool.h"
+
+// What the band monitor knows about one station
+struct BandStation {
+	double frequency;
+	// Channel power over the band's noise floor
+	float snr;
+	rds::RDSState rds;
+};
+
+// Decodes RDS from every station in a wideband IQ stream at once. A PolyphaseChannelizer splits the input on a fixed
+// raster and every channel that stands out of the noise gets its own BroadcastFM, RDSDemod and rds::Decoder, run on
+// the shared DSPPool. Needs an input rate that's a multiple of the channel rate, 400kHz.
+class BandMonitor : public dsp::block {
+public:
+	// Called for every input buffer, returns the input's samplerate and center frequency
+	typedef void (*InputHandler)(double& samplerate, double& center, void* ctx);
+
+	static constexpr double CHANNEL_SAMPLERATE = 400000.0;
+	static constexpr int MAX_STATIONS = 64;
+
+	BandMonitor() {}
+	BandMonitor(dsp::stream<dsp::complex_t>* in, InputHandler handler, void* ctx, double spacing) { init(in, handler, ctx, spacing); }
+	~BandMonitor() {
+		if (!_block_init) { return; }
+		stop();
+	}
+
+	void init(dsp::stream<dsp::complex_t>* in, InputHandler handler, void* ctx, double spacing) {
+		_in = in;
+		_handler = handler;
+		_ctx = ctx;
+		_spacing = spacing;
+		registerInput(_in);
+		_block_init = true;
+	}
+
+	void setInput(dsp::stream<dsp::complex_t>* in) {
+		assert(_block_init);
+		std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+		tempStop();
+		unregisterInput(_in);
+		_in = in;
+		registerInput(_in);
+		tempStart();
+	}
+
+	// 100kHz covers every raster, 200kHz only the stations on odd multiples of 100kHz but halves the FFT
+	void setSpacing(double spacing) {
+		assert(_block_init);
+		std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+		tempStop();
+		_spacing = spacing;
+		samplerate = 0.0;
+		tempStart();
+	}
+
+	// False when the input rate can't be split on the raster, the monitor then just drops its input
+	bool isSupported() { return supported; }
+
+	// Copy of every station currently decoded, by frequency
+	std::vector<BandStation> getStations() {
+		std::lock_guard<std::mutex> lck(tableMtx);
+		std::vector<BandStation> out;
+		for (auto& slot : slots) {
+			if (!slot->active) { continue; }
+			out.push_back({ slot->frequency, slot->snr, slot->decoder.getState() });
+		}
+		std::sort(out.begin(), out.end(), [](const BandStation& a, const BandStation& b) { return a.frequency < b.frequency; });
+		return out;
+	}
+
+	int run() {
+		int count = _in->read();
+		if (count < 0) { return -1; }
+
+		// Follow the source, which means starting over with every station
+		double sr = 0.0, center = 0.0;
+		_handler(sr, center, _ctx);
+		if (sr != samplerate) { configure(sr, center); }
+		else if (center != centerFreq) { retune(center); }
+
+		if (supported) {
+			for (int i = 0; i < count; i += PolyphaseChannelizer::MAX_CHUNK) {
+				int n = std::min<int>(count - i, PolyphaseChannelizer::MAX_CHUNK);
+				processChunk(n, &_in->readBuf[i]);
+			}
+			updateStations(count);
+		}
+
+		_in->flush();
+		return count;
+	}
+
+private:
+	struct Slot {
+		Slot() {
+			fm.init(NULL, 75000.0, CHANNEL_SAMPLERATE, false, false, true);
+			fm.setAudio(false);
+			rdsDemod.init(NULL, RDS_OUTPUT_SOFT);
+			iq = dsp::buffer::alloc<dsp::complex_t>(SLOT_BUFFER_SIZE);
+			rdsBB = dsp::buffer::alloc<dsp::complex_t>(SLOT_BUFFER_SIZE);
+			soft = dsp::buffer::alloc<float>(SLOT_BUFFER_SIZE);
+			bits = dsp::buffer::alloc<uint8_t>(SLOT_BUFFER_SIZE);
+		}
+		~Slot() {
+			dsp::buffer::free(iq);
+			dsp::buffer::free(rdsBB);
+			dsp::buffer::free(soft);
+			dsp::buffer::free(bits);
+		}
+
+		BandMonitor* _this;
+		bool active = false;
+		int bin = 0;
+		double frequency = 0.0;
+		float snr = 0.0f;
+		// Channel samples since the station last stood out of the noise
+		int quiet = 0;
+		int count = 0;
+
+		BroadcastFM fm;
+		RDSDemod rdsDemod;
+		rds::Decoder decoder;
+
+		dsp::complex_t* iq;
+		dsp::complex_t* rdsBB;
+		float* soft;
+		uint8_t* bits;
+	};
+
+	// Sets up the channelizer for a new input rate, a rate that doesn't decimate to the channel rate is left unsupported
+	void configure(double sr, double center) {
+		samplerate = sr;
+		releaseAll();
+		double decim = sr / CHANNEL_SAMPLERATE;
+		double channels = sr / _spacing;
+		supported = (sr > 0.0 && decim >= 2.0 && decim == floor(decim) && channels == floor(channels));
+		if (!supported) { return; }
+
+		// Passes a whole station plus a bit of drift, and is gone by the channel's Nyquist frequency
+		dsp::tap<float> proto = dsp::taps::lowPass(150000.0, 100000.0, sr);
+		channelizer.init((int)channels, (int)decim, proto.taps, proto.size);
+		dsp::taps::free(proto);
+
+		binCount = (int)channels;
+		binPower.assign(binCount, 0.0f);
+		binLevel.assign(binCount, NO_LEVEL);
+		binSlot.assign(binCount, -1);
+		centerFreq = NAN;
+		retune(center);
+	}
+
+	// Shift the input so every channel lands on the raster
+	void retune(double center) {
+		centerFreq = center;
+		releaseAll();
+		double offset = fmod(center - RASTER_ORIGIN, _spacing);
+		if (offset > _spacing / 2.0) { offset -= _spacing; }
+		if (offset < -_spacing / 2.0) { offset += _spacing; }
+		alignedCenter = center - offset;
+		channelizer.setShift(offset, samplerate);
+		channelizer.reset();
+		std::fill(binLevel.begin(), binLevel.end(), NO_LEVEL);
+	}
+
+	void releaseAll() {
+		std::lock_guard<std::mutex> lck(tableMtx);
+		for (auto& slot : slots) { slot->active = false; }
+		std::fill(binSlot.begin(), binSlot.end(), -1);
+		activeCount = 0;
+	}
+
+	void processChunk(int count, const dsp::complex_t* in) {
+		// Only the active stations' channels are written out
+		int chans[MAX_STATIONS];
+		dsp::complex_t* outs[MAX_STATIONS];
+		Slot* active[MAX_STATIONS];
+		int n = 0;
+		for (auto& slot : slots) {
+			if (!slot->active) { continue; }
+			chans[n] = slot->bin;
+			outs[n] = slot->iq;
+			active[n++] = slot.get();
+		}
+		int outCount = channelizer.process(count, in, n, chans, outs);
+		if (!n || !outCount) { return; }
+
+		// Every station on a worker of its own, and wait for all of them before the channels get overwritten
+		pending = n;
+		for (int i = 0; i < n; i++) {
+			active[i]->count = outCount;
+			DSPPool::shared().submit({ processSlot, active[i] });
+		}
+		std::unique_lock<std::mutex> lck(doneMtx);
+		doneCV.wait(lck, [&]() { return pending == 0; });
+	}
+
+	static void processSlot(void* ctx) {
+		Slot* slot = (Slot*)ctx;
+		int rdsCount = 0;
+		slot->fm.process(slot->count, slot->iq, NULL, rdsCount, slot->rdsBB);
+		int bits = slot->rdsDemod.processBuffer(rdsCount, slot->rdsBB, slot->soft, slot->bits);
+		slot->decoder.processSoft(slot->soft, bits);
+
+		BandMonitor* _this = slot->_this;
+		std::lock_guard<std::mutex> lck(_this->doneMtx);
+		if (--_this->pending == 0) { _this->doneCV.notify_all(); }
+	}
+
+	// Compare every channel to the band's noise floor, start decoding the ones that stand out and drop the ones gone
+	void updateStations(int inCount) {
+		int outCount = channelizer.readPower(binPower.data());
+		if (!outCount) { return; }
+
+		// Channels too close to the edge of the input would be cut off
+		int usable = (int)floor((samplerate / 2.0 - 100000.0) / _spacing);
+		std::vector<float> levels;
+		levels.reserve(binCount);
+		float alpha = 1.0f - expf(-(float)inCount / (float)(samplerate * LEVEL_TIME_CONSTANT));
+		for (int k = 0; k < binCount; k++) {
+			float level = 10.0f * log10f(binPower[k] + 1e-20f);
+			binLevel[k] = (binLevel[k] == NO_LEVEL) ? level : binLevel[k] + alpha * (level - binLevel[k]);
+			if (binUsable(k, usable)) { levels.push_back(binLevel[k]); }
+		}
+		if (levels.empty()) { return; }
+
+		// A station spills into the channels next to it, so even a narrow band with a few stations has most of its
+		// channels above the noise. A low percentile still finds it.
+		int floorIdx = (int)(levels.size() * FLOOR_PERCENTILE);
+		std::nth_element(levels.begin(), levels.begin() + floorIdx, levels.end());
+		float floorLevel = levels[floorIdx];
+
+		std::lock_guard<std::mutex> lck(tableMtx);
+		for (int k = 0; k < binCount; k++) {
+			if (!binUsable(k, usable)) { continue; }
+			float snr = binLevel[k] - floorLevel;
+			bool peak = isPeak(k);
+			int s = binSlot[k];
+			if (s >= 0) {
+				Slot* slot = slots[s].get();
+				slot->snr = snr;
+				slot->quiet = (snr < RELEASE_SNR || !peak) ? slot->quiet + outCount : 0;
+				if (slot->quiet > (int)(RELEASE_TIME * CHANNEL_SAMPLERATE)) {
+					slot->active = false;
+					binSlot[k] = -1;
+					activeCount--;
+				}
+			}
+			else if (snr > ACQUIRE_SNR && peak && activeCount < MAX_STATIONS) {
+				int bin = (k < binCount / 2) ? k : k - binCount;
+				acquire(k, alignedCenter + (double)bin * _spacing, snr);
+			}
+		}
+	}
+
+	// Only the channel a station is centered on is louder than both of its neighbours
+	bool isPeak(int k) {
+		int prev = (k + binCount - 1) % binCount;
+		int next = (k + 1) % binCount;
+		return binLevel[k] >= binLevel[prev] && binLevel[k] >= binLevel[next];
+	}
+
+	bool binUsable(int k, int usable) {
+		int bin = (k < binCount / 2) ? k : k - binCount;
+		return std::abs(bin) <= usable;
+	}
+
+	// Take a free slot for a new station, slots are only ever allocated once and then reused
+	void acquire(int k, double frequency, float snr) {
+		int s = 0;
+		for (; s < (int)slots.size(); s++) {
+			if (!slots[s]->active) { break; }
+		}
+		if (s == (int)slots.size()) {
+			slots.emplace_back(new Slot());
+			slots[s]->_this = this;
+		}
+		Slot* slot = slots[s].get();
+		slot->fm.reset();
+		slot->rdsDemod.reset();
+		slot->decoder.reset();
+		slot->active = true;
+		slot->bin = k;
+		slot->frequency = frequency;
+		slot->snr = snr;
+		slot->quiet = 0;
+		binSlot[k] = s;
+		activeCount++;
+	}
+
+	// Every station's raster is a multiple of 100kHz off 87.5MHz, which puts the 200kHz one on the odd multiples
+	static constexpr double RASTER_ORIGIN = 87.5e6;
+	static constexpr float NO_LEVEL = -1000.0f;
+	static constexpr float LEVEL_TIME_CONSTANT = 0.1f;
+	static constexpr float FLOOR_PERCENTILE = 0.2f;
+	static constexpr float ACQUIRE_SNR = 15.0f;
+	static constexpr float RELEASE_SNR = 10.0f;
+	static constexpr double RELEASE_TIME = 2.0;
+	static const int SLOT_BUFFER_SIZE = PolyphaseChannelizer::MAX_CHUNK / 2 + 1;
+
+	dsp::stream<dsp::complex_t>* _in = NULL;
+	InputHandler _handler = NULL;
+	void* _ctx = NULL;
+	double _spacing = 100000.0;
+
+	double samplerate = 0.0;
+	double centerFreq = 0.0;
+	double alignedCenter = 0.0;
+	bool supported = false;
+
+	PolyphaseChannelizer channelizer;
+	int binCount = 0;
+	std::vector<float> binPower;
+	// Smoothed power of every channel in dB
+	std::vector<float> binLevel;
+	// Slot decoding each channel, -1 if none
+	std::vector<int> binSlot;
+
+	std::mutex tableMtx;
+	std::vector<std::unique_ptr<Slot>> slots;
+	int activeCount = 0;
+
+	std::mutex doneMtx;
+	std::condition_variable doneCV;
+	int pending = 0;
+};
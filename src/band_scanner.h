@@ -0,0 +1,293 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <math.h>
+#include <string.h>
+#include "rds.h"
+
+// What the scanner needs to know about the frequency it's on
+struct ScanStatus {
+	bool pilot = false;
+	// See RDSDemod::getSymbolQuality()
+	float rdsQuality = 0.0f;
+	rds::RDSState rds;
+};
+
+// A station found by the scanner
+struct ScanEntry {
+	double frequency;
+	uint16_t pi;
+	// Blank for the segments that didn't come in
+	char ps[8 * rds::UTF8_MAX_CHAR_LEN + 1];
+	bool psComplete;
+	rds::ProgramType pty;
+	std::array<uint32_t, 25> afs;
+	uint8_t afCount;
+	// How long the scanner stayed there and how long the decoder took to the first PI
+	double dwellMs;
+	double timeToFirstPIMs;
+};
+
+struct ScanStats {
+	uint32_t sweeps = 0;
+	double lastSweepSeconds = 0.0;
+	uint64_t visited = 0;
+	uint64_t found = 0;
+	// Left before the PI deadline because there was nothing there
+	uint64_t earlyAborts = 0;
+	// Left at the PI deadline without a PI
+	uint64_t deadlines = 0;
+	double meanHitDwellMs = 0.0;
+	double meanMissDwellMs = 0.0;
+	double meanTimeToPIMs = 0.0;
+	double maxTimeToPIMs = 0.0;
+};
+
+// Steps the receiver across a range and waits on every frequency just long enough to get its PI, or its whole PS when
+// asked to. Frequencies without a pilot or anything that looks like RDS symbols are left early, most of the band is
+// empty so that's most of the sweep. Runs on its own thread and sweeps again until stopped.
+class BandScanner {
+public:
+	// Moves the receiver to freq, the decoder has to be reset by the time it returns
+	typedef void (*TuneHandler)(double freq, void* ctx);
+	typedef void (*StatusHandler)(ScanStatus& status, void* ctx);
+
+	// Symbol quality below this is noise, which sits around 2/pi
+	static constexpr float RDS_QUALITY_THRESHOLD = 0.72f;
+
+	BandScanner() {}
+	BandScanner(TuneHandler tune, StatusHandler status, void* ctx) { init(tune, status, ctx); }
+	~BandScanner() { stop(); }
+
+	void init(TuneHandler tune, StatusHandler status, void* ctx) {
+		_tune = tune;
+		_status = status;
+		_ctx = ctx;
+	}
+
+	// Takes effect on the next sweep
+	void setRange(double start, double stop, double step) {
+		std::lock_guard<std::mutex> lck(tableMtx);
+		_start = std::min<double>(start, stop);
+		_stop = std::max<double>(start, stop);
+		_step = std::max<double>(step, 1.0);
+	}
+
+	// Stay until all four PS segments are in rather than leaving at the first PI
+	void setWaitForPS(bool enabled) { waitForPS = enabled; }
+
+	void start() {
+		if (running) { return; }
+		{
+			std::lock_guard<std::mutex> lck(stopMtx);
+			stopRequested = false;
+		}
+		running = true;
+		workerThread = std::thread(&BandScanner::worker, this);
+	}
+
+	void stop() {
+		if (!running) { return; }
+		{
+			std::lock_guard<std::mutex> lck(stopMtx);
+			stopRequested = true;
+		}
+		stopCV.notify_all();
+		workerThread.join();
+		running = false;
+	}
+
+	bool isRunning() { return running; }
+
+	// Current frequency, 0 when not running
+	double getFrequency() { return current.load(std::memory_order_relaxed); }
+
+	// Stations from the latest visit of each frequency, by frequency
+	std::vector<ScanEntry> getTable() {
+		std::lock_guard<std::mutex> lck(tableMtx);
+		return table;
+	}
+
+	ScanStats getStats() {
+		std::lock_guard<std::mutex> lck(tableMtx);
+		return stats;
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lck(tableMtx);
+		table.clear();
+		stats = ScanStats();
+		hitDwellSum = 0.0;
+		missDwellSum = 0.0;
+		piTimeSum = 0.0;
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	enum DwellResult {
+		DWELL_HIT,
+		DWELL_EARLY_ABORT,
+		DWELL_DEADLINE,
+		DWELL_STOPPED
+	};
+
+	void worker() {
+		while (true) {
+			double start, stop, step;
+			{
+				std::lock_guard<std::mutex> lck(tableMtx);
+				start = _start;
+				stop = _stop;
+				step = _step;
+			}
+
+			auto sweepStart = Clock::now();
+			int steps = (int)floor((stop - start) / step + 0.5);
+			for (int i = 0; i <= steps; i++) {
+				double freq = start + (double)i * step;
+				ScanStatus st;
+				DwellResult res = dwell(freq, st);
+				if (res == DWELL_STOPPED) {
+					current.store(0.0, std::memory_order_relaxed);
+					return;
+				}
+				record(freq, res, st);
+			}
+
+			std::lock_guard<std::mutex> lck(tableMtx);
+			stats.sweeps++;
+			stats.lastSweepSeconds = std::chrono::duration<double>(Clock::now() - sweepStart).count();
+		}
+	}
+
+	DwellResult dwell(double freq, ScanStatus& st) {
+		// The decoder's state is only about this frequency once it's been published after the reset
+		_status(st, _ctx);
+		rds::Timestamp mark = st.rds.time;
+		current.store(freq, std::memory_order_relaxed);
+		_tune(freq, _ctx);
+		tuned = Clock::now();
+
+		// A single block A can be a syndrome match on noise, so the PI only counts once it's been decoded twice or the
+		// decoder got to stable sync
+		uint16_t candidatePI = 0;
+		rds::Timestamp candidateTime = 0;
+		bool confirmed = false;
+
+		while (true) {
+			if (sleep(POLL_INTERVAL_MS)) { return DWELL_STOPPED; }
+			_status(st, _ctx);
+			double elapsed = elapsedMs();
+			bool fresh = st.rds.time > mark && st.rds.acquisitionStart >= mark;
+			bool quiet = st.rdsQuality < RDS_QUALITY_THRESHOLD;
+
+			if (fresh && st.rds.firstPI && !confirmed) {
+				if (st.rds.syncState == rds::SYNC_STATE_STABLE) { confirmed = true; }
+				else if (st.rds.blockALastUpdate != candidateTime) {
+					confirmed = (candidateTime && st.rds.piCode == candidatePI);
+					candidatePI = st.rds.piCode;
+					candidateTime = st.rds.blockALastUpdate;
+				}
+			}
+
+			if (confirmed) {
+				if (!waitForPS || st.rds.psComplete() || elapsed >= PS_DEADLINE_MS) { return DWELL_HIT; }
+				continue;
+			}
+
+			// Nothing to lock to, or the decoder still hasn't found a single block in what it's getting
+			if (elapsed >= EARLY_ABORT_MS && !st.pilot && quiet) { return DWELL_EARLY_ABORT; }
+			if (fresh && elapsed >= SEARCH_ABORT_MS && st.rds.syncState == rds::SYNC_STATE_SEARCHING && quiet) { return DWELL_EARLY_ABORT; }
+			if (elapsed >= PI_DEADLINE_MS) { return DWELL_DEADLINE; }
+		}
+	}
+
+	void record(double freq, DwellResult res, const ScanStatus& st) {
+		double dwellMs = elapsedMs();
+		std::lock_guard<std::mutex> lck(tableMtx);
+		stats.visited++;
+
+		// Whatever was there on the last sweep is gone unless it was found again
+		auto it = std::lower_bound(table.begin(), table.end(), freq, [](const ScanEntry& e, double f) { return e.frequency < f; });
+		bool exists = (it != table.end() && fabs(it->frequency - freq) < 1.0);
+		if (res != DWELL_HIT) {
+			if (res == DWELL_EARLY_ABORT) { stats.earlyAborts++; }
+			else { stats.deadlines++; }
+			missDwellSum += dwellMs;
+			stats.meanMissDwellMs = missDwellSum / (double)(stats.visited - stats.found);
+			if (exists) { table.erase(it); }
+			return;
+		}
+
+		ScanEntry entry;
+		entry.frequency = freq;
+		entry.pi = st.rds.piCode;
+		strcpy(entry.ps, st.rds.psUTF8);
+		entry.psComplete = st.rds.psComplete();
+		entry.pty = st.rds.programType;
+		entry.afs = st.rds.afs;
+		entry.afCount = st.rds.afCount;
+		entry.dwellMs = dwellMs;
+		entry.timeToFirstPIMs = st.rds.timeToFirstPIMs();
+		if (exists) { *it = entry; }
+		else { table.insert(it, entry); }
+
+		stats.found++;
+		hitDwellSum += dwellMs;
+		piTimeSum += entry.timeToFirstPIMs;
+		stats.meanHitDwellMs = hitDwellSum / (double)stats.found;
+		stats.meanTimeToPIMs = piTimeSum / (double)stats.found;
+		stats.maxTimeToPIMs = std::max<double>(stats.maxTimeToPIMs, entry.timeToFirstPIMs);
+	}
+
+	double elapsedMs() { return std::chrono::duration<double, std::milli>(Clock::now() - tuned).count(); }
+
+	// Returns true if stopped in the meantime
+	bool sleep(int ms) {
+		std::unique_lock<std::mutex> lck(stopMtx);
+		return stopCV.wait_for(lck, std::chrono::milliseconds(ms), [&]() { return stopRequested; });
+	}
+
+	// Long enough for the pilot detector and a window of symbols from the new frequency to come through
+	static const int EARLY_ABORT_MS = 80;
+	// About four and a half groups, a station with RDS is in sync long before that
+	static const int SEARCH_ABORT_MS = 400;
+	// A clean station sends its PI in every group, a second is plenty even with errors
+	static const int PI_DEADLINE_MS = 1000;
+	// Four group 0s, at least a quarter of the groups on most stations
+	static const int PS_DEADLINE_MS = 2500;
+	static const int POLL_INTERVAL_MS = 10;
+
+	TuneHandler _tune = NULL;
+	StatusHandler _status = NULL;
+	void* _ctx = NULL;
+
+	double _start = 87.5e6;
+	double _stop = 108e6;
+	double _step = 100000.0;
+	std::atomic<bool> waitForPS{ false };
+
+	std::thread workerThread;
+	bool running = false;
+	std::mutex stopMtx;
+	std::condition_variable stopCV;
+	bool stopRequested = false;
+
+	std::atomic<double> current{ 0.0 };
+	Clock::time_point tuned;
+
+	std::mutex tableMtx;
+	std::vector<ScanEntry> table;
+	ScanStats stats;
+	double hitDwellSum = 0.0;
+	double missDwellSum = 0.0;
+	double piTimeSum = 0.0;
+};
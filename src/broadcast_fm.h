@@ -0,0 +1,398 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <dsp/processor.h>
+#include <dsp/buffer/buffer.h>
+#include <dsp/taps/band_pass.h>
+#include <dsp/taps/low_pass.h>
+#include <dsp/filter/fir.h>
+#include <dsp/loop/pll.h>
+#include <dsp/loop/fast_agc.h>
+#include <dsp/loop/costas.h>
+#include <dsp/math/delay.h>
+#include <dsp/math/hz_to_rads.h>
+#include <dsp/convert/l_r_to_stereo.h>
+#include <dsp/channel/frequency_xlator.h>
+#include <dsp/multirate/rational_resampler.h>
+#include "fm_kernels.h"
+
+enum RDSCarrierSource {
+	// Free running 57kHz mixer, RDSDemod has to recover the carrier with its own Costas loop
+	RDS_CARRIER_COSTAS,
+	// Third harmonic of the stereo pilot, coherent from the first sample. Falls back to a Costas loop when there's no pilot.
+	RDS_CARRIER_PILOT
+};
+
+// Same as dsp::demod::BroadcastFM, but the pilot PLL is also used for the 57kHz RDS carrier when it's locked. The
+// discriminator and the stereo matrix are the SIMD kernels from fm_kernels.h rather than atan2f per sample.
+class BroadcastFM : public dsp::Processor<dsp::complex_t, dsp::stereo_t> {
+	using base_type = dsp::Processor<dsp::complex_t, dsp::stereo_t>;
+public:
+	BroadcastFM() {}
+	BroadcastFM(dsp::stream<dsp::complex_t>* in, double deviation, double samplerate, bool stereo = true, bool lowPass = true, bool rdsOut = false) { init(in, deviation, samplerate, stereo, lowPass, rdsOut); }
+	~BroadcastFM() {
+		if (!base_type::_block_init) { return; }
+		base_type::stop();
+		dsp::taps::free(pilotFirTaps);
+		dsp::taps::free(audioFirTaps);
+		dsp::buffer::free(mpx);
+		dsp::buffer::free(mpxc);
+		dsp::buffer::free(l);
+		dsp::buffer::free(r);
+		dsp::buffer::free(rdsMix);
+	}
+
+	void init(dsp::stream<dsp::complex_t>* in, double deviation, double samplerate, bool stereo = true, bool lowPass = true, bool rdsOut = false) {
+		// Save config
+		_deviation = deviation;
+		_samplerate = samplerate;
+		_stereo = stereo;
+		_lowPass = lowPass;
+		_rdsOut = rdsOut;
+
+		// Initialize the DSP
+		discGain = 1.0f / dsp::math::hzToRads(_deviation, _samplerate);
+		lastIQ = { 1.0f, 0.0f };
+		pilotFirTaps = dsp::taps::bandPass<dsp::complex_t>(18750.0, 19250.0, 3000.0, _samplerate);
+		pilotFir.init(NULL, pilotFirTaps);
+		pilotPLL.init(NULL, 25000.0 / _samplerate, 0.0, dsp::math::hzToRads(19000.0, _samplerate), dsp::math::hzToRads(18750.0, _samplerate), dsp::math::hzToRads(19250.0, _samplerate));
+		mpxDelaySamples = ((pilotFirTaps.size - 1) / 2) + 1;
+		mpxDelay.init(NULL, mpxDelaySamples);
+		audioFirTaps = dsp::taps::lowPass(15000.0, 4000.0, _samplerate);
+		alFir.init(NULL, audioFirTaps);
+		arFir.init(NULL, audioFirTaps);
+		rdsXlator.init(NULL, -57000.0, _samplerate);
+		rdsResamp.init(NULL, _samplerate, 5000.0);
+		rdsAgc.init(NULL, 1.0, 1e6, 0.1);
+		rdsCostas.init(NULL, 0.005f);
+		initPilotDetector();
+
+		// Free useless buffers
+		mpxDelay.out.free();
+		alFir.out.free();
+		arFir.out.free();
+		rdsXlator.out.free();
+		rdsResamp.out.free();
+		rdsAgc.out.free();
+		rdsCostas.out.free();
+
+		// Scratch
+		mpx = dsp::buffer::alloc<float>(STREAM_BUFFER_SIZE);
+		mpxc = dsp::buffer::alloc<dsp::complex_t>(STREAM_BUFFER_SIZE);
+		l = dsp::buffer::alloc<float>(STREAM_BUFFER_SIZE);
+		r = dsp::buffer::alloc<float>(STREAM_BUFFER_SIZE);
+		rdsMix = dsp::buffer::alloc<dsp::complex_t>(STREAM_BUFFER_SIZE);
+
+		// Init the rest
+		base_type::registerOutput(&rdsOut);
+		base_type::init(in);
+	}
+
+	void setDeviation(double deviation) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		_deviation = deviation;
+		discGain = 1.0f / dsp::math::hzToRads(_deviation, _samplerate);
+		base_type::tempStart();
+	}
+
+	// Every filter is redesigned for the new rate
+	void setSamplerate(double samplerate) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		_samplerate = samplerate;
+		discGain = 1.0f / dsp::math::hzToRads(_deviation, _samplerate);
+		dsp::taps::free(pilotFirTaps);
+		pilotFirTaps = dsp::taps::bandPass<dsp::complex_t>(18750.0, 19250.0, 3000.0, _samplerate);
+		pilotFir.setTaps(pilotFirTaps);
+		pilotPLL.setBandwidth(25000.0 / _samplerate);
+		pilotPLL.setInitialFreq(dsp::math::hzToRads(19000.0, _samplerate));
+		pilotPLL.setFrequencyLimits(dsp::math::hzToRads(18750.0, _samplerate), dsp::math::hzToRads(19250.0, _samplerate));
+		mpxDelaySamples = ((pilotFirTaps.size - 1) / 2) + 1;
+		mpxDelay.setDelay(mpxDelaySamples);
+		dsp::taps::free(audioFirTaps);
+		audioFirTaps = dsp::taps::lowPass(15000.0, 4000.0, _samplerate);
+		alFir.setTaps(audioFirTaps);
+		arFir.setTaps(audioFirTaps);
+		rdsXlator.setOffset(-57000.0, _samplerate);
+		rdsResamp.setInSamplerate(_samplerate);
+		reset();
+		base_type::tempStart();
+	}
+
+	void setStereo(bool stereo) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		_stereo = stereo;
+		pilotLocked = false;
+		base_type::tempStart();
+	}
+
+	void setLowPass(bool lowPass) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		_lowPass = lowPass;
+		alFir.reset();
+		arFir.reset();
+		base_type::tempStart();
+	}
+
+	void setRDSOut(bool rdsOut) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		_rdsOut = rdsOut;
+		rdsXlator.reset();
+		rdsResamp.reset();
+		base_type::tempStart();
+	}
+
+	void setRDSCarrier(RDSCarrierSource source) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		rdsCarrier = source;
+		pilotLocked = false;
+		rdsAgc.reset();
+		rdsCostas.reset();
+		base_type::tempStart();
+	}
+
+	void reset() {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		lastIQ = { 1.0f, 0.0f };
+		pilotFir.reset();
+		pilotPLL.reset();
+		mpxDelay.reset();
+		alFir.reset();
+		arFir.reset();
+		rdsXlator.reset();
+		rdsResamp.reset();
+		rdsAgc.reset();
+		rdsCostas.reset();
+		initPilotDetector();
+		base_type::tempStart();
+	}
+
+	// Keep the pilot PLL running for isPilotLocked() even when neither the audio nor RDS needs it, so the pilot is seen
+	// in mono and RDS only mode too
+	void setPilotDetection(bool enabled) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		pilotDetection = enabled;
+		pilotFir.reset();
+		pilotPLL.reset();
+		mpxDelay.reset();
+		initPilotDetector();
+		base_type::tempStart();
+	}
+
+	// True while there's a pilot the PLL holds on to, always false when the PLL isn't running. With the pilot as the RDS
+	// carrier source this is also when the RDS carrier comes from it.
+	bool isPilotLocked() { return pilotLocked; }
+
+	// Without audio only rdsOut is written, the stereo decoder and audio filters don't run and nothing goes to out.
+	// The pilot PLL then only runs when it's the RDS carrier.
+	void setAudio(bool audio) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		_audio = audio;
+		pilotFir.reset();
+		pilotPLL.reset();
+		mpxDelay.reset();
+		alFir.reset();
+		arFir.reset();
+		initPilotDetector();
+		base_type::tempStart();
+	}
+
+	// Returns the number of audio samples written to out, none without audio
+	inline int process(int count, dsp::complex_t* in, dsp::stereo_t* out, int& rdsOutCount, dsp::complex_t* rdsout) {
+		// Demodulate
+		fmDiscriminate(count, (const float*)in, (float*)&lastIQ, discGain, mpx);
+
+		const dsp::complex_t* pilot = NULL;
+		if (runsPilot()) {
+			// Filter out the pilot and run it through the PLL
+			for (int i = 0; i < count; i++) { mpxc[i] = { mpx[i], 0.0f }; }
+			pilotFir.process(count, mpxc, pilotFir.out.writeBuf);
+			pilotPLL.process(count, pilotFir.out.writeBuf, pilotPLL.out.writeBuf);
+			pilot = pilotPLL.out.writeBuf;
+
+			// Delay the MPX by the pilot filter's group delay so it lines up with the PLL output
+			mpxDelay.process(count, mpx, mpx);
+			detectPilot(count, pilot);
+		}
+
+		// Without the PLL the RDS carrier can only come from the Costas loop
+		if (_rdsOut) { rdsOutCount = processRDS(count, mpx, pilot, rdsout); }
+		if (!_audio) { return 0; }
+
+		if (_stereo) {
+			// Down convert L-R with twice the pilot, then L = LPR+LMR, R = LPR-LMR
+			stereoMatrix(count, mpx, (const float*)pilot, l, r);
+
+			// Filter if needed
+			if (_lowPass) {
+				alFir.process(count, l, l);
+				arFir.process(count, r, r);
+			}
+
+			// Interleave into stereo
+			dsp::convert::LRToStereo::process(count, l, r, out);
+		}
+		else {
+			// Filter if needed
+			if (_lowPass) {
+				alFir.process(count, mpx, mpx);
+			}
+
+			// Interleave raw MPX into stereo
+			dsp::convert::LRToStereo::process(count, mpx, mpx, out);
+		}
+
+		return count;
+	}
+
+	int run() {
+		int count = base_type::_in->read();
+		if (count < 0) { return -1; }
+
+		int rdsOutCount = 0;
+		int outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf, rdsOutCount, rdsOut.writeBuf);
+
+		base_type::_in->flush();
+		if (outCount && !base_type::out.swap(outCount)) { return -1; }
+		if (rdsOutCount && !rdsOut.swap(rdsOutCount)) { return -1; }
+		return count;
+	}
+
+	dsp::stream<dsp::complex_t> rdsOut;
+
+private:
+	// Stereo needs the pilot for the audio, RDS only when it's the carrier
+	bool runsPilot() { return (_stereo && (_audio || rdsCarrier == RDS_CARRIER_PILOT)) || pilotDetection; }
+
+	// Bring the 57kHz subcarrier down to baseband at 5kHz
+	inline int processRDS(int count, const float* mpx, const dsp::complex_t* pilot, dsp::complex_t* out) {
+		bool coherent = pilot && pilotLocked && rdsCarrier == RDS_CARRIER_PILOT;
+		if (coherent) {
+			// Mix with the conjugate of the pilot cubed. Whether the station puts RDS in phase or in quadrature with
+			// the third harmonic doesn't matter, RDSDemod's second Costas loop takes care of the constant phase.
+			for (int i = 0; i < count; i++) {
+				dsp::complex_t p3 = pilot[i] * pilot[i] * pilot[i];
+				rdsMix[i] = { mpx[i] * p3.re, -mpx[i] * p3.im };
+			}
+		}
+		else {
+			for (int i = 0; i < count; i++) { mpxc[i] = { mpx[i], 0.0f }; }
+			rdsXlator.process(count, mpxc, rdsMix);
+		}
+		int outCount = rdsResamp.process(count, rdsMix, out);
+
+		// Without a pilot the mixer is free running, so the carrier still has to be recovered before it leaves
+		if (rdsCarrier == RDS_CARRIER_PILOT && !coherent) {
+			outCount = rdsAgc.process(outCount, out, out);
+			outCount = rdsCostas.process(outCount, out, out);
+		}
+		return outCount;
+	}
+
+	void initPilotDetector() {
+		// Look at the PLL output about every 100us, which is plenty for a phase that should barely move
+		detectStep = std::max<int>(1, (int)round(_samplerate / 10000.0));
+		detectWindow = std::max<int>(1, (int)round(PILOT_DETECT_WINDOW * _samplerate / (double)detectStep));
+		float stepPhase = dsp::math::hzToRads(19000.0, _samplerate) * (float)detectStep;
+		detectRefStep = { cosf(stepPhase), sinf(stepPhase) };
+		detectRef = { 1.0f, 0.0f };
+		detectAcc = { 0.0f, 0.0f };
+		detectOffset = 0;
+		detectCount = 0;
+		pilotLocked = false;
+	}
+
+	// A PLL on a real pilot holds its frequency to within a couple of Hz, while one chasing noise wanders all over the
+	// pilot filter's passband. Against a fixed 19kHz reference, only the first keeps a steady phase for a whole window.
+	inline void detectPilot(int count, const dsp::complex_t* pilot) {
+		int i = detectOffset;
+		for (; i < count; i += detectStep) {
+			detectAcc.re += pilot[i].re * detectRef.re + pilot[i].im * detectRef.im;
+			detectAcc.im += pilot[i].im * detectRef.re - pilot[i].re * detectRef.im;
+			detectRef = detectRef * detectRefStep;
+			if (++detectCount < detectWindow) { continue; }
+
+			// Hysteresis so a marginal pilot doesn't keep switching the carrier back and forth
+			float coherence = sqrtf(detectAcc.re * detectAcc.re + detectAcc.im * detectAcc.im) / (float)detectWindow;
+			bool locked = pilotLocked ? (coherence > PILOT_UNLOCK_COHERENCE) : (coherence > PILOT_LOCK_COHERENCE);
+			if (locked != pilotLocked) {
+				// Start over from a clean loop next time the pilot is lost
+				if (locked) {
+					rdsAgc.reset();
+					rdsCostas.reset();
+				}
+				pilotLocked = locked;
+			}
+
+			// Keep the reference from drifting off the unit circle
+			float mag = sqrtf(detectRef.re * detectRef.re + detectRef.im * detectRef.im);
+			detectRef = { detectRef.re / mag, detectRef.im / mag };
+			detectAcc = { 0.0f, 0.0f };
+			detectCount = 0;
+		}
+		detectOffset = i - count;
+	}
+
+	static constexpr double PILOT_DETECT_WINDOW = 0.01;
+	static constexpr float PILOT_LOCK_COHERENCE = 0.9f;
+	static constexpr float PILOT_UNLOCK_COHERENCE = 0.6f;
+
+	double _deviation;
+	double _samplerate;
+	bool _stereo;
+	bool _lowPass = true;
+	bool _rdsOut = false;
+	bool _audio = true;
+	bool pilotDetection = false;
+	RDSCarrierSource rdsCarrier = RDS_CARRIER_COSTAS;
+
+	// Radians per sample to MPX, and the sample before the current buffer
+	float discGain = 1.0f;
+	dsp::complex_t lastIQ = { 1.0f, 0.0f };
+	dsp::tap<dsp::complex_t> pilotFirTaps;
+	dsp::filter::FIR<dsp::complex_t, dsp::complex_t> pilotFir;
+	dsp::loop::PLL pilotPLL;
+	int mpxDelaySamples = 0;
+	dsp::math::Delay<float> mpxDelay;
+	dsp::tap<float> audioFirTaps;
+	dsp::filter::FIR<float, float> alFir;
+	dsp::filter::FIR<float, float> arFir;
+
+	dsp::channel::FrequencyXlator rdsXlator;
+	dsp::multirate::RationalResampler<dsp::complex_t> rdsResamp;
+	dsp::loop::FastAGC<dsp::complex_t> rdsAgc;
+	dsp::loop::Costas<2> rdsCostas;
+
+	int detectStep = 1;
+	int detectWindow = 1;
+	int detectOffset = 0;
+	int detectCount = 0;
+	dsp::complex_t detectRef = { 1.0f, 0.0f };
+	dsp::complex_t detectRefStep = { 1.0f, 0.0f };
+	dsp::complex_t detectAcc = { 0.0f, 0.0f };
+	std::atomic<bool> pilotLocked{ false };
+
+	float* mpx = NULL;
+	dsp::complex_t* mpxc = NULL;
+	float* l = NULL;
+	float* r = NULL;
+	dsp::complex_t* rdsMix = NULL;
+};
@@ -0,0 +1,158 @@
+#pragma once
+#include <math.h>
+#include <string.h>
+#include <fftw3.h>
+#include <dsp/types.h>
+#include <dsp/stream.h>
+#include <dsp/buffer/buffer.h>
+
+// Splits a wideband stream into evenly spaced channels in a single pass. The input goes through a bank of polyphase
+// branches, all cut from the same lowpass prototype, and one FFT turns their outputs into every channel at once. The
+// cost follows the input rate and the FFT size, not the number of channels actually used.
+//
+// Channel k is centered on k * samplerate / channels, the upper half of the bins being the negative frequencies. It
+// comes out at samplerate / decim, the same as mixing it down, filtering with the prototype and decimating would.
+class PolyphaseChannelizer {
+public:
+	PolyphaseChannelizer() {}
+	PolyphaseChannelizer(int channels, int decim, const float* taps, int tapCount) { init(channels, decim, taps, tapCount); }
+	~PolyphaseChannelizer() { release(); }
+
+	// decim must divide channels, the prototype is padded to a whole number of taps per branch
+	void init(int channels, int decim, const float* taps, int tapCount) {
+		release();
+		M = channels;
+		D = decim;
+		P = (tapCount + M - 1) / M;
+		L = P * M;
+		proto = dsp::buffer::alloc<float>(L);
+		memset(proto, 0, L * sizeof(float));
+		memcpy(proto, taps, tapCount * sizeof(float));
+		buffer = dsp::buffer::alloc<dsp::complex_t>(L + MAX_CHUNK);
+		branches = dsp::buffer::alloc<dsp::complex_t>(M);
+		bins = dsp::buffer::alloc<dsp::complex_t>(M);
+		power = dsp::buffer::alloc<float>(M);
+		plan = fftwf_plan_dft_1d(M, (fftwf_complex*)branches, (fftwf_complex*)bins, FFTW_BACKWARD, FFTW_ESTIMATE);
+		reset();
+	}
+
+	void reset() {
+		memset(buffer, 0, (L - 1) * sizeof(dsp::complex_t));
+		memset(power, 0, M * sizeof(float));
+		powerCount = 0;
+		phase = 0;
+		rot = 0;
+		shift = { 1.0f, 0.0f };
+	}
+
+	// Moves the whole input up by hz before it's split, e.g. to line the channels up with a station raster
+	void setShift(double hz, double samplerate) {
+		double step = 2.0 * M_PI * hz / samplerate;
+		shiftStep = { (float)cos(step), (float)sin(step) };
+		shifting = (hz != 0.0);
+	}
+
+	int getChannelCount() { return M; }
+	int getDecimation() { return D; }
+
+	// Takes at most MAX_CHUNK samples. Only the channels listed in chans are written, the i-th one to outs[i].
+	// Returns the number of samples written to each.
+	int process(int count, const dsp::complex_t* in, int chanCount, const int* chans, dsp::complex_t** outs) {
+		// Append the new samples after the history, shifted if needed
+		dsp::complex_t* newest = &buffer[L - 1];
+		if (shifting) {
+			for (int i = 0; i < count; i++) {
+				newest[i] = in[i] * shift;
+				shift = shift * shiftStep;
+			}
+			// Keep the phasor from drifting off the unit circle
+			float mag = sqrtf(shift.re * shift.re + shift.im * shift.im);
+			shift = { shift.re / mag, shift.im / mag };
+		}
+		else {
+			memcpy(newest, in, count * sizeof(dsp::complex_t));
+		}
+
+		int outCount = 0;
+		for (; phase < count; phase += D) {
+			// Every branch m sums the samples m, m + M, m + 2M, ... before the current one
+			const dsp::complex_t* x = &newest[phase];
+			for (int m = 0; m < M; m++) {
+				dsp::complex_t acc = { 0.0f, 0.0f };
+				for (int p = 0; p < P; p++) {
+					int l = m + p * M;
+					acc.re += proto[l] * x[-l].re;
+					acc.im += proto[l] * x[-l].im;
+				}
+
+				// Rotating the branches by the output time keeps every channel's phase continuous across outputs
+				int idx = m - rot;
+				if (idx < 0) { idx += M; }
+				branches[idx] = acc;
+			}
+			fftwf_execute(plan);
+
+			for (int i = 0; i < chanCount; i++) { outs[i][outCount] = bins[chans[i]]; }
+			for (int k = 0; k < M; k++) { power[k] += bins[k].re * bins[k].re + bins[k].im * bins[k].im; }
+			powerCount++;
+
+			rot += D;
+			if (rot >= M) { rot -= M; }
+			outCount++;
+		}
+		phase -= count;
+
+		// Keep the history for the next call
+		memmove(buffer, &buffer[count], (L - 1) * sizeof(dsp::complex_t));
+		return outCount;
+	}
+
+	// Mean power of every channel since the last call, returns how many outputs that was over
+	int readPower(float* out) {
+		int count = powerCount;
+		float norm = count ? 1.0f / (float)count : 0.0f;
+		for (int k = 0; k < M; k++) {
+			out[k] = power[k] * norm;
+			power[k] = 0.0f;
+		}
+		powerCount = 0;
+		return count;
+	}
+
+	static constexpr int MAX_CHUNK = 65536;
+
+private:
+	void release() {
+		if (!proto) { return; }
+		fftwf_destroy_plan(plan);
+		dsp::buffer::free(proto);
+		dsp::buffer::free(buffer);
+		dsp::buffer::free(branches);
+		dsp::buffer::free(bins);
+		dsp::buffer::free(power);
+		proto = NULL;
+	}
+
+	int M = 0;
+	int D = 1;
+	// Taps per branch and total taps after padding
+	int P = 0;
+	int L = 0;
+
+	float* proto = NULL;
+	dsp::complex_t* buffer = NULL;
+	dsp::complex_t* branches = NULL;
+	dsp::complex_t* bins = NULL;
+	fftwf_plan plan;
+
+	// Input samples until the next output, and where the branches currently start
+	int phase = 0;
+	int rot = 0;
+
+	bool shifting = false;
+	dsp::complex_t shift = { 1.0f, 0.0f };
+	dsp::complex_t shiftStep = { 1.0f, 0.0f };
+
+	float* power = NULL;
+	int powerCount = 0;
+};
@@ -1,105 +1,169 @@
 #pragma once
+#include <stdint.h>
+#include <string.h>
+#include <array>
 #include <string>
-#include <unordered_map>
 
 namespace rds {
-	inline std::string convert_from_rdscharset(const char* rds_str) {
-		static const std::unordered_map<unsigned char, std::string> rds_to_utf8 = {
-			// Control characters (optional: skip or replace)
-			{0x00, " "}, {0x01, " "}, {0x02, " "}, {0x03, " "},
-			{0x04, " "}, {0x05, " "}, {0x06, " "}, {0x07, " "},
-			{0x08, " "}, {0x09, " "}, {0x0A, " "}, {0x0B, " "},
-			{0x0C, " "}, {0x0D, " "}, {0x0E, " "}, {0x0F, " "},
-			{0x10, " "}, {0x11, " "}, {0x12, " "}, {0x13, " "},
-			{0x14, " "}, {0x15, " "}, {0x16, " "}, {0x17, " "},
-			{0x18, " "}, {0x19, " "}, {0x1A, " "}, {0x1B, " "},
-			{0x1C, " "}, {0x1D, " "}, {0x1E, " "}, {0x1F, " "},
-			{0x7F, " "},
+	// Longest UTF-8 sequence a single RDS charset or UCS-2 character converts to
+	const int UTF8_MAX_CHAR_LEN = 3;
+
+	struct UTF8Char {
+		char bytes[UTF8_MAX_CHAR_LEN];
+		uint8_t len;
+	};
+
+	constexpr UTF8Char utf8Char(const char* str) {
+		UTF8Char c{};
+		while (str[c.len] && c.len < UTF8_MAX_CHAR_LEN) {
+			c.bytes[c.len] = str[c.len];
+			c.len++;
+		}
+		return c;
+	}
+
+	constexpr std::array<UTF8Char, 256> makeRDSCharsetTable() {
+		std::array<UTF8Char, 256> table{};
+
+		// Standard ASCII
+		for (int i = 0; i < 0x80; i++) {
+			table[i].bytes[0] = (char)i;
+			table[i].len = 1;
+		}
+
+		// Unknown characters
+		for (int i = 0x80; i < 0x100; i++) { table[i] = utf8Char("?"); }
+
+		// Extended chars
+		table[0x80] = utf8Char("\xE2\x82\xAC"); // €
+		table[0x81] = utf8Char("'");
+		table[0x82] = utf8Char(",");
+		table[0x83] = utf8Char("-");
+		table[0x84] = utf8Char(".");
+		table[0x85] = utf8Char("/");
+		table[0x86] = utf8Char(":");
+		table[0x87] = utf8Char(";");
+		table[0x88] = utf8Char("?");
+		table[0x89] = utf8Char("!");
+		table[0x8A] = utf8Char("\"");
+		table[0x8B] = utf8Char("(");
+		table[0x8C] = utf8Char(")");
+		table[0x8D] = utf8Char("*");
+		table[0x8E] = utf8Char("\xC2\xA1"); // ¡
+		table[0x8F] = utf8Char("#");
+		table[0x90] = utf8Char("&");
+		table[0x91] = utf8Char("'");
+		table[0x92] = utf8Char("\"");
+		table[0x93] = utf8Char("%");
+		table[0x94] = utf8Char("+");
+		table[0x95] = utf8Char("=");
+		table[0x96] = utf8Char("<");
+		table[0x97] = utf8Char(">");
+		table[0x98] = utf8Char("\xC2\xBF"); // ¿
+		table[0x99] = utf8Char("[");
+		table[0x9A] = utf8Char("]");
+		table[0x9B] = utf8Char("^");
+		table[0x9C] = utf8Char("_");
+		table[0x9D] = utf8Char("`");
+		table[0x9E] = utf8Char("{");
+		table[0x9F] = utf8Char("}");
+		table[0xA0] = utf8Char("\xC2\xA0"); // non-breaking space
+		table[0xA1] = utf8Char("\xC2\xA1"); // ¡
+		table[0xA2] = utf8Char("\xC2\xA9"); // ©
+		table[0xA3] = utf8Char("\xC2\xA3"); // £
+		table[0xA4] = utf8Char("\xE2\x82\xA4"); // ₤
+		table[0xA5] = utf8Char("\xC2\xA5"); // ¥
+		table[0xA6] = utf8Char("|");
+		table[0xA7] = utf8Char("\xC2\xA7"); // §
+		table[0xA8] = utf8Char("\xC2\xA4"); // ¤
+		table[0xA9] = utf8Char("\xC2\xAB"); // «
+		table[0xAA] = utf8Char("$"); // Dollar sign
+		table[0xAB] = utf8Char("\xC2\xBB"); // »
+		table[0xAC] = utf8Char("\xC2\xAC"); // ¬
+		table[0xAD] = utf8Char("-");
+		table[0xAE] = utf8Char("\xC2\xAE"); // ®
+		table[0xAF] = utf8Char("\xE2\x84\xA2"); // ™
+		table[0xB0] = utf8Char("\xC2\xBA"); // º
+		table[0xB1] = utf8Char("\xC2\xB9"); // ¹
+		table[0xB2] = utf8Char("\xC2\xB2"); // ²
+		table[0xB3] = utf8Char("\xC2\xB3"); // ³
+		table[0xB4] = utf8Char("\xC2\xB1"); // ±
+		table[0xB5] = utf8Char("\xC2\xB5"); // µ
+		table[0xB6] = utf8Char("\xC2\xB6"); // ¶
+		table[0xB7] = utf8Char("\xC2\xB7"); // ·
+		table[0xB8] = utf8Char("\xC2\xB8"); // ¸
+		table[0xB9] = utf8Char("\xC2\xB9"); // ¹
+		table[0xBA] = utf8Char("\xC2\xBA"); // º
+		table[0xBB] = utf8Char("\xC2\xB0"); // °
+		table[0xBC] = utf8Char("\xC2\xBC"); // ¼
+		table[0xBD] = utf8Char("\xC2\xBD"); // ½
+		table[0xBE] = utf8Char("\xC2\xBE"); // ¾
+		table[0xBF] = utf8Char("\xC2\xBF"); // ¿
+		// You can add more special symbols if needed
+
+		return table;
+	}
+
+	// UTF-8 sequence of every RDS charset character
+	inline constexpr std::array<UTF8Char, 256> RDS_CHARSET_TO_UTF8 = makeRDSCharsetTable();
 
-			// Extended chars
-			{0x80, "\xE2\x82\xAC"}, // €
-			{0x81, "'"},
-			{0x82, ","},
-			{0x83, "-"},
-			{0x84, "."},
-			{0x85, "/"},
-			{0x86, ":"},
-			{0x87, ";"},
-			{0x88, "?"},
-			{0x89, "!"},
-			{0x8A, "\""},
-			{0x8B, "("},
-			{0x8C, ")"},
-			{0x8D, "*"},
-			{0x8E, "\xC2\xA1"}, // ¡
-			{0x8F, "#"},
-			{0x90, "&"},
-			{0x91, "'"},
-			{0x92, "\""},
-			{0x93, "%"},
-			{0x94, "+"},
-			{0x95, "="},
-			{0x96, "<"},
-			{0x97, ">"},
-			{0x98, "\xC2\xBF"}, // ¿
-			{0x99, "["},
-			{0x9A, "]"},
-			{0x9B, "^"},
-			{0x9C, "_"},
-			{0x9D, "`"},
-			{0x9E, "{"},
-			{0x9F, "}"},
-			{0xA0, "\xC2\xA0"}, // non-breaking space
-			{0xA1, "\xC2\xA1"}, // ¡
-			{0xA2, "\xC2\xA9"}, // ©
-			{0xA3, "\xC2\xA3"}, // £
-			{0xA4, "\xE2\x82\xA4"}, // ₤
-			{0xA5, "\xC2\xA5"}, // ¥
-			{0xA6, "|"},
-			{0xA7, "\xC2\xA7"}, // §
-			{0xA8, "\xC2\xA4"}, // ¤
-			{0xA9, "\xC2\xAB"}, // «
-			{0xAA, "$"},         // Dollar sign
-			{0xAB, "\xC2\xBB"}, // »
-			{0xAC, "\xC2\xAC"}, // ¬
-			{0xAD, "-"},
-			{0xAE, "\xC2\xAE"}, // ®
-			{0xAF, "\xE2\x84\xA2"}, // ™
-			{0xB0, "\xC2\xBA"}, // º
-			{0xB1, "\xC2\xB9"}, // ¹
-			{0xB2, "\xC2\xB2"}, // ²
-			{0xB3, "\xC2\xB3"}, // ³
-			{0xB4, "\xC2\xB1"}, // ±
-			{0xB5, "\xC2\xB5"}, // µ
-			{0xB6, "\xC2\xB6"}, // ¶
-			{0xB7, "\xC2\xB7"}, // ·
-			{0xB8, "\xC2\xB8"}, // ¸
-			{0xB9, "\xC2\xB9"}, // ¹
-			{0xBA, "\xC2\xBA"}, // º
-			{0xBB, "\xC2\xB0"}, // °
-			{0xBC, "\xC2\xBC"}, // ¼
-			{0xBD, "\xC2\xBD"}, // ½
-			{0xBE, "\xC2\xBE"}, // ¾
-			{0xBF, "\xC2\xBF"}, // ¿
-			// You can add more special symbols if needed
-		};
+	// Convert at most len RDS charset characters, stopping early at a NUL. Output is always NUL terminated, returns its length.
+	inline size_t convert_from_rdscharset(const char* rds_str, size_t len, char* out, size_t outSize) {
+		size_t n = 0;
+		for (size_t i = 0; i < len && rds_str[i]; i++) {
+			const UTF8Char& c = RDS_CHARSET_TO_UTF8[(uint8_t)rds_str[i]];
+			if (n + c.len >= outSize) { break; }
+			memcpy(&out[n], c.bytes, c.len);
+			n += c.len;
+		}
+		out[n] = 0;
+		return n;
+	}
 
+	inline std::string convert_from_rdscharset(const char* rds_str) {
 		std::string utf8_str;
-		unsigned char ch;
+		for (; *rds_str; rds_str++) {
+			const UTF8Char& c = RDS_CHARSET_TO_UTF8[(uint8_t)*rds_str];
+			utf8_str.append(c.bytes, c.len);
+		}
+		return utf8_str;
+	}
+
+	// Convert at most len bytes of big endian UCS-2, stopping early at U+0000. Output is always NUL terminated, returns its length.
+	inline size_t convert_from_ucs2(const char* ucs2_str, size_t len, char* out, size_t outSize) {
+		size_t n = 0;
+		for (size_t i = 0; i + 1 < len; i += 2) {
+			uint16_t ch = ((uint8_t)ucs2_str[i] << 8) | (uint8_t)ucs2_str[i + 1];
+			if (!ch) { break; }
 
-		while ((ch = *reinterpret_cast<const unsigned char*>(rds_str++))) {
+			char c[UTF8_MAX_CHAR_LEN];
+			int clen;
 			if (ch < 0x80) {
-				utf8_str += ch; // Standard ASCII
-			} else {
-				auto it = rds_to_utf8.find(ch);
-				if (it != rds_to_utf8.end()) {
-					utf8_str += it->second;
-				} else {
-					utf8_str += '?'; // Unknown character
-				}
+				c[0] = (char)ch;
+				clen = 1;
+			}
+			else if (ch < 0x800) {
+				c[0] = (char)(0xC0 | (ch >> 6));
+				c[1] = (char)(0x80 | (ch & 0x3F));
+				clen = 2;
+			}
+			else if (ch >= 0xD800 && ch <= 0xDFFF) {
+				// Surrogates have no meaning in UCS-2
+				c[0] = '?';
+				clen = 1;
+			}
+			else {
+				c[0] = (char)(0xE0 | (ch >> 12));
+				c[1] = (char)(0x80 | ((ch >> 6) & 0x3F));
+				c[2] = (char)(0x80 | (ch & 0x3F));
+				clen = 3;
 			}
-		}
 
-		return utf8_str;
+			if (n + clen >= outSize) { break; }
+			memcpy(&out[n], c, clen);
+			n += clen;
+		}
+		out[n] = 0;
+		return n;
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <string.h>
+#include <dsp/processor.h>
+#include "dsp_pool.h"
+
+// dsp::block keeps its control mutex protected, this reaches it the same way a block's own code would
+class BlockControl : public dsp::block {
+public:
+	static std::recursive_mutex& mutex(dsp::block* blk) { return blk->*(&BlockControl::ctrlMtx); }
+};
+
+// Calls a stopped block's processing on the current thread. The block's control mutex is held like it would be around
+// its own run(), so its setters still wait for the buffer to be done before changing anything.
+template <class Func>
+inline int coopStep(dsp::block* blk, Func func) {
+	std::lock_guard<std::recursive_mutex> lck(BlockControl::mutex(blk));
+	return func();
+}
+
+// Runs a whole block graph on a single thread. The blocks are left stopped and, for every input buffer, the handler
+// pushes it through their process() one after the other with coopStep() and writes the result to out. Nothing is
+// handed over through streams in between, so there's a single thread wakeup per buffer instead of one per block.
+// With a pool set, the executor's own thread only copies the input and the handler runs on the pool's workers instead,
+// through a strand so the buffers still go through it one at a time and in order.
+template <class I, class O>
+class CoopExecutor : public dsp::Processor<I, O> {
+	using base_type = dsp::Processor<I, O>;
+public:
+	// Returns the number of samples written to out
+	typedef int (*Handler)(int count, I* in, O* out, void* ctx);
+
+	CoopExecutor() {}
+	CoopExecutor(dsp::stream<I>* in, Handler handler, void* ctx) { init(in, handler, ctx); }
+	~CoopExecutor() {
+		if (!base_type::_block_init) { return; }
+		base_type::stop();
+		for (int i = 0; i < JOB_COUNT; i++) { dsp::buffer::free(jobs[i].in); }
+	}
+
+	void init(dsp::stream<I>* in, Handler handler, void* ctx) {
+		_handler = handler;
+		_ctx = ctx;
+		for (int i = 0; i < JOB_COUNT; i++) { jobs[i]._this = this; }
+		base_type::init(in);
+	}
+
+	// NULL runs the handler on the executor's own thread
+	void setPool(DSPPool* pool) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		if (pool && !jobs[0].in) {
+			for (int i = 0; i < JOB_COUNT; i++) { jobs[i].in = dsp::buffer::alloc<I>(STREAM_BUFFER_SIZE); }
+		}
+		_pool = pool;
+		if (pool) { strand.init(pool); }
+		base_type::tempStart();
+	}
+
+	int run() {
+		int count = base_type::_in->read();
+		if (count < 0) { return -1; }
+
+		if (_pool) {
+			Job* job = acquireJob();
+			if (!job) {
+				base_type::_in->flush();
+				return -1;
+			}
+			memcpy(job->in, base_type::_in->readBuf, count * sizeof(I));
+			job->count = count;
+			base_type::_in->flush();
+			strand.submit({ runJob, job });
+			return count;
+		}
+
+		count = _handler(count, base_type::_in->readBuf, base_type::out.writeBuf, _ctx);
+
+		base_type::_in->flush();
+
+		// Nothing to hand on when the handler produced no output, e.g. without audio
+		if (count && !base_type::out.swap(count)) { return -1; }
+		return count;
+	}
+
+protected:
+	void doStart() {
+		stopping = false;
+		dsp::block::doStart();
+	}
+
+	void doStop() {
+		// Jobs still queued are dropped, the one running might be waiting to swap out
+		{
+			std::lock_guard<std::mutex> lck(jobMtx);
+			stopping = true;
+		}
+		jobCV.notify_all();
+		base_type::out.stopWriter();
+		if (_pool) { strand.wait(); }
+
+		dsp::block::doStop();
+
+		// The executor's thread could have submitted one last job before seeing the stop
+		if (_pool) { strand.wait(); }
+	}
+
+private:
+	struct Job {
+		CoopExecutor* _this;
+		I* in = NULL;
+		int count = 0;
+	};
+
+	// Wait for the oldest job to be done with its buffer, NULL when stopping
+	Job* acquireJob() {
+		std::unique_lock<std::mutex> lck(jobMtx);
+		jobCV.wait(lck, [&]() { return inFlight < JOB_COUNT || stopping; });
+		if (stopping) { return NULL; }
+		inFlight++;
+		return &jobs[nextJob++ % JOB_COUNT];
+	}
+
+	static void runJob(void* ctx) {
+		Job* job = (Job*)ctx;
+		CoopExecutor* _this = job->_this;
+		if (!_this->stopping) {
+			int count = _this->_handler(job->count, job->in, _this->out.writeBuf, _this->_ctx);
+			if (count) { _this->out.swap(count); }
+		}
+
+		{
+			std::lock_guard<std::mutex> lck(_this->jobMtx);
+			_this->inFlight--;
+		}
+		_this->jobCV.notify_all();
+	}
+
+	// One buffer being copied in while the one before is processed
+	static const int JOB_COUNT = 2;
+
+	Handler _handler = NULL;
+	void* _ctx = NULL;
+
+	DSPPool* _pool = NULL;
+	DSPStrand strand;
+	Job jobs[JOB_COUNT];
+	int nextJob = 0;
+	int inFlight = 0;
+	std::atomic<bool> stopping{ false };
+	std::mutex jobMtx;
+	std::condition_variable jobCV;
+};
@@ -4,6 +4,7 @@
 #include <gui/widgets/waterfall.h>
 #include <config.h>
 #include <utils/event.h>
+#include <rds.h>
 
 enum DeemphasisMode {
 	DEEMP_MODE_22US,
@@ -31,6 +32,8 @@ namespace demod {
 		virtual void setBandwidth(double bandwidth) = 0;
 		virtual void setInput(dsp::stream<dsp::complex_t>* input) = 0;
 		virtual void FrequencyChanged() = 0;
+		// Called while stopped, the module retunes the VFO and audio resampler to getIFSampleRate() after
+		virtual void setIFSampleRate(double samplerate) = 0;
 		virtual double getIFSampleRate() = 0;
 		virtual double getAFSampleRate() = 0;
 		virtual double getDefaultBandwidth() = 0;
@@ -40,6 +43,17 @@ namespace demod {
 		virtual int getVFOReference() = 0;
 		virtual int getDefaultDeemphasisMode() = 0;
 		virtual dsp::stream<dsp::stereo_t>* getOutput() = 0;
+		// For the module's single thread mode, does what start() would on the caller's thread, one buffer at a time.
+		// Only while stopped.
+		virtual int process(int count, dsp::complex_t* in, dsp::stereo_t* out) = 0;
+		// Without audio nothing is written to the output, RDS keeps being decoded
+		virtual void setAudioEnabled(bool enabled) = 0;
+		// What the band scanner looks at to decide whether the frequency is worth waiting on
+		virtual bool hasPilot() = 0;
+		// Makes hasPilot() work in mono too, at the cost of the pilot filter and PLL
+		virtual void setPilotDetection(bool enabled) = 0;
+		virtual float getRDSQuality() = 0;
+		virtual rds::RDSState getRDSState() = 0;
 	};
 }
 
@@ -0,0 +1,46 @@
+#pragma once
+#include <dsp/types.h>
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Real taps against complex samples, with every tap stored twice so it lines up with both halves of a complex sample.
+// x is the complex samples as floats, len is in floats and a multiple of 8. Even lanes add up the real part, odd lanes
+// the imaginary.
+inline dsp::complex_t dotInterleaved(const float* h, const float* x, int len) {
+	int k = 0;
+	dsp::complex_t acc = { 0.0f, 0.0f };
+#if defined(__AVX2__) && defined(__FMA__)
+	__m256 acc8 = _mm256_setzero_ps();
+	for (; k < len; k += 8) {
+		acc8 = _mm256_fmadd_ps(_mm256_loadu_ps(&h[k]), _mm256_loadu_ps(&x[k]), acc8);
+	}
+	__m128 acc4 = _mm_add_ps(_mm256_castps256_ps128(acc8), _mm256_extractf128_ps(acc8, 1));
+	acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+	acc.re = _mm_cvtss_f32(acc4);
+	acc.im = _mm_cvtss_f32(_mm_shuffle_ps(acc4, acc4, 1));
+#elif defined(__SSE2__) || defined(_M_X64)
+	__m128 acc4 = _mm_setzero_ps();
+	for (; k < len; k += 4) {
+		acc4 = _mm_add_ps(acc4, _mm_mul_ps(_mm_loadu_ps(&h[k]), _mm_loadu_ps(&x[k])));
+	}
+	acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+	acc.re = _mm_cvtss_f32(acc4);
+	acc.im = _mm_cvtss_f32(_mm_shuffle_ps(acc4, acc4, 1));
+#elif defined(__ARM_NEON)
+	float32x4_t acc4 = vdupq_n_f32(0.0f);
+	for (; k < len; k += 4) {
+		acc4 = vmlaq_f32(acc4, vld1q_f32(&h[k]), vld1q_f32(&x[k]));
+	}
+	float32x2_t acc2 = vadd_f32(vget_low_f32(acc4), vget_high_f32(acc4));
+	acc.re = vget_lane_f32(acc2, 0);
+	acc.im = vget_lane_f32(acc2, 1);
+#endif
+	for (; k < len; k += 2) {
+		acc.re += h[k] * x[k];
+		acc.im += h[k + 1] * x[k + 1];
+	}
+	return acc;
+}
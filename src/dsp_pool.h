@@ -0,0 +1,205 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// A unit of work, a plain function and its context so a task is just two pointers
+struct DSPTask {
+	void (*func)(void* ctx);
+	void* ctx;
+};
+
+// Worker threads shared by every receiver instance. Each worker has its own deque and runs its tasks in the order they
+// came, when it runs dry it steals from the back of another worker's, the task that would have waited the longest there.
+// Tasks don't come with any ordering between each other, see DSPStrand for that.
+class DSPPool {
+public:
+	static constexpr int MAX_WORKERS = 64;
+
+	DSPPool() {}
+	DSPPool(int workers) { setWorkerCount(workers); }
+	~DSPPool() { setWorkerCount(-1); }
+
+	// The pool every instance of the module submits to, started with one worker per core on first use
+	static DSPPool& shared() {
+		static DSPPool pool(0);
+		return pool;
+	}
+
+	// 0 is one worker per core, anything negative stops them all. Workers being retired finish their queue first.
+	// Must not be called from a worker.
+	void setWorkerCount(int count) {
+		std::lock_guard<std::mutex> lck(resizeMtx);
+		if (count == 0) { count = std::max<int>(std::thread::hardware_concurrency(), 1); }
+		count = std::clamp<int>(count, 0, MAX_WORKERS);
+
+		int old = active.load();
+		if (count == old) { return; }
+		active.store(count);
+		if (count < old) {
+			wakeAll();
+			for (int i = count; i < old; i++) { workers[i].thread.join(); }
+			return;
+		}
+		spawned = std::max<int>(spawned, count);
+		for (int i = old; i < count; i++) { workers[i].thread = std::thread(&DSPPool::worker, this, i); }
+	}
+
+	int getWorkerCount() { return active.load(); }
+
+	// Queue a task, onto the current worker's own deque when called from a task
+	void submit(DSPTask task) {
+		int count = active.load();
+		int id = (current == this) ? currentId : -1;
+		if (id < 0 || id >= count) { id = next.fetch_add(1, std::memory_order_relaxed) % std::max<int>(count, 1); }
+		{
+			std::lock_guard<std::mutex> lck(workers[id].mtx);
+			workers[id].tasks.push_back(task);
+		}
+
+		// Taken under the sleep mutex so a worker can't check pending and go to sleep in between
+		{
+			std::lock_guard<std::mutex> lck(sleepMtx);
+			pending++;
+		}
+		sleepCV.notify_one();
+	}
+
+	// Tasks taken from another worker's deque, for tuning the worker count
+	uint64_t getStealCount() { return steals.load(std::memory_order_relaxed); }
+
+private:
+	struct Worker {
+		std::mutex mtx;
+		std::deque<DSPTask> tasks;
+		std::thread thread;
+	};
+
+	void worker(int id) {
+		current = this;
+		currentId = id;
+		while (true) {
+			DSPTask task;
+			if (popLocal(id, task) || (id < active.load() && steal(id, task))) {
+				{
+					std::lock_guard<std::mutex> lck(sleepMtx);
+					pending--;
+				}
+				task.func(task.ctx);
+				continue;
+			}
+
+			// Retired workers leave once their own deque is empty, what's left elsewhere is stolen by the others
+			std::unique_lock<std::mutex> lck(sleepMtx);
+			if (id >= active.load()) { return; }
+			sleepCV.wait(lck, [&]() { return pending > 0 || id >= active.load(); });
+		}
+	}
+
+	bool popLocal(int id, DSPTask& task) {
+		std::lock_guard<std::mutex> lck(workers[id].mtx);
+		if (workers[id].tasks.empty()) { return false; }
+		task = workers[id].tasks.front();
+		workers[id].tasks.pop_front();
+		return true;
+	}
+
+	// Retired workers are checked too, a submit that raced with the retirement can still have left something there
+	bool steal(int id, DSPTask& task) {
+		int count = spawned;
+		for (int i = 1; i < count; i++) {
+			Worker& victim = workers[(id + i) % count];
+			std::lock_guard<std::mutex> lck(victim.mtx);
+			if (victim.tasks.empty()) { continue; }
+			task = victim.tasks.back();
+			victim.tasks.pop_back();
+			steals.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	void wakeAll() {
+		{ std::lock_guard<std::mutex> lck(sleepMtx); }
+		sleepCV.notify_all();
+	}
+
+	Worker workers[MAX_WORKERS];
+	std::atomic<int> active{ 0 };
+	// Highest worker count ever reached, every deque a task could have been left in
+	std::atomic<int> spawned{ 0 };
+	std::atomic<uint32_t> next{ 0 };
+	std::atomic<uint64_t> steals{ 0 };
+	std::mutex resizeMtx;
+
+	// Queued tasks across every deque, can dip below zero while a task is popped before its submit counted it
+	std::mutex sleepMtx;
+	std::condition_variable sleepCV;
+	int pending = 0;
+
+	static inline thread_local DSPPool* current = NULL;
+	static inline thread_local int currentId = -1;
+};
+
+// Runs its tasks one at a time and in the order they were submitted, on whichever worker is free. There's only ever
+// one task of a strand queued in the pool, so a strand with a backlog can't take more than one worker for itself.
+class DSPStrand {
+public:
+	DSPStrand() {}
+	DSPStrand(DSPPool* pool) { init(pool); }
+
+	void init(DSPPool* pool) { this->pool = pool; }
+
+	void submit(DSPTask task) {
+		std::lock_guard<std::mutex> lck(mtx);
+		tasks.push_back(task);
+		if (scheduled) { return; }
+		scheduled = true;
+		pool->submit({ drain, this });
+	}
+
+	// Wait for every task submitted so far to be done
+	void wait() {
+		std::unique_lock<std::mutex> lck(mtx);
+		idleCV.wait(lck, [&]() { return !scheduled; });
+	}
+
+private:
+	// Runs a few tasks, then goes to the back of the queue so the other strands get their turn
+	static void drain(void* ctx) {
+		DSPStrand* _this = (DSPStrand*)ctx;
+		for (int i = 0; i < BATCH; i++) {
+			DSPTask task;
+			{
+				std::lock_guard<std::mutex> lck(_this->mtx);
+				if (_this->tasks.empty()) {
+					_this->scheduled = false;
+					_this->idleCV.notify_all();
+					return;
+				}
+				task = _this->tasks.front();
+				_this->tasks.pop_front();
+			}
+			task.func(task.ctx);
+		}
+
+		std::lock_guard<std::mutex> lck(_this->mtx);
+		if (_this->tasks.empty()) {
+			_this->scheduled = false;
+			_this->idleCV.notify_all();
+			return;
+		}
+		_this->pool->submit({ drain, _this });
+	}
+
+	static const int BATCH = 4;
+
+	DSPPool* pool = NULL;
+	std::mutex mtx;
+	std::condition_variable idleCV;
+	std::deque<DSPTask> tasks;
+	bool scheduled = false;
+};
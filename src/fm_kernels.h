@@ -0,0 +1,194 @@
+#pragma once
+#include <math.h>
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Odd minimax polynomial for atan on [0, 1], within 1e-5 rad
+const float FM_ATAN_C1 = 0.99997726f;
+const float FM_ATAN_C3 = -0.33262347f;
+const float FM_ATAN_C5 = 0.19354346f;
+const float FM_ATAN_C7 = -0.11643287f;
+const float FM_ATAN_C9 = 0.05265332f;
+const float FM_ATAN_C11 = -0.01172120f;
+
+// The polynomial only has to cover [0, 1], the smaller of |x| and |y| over the larger, and the octant is put back
+// after. The vector versions below do exactly the same thing lane by lane.
+inline float fastAtan2(float y, float x) {
+	float ax = fabsf(x);
+	float ay = fabsf(y);
+	float mx = (ax > ay) ? ax : ay;
+	float mn = (ax > ay) ? ay : ax;
+	float t = mn / ((mx > 1e-30f) ? mx : 1e-30f);
+	float s = t * t;
+	float a = t * (FM_ATAN_C1 + s * (FM_ATAN_C3 + s * (FM_ATAN_C5 + s * (FM_ATAN_C7 + s * (FM_ATAN_C9 + s * FM_ATAN_C11)))));
+	if (ay > ax) { a = (float)(M_PI / 2.0) - a; }
+	if (x < 0.0f) { a = (float)M_PI - a; }
+	return copysignf(a, y);
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+// Complex samples as interleaved floats into separate real and imaginary vectors, in order
+inline void deinterleave8(const float* x, __m256& re, __m256& im) {
+	__m256 a = _mm256_loadu_ps(x);
+	__m256 b = _mm256_loadu_ps(&x[8]);
+	re = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+	im = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+inline __m256 fastAtan2(__m256 y, __m256 x) {
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	__m256 ax = _mm256_and_ps(x, absMask);
+	__m256 ay = _mm256_and_ps(y, absMask);
+	__m256 t = _mm256_div_ps(_mm256_min_ps(ax, ay), _mm256_max_ps(_mm256_max_ps(ax, ay), _mm256_set1_ps(1e-30f)));
+	__m256 s = _mm256_mul_ps(t, t);
+	__m256 p = _mm256_fmadd_ps(s, _mm256_set1_ps(FM_ATAN_C11), _mm256_set1_ps(FM_ATAN_C9));
+	p = _mm256_fmadd_ps(s, p, _mm256_set1_ps(FM_ATAN_C7));
+	p = _mm256_fmadd_ps(s, p, _mm256_set1_ps(FM_ATAN_C5));
+	p = _mm256_fmadd_ps(s, p, _mm256_set1_ps(FM_ATAN_C3));
+	p = _mm256_fmadd_ps(s, p, _mm256_set1_ps(FM_ATAN_C1));
+	__m256 a = _mm256_mul_ps(t, p);
+	a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps((float)(M_PI / 2.0)), a), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+	a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps((float)M_PI), a), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+	return _mm256_or_ps(a, _mm256_andnot_ps(absMask, y));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+inline void deinterleave4(const float* x, __m128& re, __m128& im) {
+	__m128 a = _mm_loadu_ps(x);
+	__m128 b = _mm_loadu_ps(&x[4]);
+	re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+	im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+inline __m128 select4(__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+inline __m128 fastAtan2(__m128 y, __m128 x) {
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 ax = _mm_and_ps(x, absMask);
+	__m128 ay = _mm_and_ps(y, absMask);
+	__m128 t = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-30f)));
+	__m128 s = _mm_mul_ps(t, t);
+	__m128 p = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(FM_ATAN_C11)), _mm_set1_ps(FM_ATAN_C9));
+	p = _mm_add_ps(_mm_mul_ps(s, p), _mm_set1_ps(FM_ATAN_C7));
+	p = _mm_add_ps(_mm_mul_ps(s, p), _mm_set1_ps(FM_ATAN_C5));
+	p = _mm_add_ps(_mm_mul_ps(s, p), _mm_set1_ps(FM_ATAN_C3));
+	p = _mm_add_ps(_mm_mul_ps(s, p), _mm_set1_ps(FM_ATAN_C1));
+	__m128 a = _mm_mul_ps(t, p);
+	a = select4(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps((float)(M_PI / 2.0)), a), a);
+	a = select4(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps((float)M_PI), a), a);
+	return _mm_or_ps(a, _mm_andnot_ps(absMask, y));
+}
+#elif defined(__ARM_NEON)
+inline float32x4_t fastAtan2(float32x4_t y, float32x4_t x) {
+	float32x4_t ax = vabsq_f32(x);
+	float32x4_t ay = vabsq_f32(y);
+	float32x4_t mx = vmaxq_f32(vmaxq_f32(ax, ay), vdupq_n_f32(1e-30f));
+
+	// No divide on ARMv7, two Newton steps on the estimate get the reciprocal to float precision
+	float32x4_t inv = vrecpeq_f32(mx);
+	inv = vmulq_f32(inv, vrecpsq_f32(mx, inv));
+	inv = vmulq_f32(inv, vrecpsq_f32(mx, inv));
+	float32x4_t t = vmulq_f32(vminq_f32(ax, ay), inv);
+
+	float32x4_t s = vmulq_f32(t, t);
+	float32x4_t p = vmlaq_f32(vdupq_n_f32(FM_ATAN_C9), s, vdupq_n_f32(FM_ATAN_C11));
+	p = vmlaq_f32(vdupq_n_f32(FM_ATAN_C7), s, p);
+	p = vmlaq_f32(vdupq_n_f32(FM_ATAN_C5), s, p);
+	p = vmlaq_f32(vdupq_n_f32(FM_ATAN_C3), s, p);
+	p = vmlaq_f32(vdupq_n_f32(FM_ATAN_C1), s, p);
+	float32x4_t a = vmulq_f32(t, p);
+	a = vbslq_f32(vcgtq_f32(ay, ax), vsubq_f32(vdupq_n_f32((float)(M_PI / 2.0)), a), a);
+	a = vbslq_f32(vcltq_f32(x, vdupq_n_f32(0.0f)), vsubq_f32(vdupq_n_f32((float)M_PI), a), a);
+	uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(y), vdupq_n_u32(0x80000000));
+	return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), sign));
+}
+#endif
+
+// Quadrature FM discriminator, the phase step between consecutive samples is the angle of x[i] * conj(x[i - 1]),
+// scaled by gain. iq is the complex samples as interleaved floats and last the sample before the first one, updated to
+// the last one. Can't run in place.
+inline void fmDiscriminate(int count, const float* iq, float* last, float gain, float* out) {
+	if (count <= 0) { return; }
+	out[0] = gain * fastAtan2(iq[1] * last[0] - iq[0] * last[1], iq[0] * last[0] + iq[1] * last[1]);
+
+	int i = 1;
+#if defined(__AVX2__) && defined(__FMA__)
+	__m256 g8 = _mm256_set1_ps(gain);
+	for (; i + 8 <= count; i += 8) {
+		__m256 xr, xi, pr, pi;
+		deinterleave8(&iq[2 * i], xr, xi);
+		deinterleave8(&iq[2 * (i - 1)], pr, pi);
+		__m256 re = _mm256_fmadd_ps(xr, pr, _mm256_mul_ps(xi, pi));
+		__m256 im = _mm256_fmsub_ps(xi, pr, _mm256_mul_ps(xr, pi));
+		_mm256_storeu_ps(&out[i], _mm256_mul_ps(g8, fastAtan2(im, re)));
+	}
+#elif defined(__SSE2__) || defined(_M_X64)
+	__m128 g4 = _mm_set1_ps(gain);
+	for (; i + 4 <= count; i += 4) {
+		__m128 xr, xi, pr, pi;
+		deinterleave4(&iq[2 * i], xr, xi);
+		deinterleave4(&iq[2 * (i - 1)], pr, pi);
+		__m128 re = _mm_add_ps(_mm_mul_ps(xr, pr), _mm_mul_ps(xi, pi));
+		__m128 im = _mm_sub_ps(_mm_mul_ps(xi, pr), _mm_mul_ps(xr, pi));
+		_mm_storeu_ps(&out[i], _mm_mul_ps(g4, fastAtan2(im, re)));
+	}
+#elif defined(__ARM_NEON)
+	float32x4_t g4 = vdupq_n_f32(gain);
+	for (; i + 4 <= count; i += 4) {
+		float32x4x2_t x = vld2q_f32(&iq[2 * i]);
+		float32x4x2_t p = vld2q_f32(&iq[2 * (i - 1)]);
+		float32x4_t re = vmlaq_f32(vmulq_f32(x.val[0], p.val[0]), x.val[1], p.val[1]);
+		float32x4_t im = vmlsq_f32(vmulq_f32(x.val[1], p.val[0]), x.val[0], p.val[1]);
+		vst1q_f32(&out[i], vmulq_f32(g4, fastAtan2(im, re)));
+	}
+#endif
+	for (; i < count; i++) {
+		const float* x = &iq[2 * i];
+		out[i] = gain * fastAtan2(x[1] * x[-2] - x[0] * x[-1], x[0] * x[-2] + x[1] * x[-1]);
+	}
+	last[0] = iq[2 * (count - 1)];
+	last[1] = iq[2 * (count - 1) + 1];
+}
+
+// L = LPR + LMR and R = LPR - LMR, LMR being the MPX brought down with twice the pilot. The MPX is real so only the
+// real part of the carrier matters, re^2 - im^2 of the pilot. The pilot is interleaved like fmDiscriminate's input.
+inline void stereoMatrix(int count, const float* mpx, const float* pilot, float* l, float* r) {
+	int i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+	__m256 two = _mm256_set1_ps(2.0f);
+	for (; i + 8 <= count; i += 8) {
+		__m256 pr, pi;
+		deinterleave8(&pilot[2 * i], pr, pi);
+		__m256 x = _mm256_loadu_ps(&mpx[i]);
+		__m256 lmr = _mm256_mul_ps(_mm256_mul_ps(two, x), _mm256_fmsub_ps(pr, pr, _mm256_mul_ps(pi, pi)));
+		_mm256_storeu_ps(&l[i], _mm256_add_ps(x, lmr));
+		_mm256_storeu_ps(&r[i], _mm256_sub_ps(x, lmr));
+	}
+#elif defined(__SSE2__) || defined(_M_X64)
+	__m128 two = _mm_set1_ps(2.0f);
+	for (; i + 4 <= count; i += 4) {
+		__m128 pr, pi;
+		deinterleave4(&pilot[2 * i], pr, pi);
+		__m128 x = _mm_loadu_ps(&mpx[i]);
+		__m128 lmr = _mm_mul_ps(_mm_mul_ps(two, x), _mm_sub_ps(_mm_mul_ps(pr, pr), _mm_mul_ps(pi, pi)));
+		_mm_storeu_ps(&l[i], _mm_add_ps(x, lmr));
+		_mm_storeu_ps(&r[i], _mm_sub_ps(x, lmr));
+	}
+#elif defined(__ARM_NEON)
+	float32x4_t two = vdupq_n_f32(2.0f);
+	for (; i + 4 <= count; i += 4) {
+		float32x4x2_t p = vld2q_f32(&pilot[2 * i]);
+		float32x4_t x = vld1q_f32(&mpx[i]);
+		float32x4_t lmr = vmulq_f32(vmulq_f32(two, x), vmlsq_f32(vmulq_f32(p.val[0], p.val[0]), p.val[1], p.val[1]));
+		vst1q_f32(&l[i], vaddq_f32(x, lmr));
+		vst1q_f32(&r[i], vsubq_f32(x, lmr));
+	}
+#endif
+	for (const float* p = &pilot[2 * i]; i < count; i++, p += 2) {
+		float lmr = 2.0f * mpx[i] * (p[0] * p[0] - p[1] * p[1]);
+		l[i] = mpx[i] + lmr;
+		r[i] = mpx[i] - lmr;
+	}
+}
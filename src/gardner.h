@@ -0,0 +1,120 @@
+#pragma once
+#include <dsp/types.h>
+#include <dsp/stream.h>
+#include <dsp/buffer/buffer.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// Gardner timing recovery for a real signal at two samples per symbol, outputs one sample per symbol.
+// Works on whole samples except for the interpolator, which is an 8 tap polyphase sinc like the one in the MM block.
+class GardnerRecovery {
+public:
+	GardnerRecovery() {}
+	~GardnerRecovery() {
+		if (buffer) { dsp::buffer::free(buffer); }
+	}
+
+	void init(double omega, double muGain, double omegaGain, double omegaRelLimit) {
+		_omega = omega;
+		_muGain = muGain;
+		_omegaGain = omegaGain;
+		omegaMin = omega * (1.0 - omegaRelLimit);
+		omegaMax = omega * (1.0 + omegaRelLimit);
+
+		// One set of taps per 1/32 of a sample, plus one for a full sample
+		for (int p = 0; p <= INTERP_PHASES; p++) {
+			double mu = (double)p / (double)INTERP_PHASES;
+			double sum = 0.0;
+			double set[INTERP_TAPS];
+			for (int k = 0; k < INTERP_TAPS; k++) {
+				double x = (double)k - (double)(INTERP_TAPS / 2 - 1) - mu;
+				double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+				double w = 2.0 * M_PI * (x + (double)(INTERP_TAPS / 2)) / (double)INTERP_TAPS;
+				set[k] = sinc * (0.42 - 0.5 * cos(w) + 0.08 * cos(2.0 * w));
+				sum += set[k];
+			}
+			for (int k = 0; k < INTERP_TAPS; k++) { interpTaps[p][k] = set[k] / sum; }
+		}
+
+		if (buffer) { dsp::buffer::free(buffer); }
+		buffer = dsp::buffer::alloc<float>(STREAM_BUFFER_SIZE + INTERP_TAPS);
+		bufStart = &buffer[INTERP_TAPS - 1];
+		reset();
+	}
+
+	// Keeps the current timing, only the loop speed changes
+	void setGains(double muGain, double omegaGain) {
+		_muGain = muGain;
+		_omegaGain = omegaGain;
+	}
+
+	void reset() {
+		memset(buffer, 0, (INTERP_TAPS - 1) * sizeof(float));
+		omega = _omega;
+		mu = 0.0f;
+		offset = 0;
+		midStrobe = false;
+		lastSymbol = 0.0f;
+		midSample = 0.0f;
+	}
+
+	// Can run in place
+	inline int process(int count, const float* in, float* out) {
+		memcpy(bufStart, in, count * sizeof(float));
+
+		int outCount = 0;
+		while (offset < count) {
+			// Strobes alternate between symbol centers and the transitions halfway between them
+			const float* x = &buffer[offset];
+			const float* h = interpTaps[(int)roundf(mu * (float)INTERP_PHASES)];
+			float y = 0.0f;
+			for (int k = 0; k < INTERP_TAPS; k++) { y += h[k] * x[k]; }
+
+			float step = omega * 0.5f;
+			if (midStrobe) {
+				midSample = y;
+			}
+			else {
+				// The transition sample is zero when on time and takes the sign of the new symbol when late
+				float err = std::clamp<float>(midSample * (lastSymbol - y), -1.0f, 1.0f);
+				omega = std::clamp<float>(omega + _omegaGain * err, omegaMin, omegaMax);
+				step += _muGain * err;
+				lastSymbol = y;
+				out[outCount++] = y;
+			}
+			midStrobe = !midStrobe;
+
+			mu += step;
+			int whole = (int)floorf(mu);
+			offset += whole;
+			mu -= (float)whole;
+		}
+		offset -= count;
+
+		// Keep the last samples for the next call
+		memmove(buffer, &buffer[count], (INTERP_TAPS - 1) * sizeof(float));
+		return outCount;
+	}
+
+private:
+	static const int INTERP_TAPS = 8;
+	static const int INTERP_PHASES = 32;
+
+	float interpTaps[INTERP_PHASES + 1][INTERP_TAPS];
+	float* buffer = NULL;
+	float* bufStart = NULL;
+
+	float _omega = 2.0f;
+	float _muGain = 0.0f;
+	float _omegaGain = 0.0f;
+	float omegaMin = 2.0f;
+	float omegaMax = 2.0f;
+
+	float omega = 2.0f;
+	float mu = 0.0f;
+	int offset = 0;
+	bool midStrobe = false;
+	float lastSymbol = 0.0f;
+	float midSample = 0.0f;
+};
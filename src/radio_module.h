@@ -16,6 +16,10 @@
 #include <utils/optionlist.h>
 #include "radio_interface.h"
 #include "demod.h"
+#include "coop_executor.h"
+#include "band_monitor.h"
+#include "band_scanner.h"
+#include <gui/tuner.h>
 
 ConfigManager config;
 
@@ -32,7 +36,12 @@ public:
 	FMRadioModule(std::string name) {
 		this->name = name;
 
-		// Initialize option lists
+		// Initialize option lists, 228kHz is 4 times the RDS subcarrier. 171kHz is left out until if_rate_bench shows the
+		// filters still have room at that rate.
+		ifSamplerates.define("250000", "250 kHz", 250000.0);
+		ifSamplerates.define("228000", "228 kHz", 228000.0);
+		bandSpacings.define("100kHz", "100 kHz", 100000.0);
+		bandSpacings.define("200kHz", "200 kHz", 200000.0);
 		deempModes.define("None", DEEMP_MODE_NONE);
 		deempModes.define("22us", DEEMP_MODE_22US);
 		deempModes.define("50us", DEEMP_MODE_50US);
@@ -64,23 +73,86 @@ public:
 		afChain.addBlock(&resamp, true);
 		afChain.addBlock(&deemp, false);
 
+		// Initialize the single thread mode
+		executor.init(vfo->output, executorHandler, this);
+		executorIF[0] = dsp::buffer::alloc<dsp::complex_t>(STREAM_BUFFER_SIZE);
+		executorIF[1] = dsp::buffer::alloc<dsp::complex_t>(STREAM_BUFFER_SIZE);
+		executorAF = dsp::buffer::alloc<dsp::stereo_t>(STREAM_BUFFER_SIZE);
+		config.acquire();
+		if (config.conf[name].contains("singleThread")) {
+			singleThread = config.conf[name]["singleThread"];
+		}
+		if (config.conf[name].contains("sharedPool")) {
+			sharedPool = config.conf[name]["sharedPool"];
+		}
+		if (config.conf[name].contains("poolThreads")) {
+			poolThreads = config.conf[name]["poolThreads"];
+		}
+		config.release();
+		if (sharedPool) {
+			DSPPool::shared().setWorkerCount(poolThreads);
+			executor.setPool(&DSPPool::shared());
+		}
+
+		// Initialize the IF samplerate, the demodulator is set to it when selected
+		config.acquire();
+		if (config.conf[name].contains("ifSamplerate")) {
+			std::string srOpt = config.conf[name]["ifSamplerate"];
+			if (ifSamplerates.keyExists(srOpt)) {
+				ifSamplerateId = ifSamplerates.keyId(srOpt);
+			}
+		}
+		config.release();
+
+		// Initialize the band monitor
+		config.acquire();
+		if (config.conf[name].contains("bandMonitor")) {
+			bandMonitorEnabled = config.conf[name]["bandMonitor"];
+		}
+		if (config.conf[name].contains("bandMonitorSpacing")) {
+			std::string spacingOpt = config.conf[name]["bandMonitorSpacing"];
+			if (bandSpacings.keyExists(spacingOpt)) {
+				bandSpacingId = bandSpacings.keyId(spacingOpt);
+			}
+		}
+		config.release();
+		bandMonitor.init(&bandIQ, bandInputHandler, this, bandSpacings[bandSpacingId]);
+
+		// Initialize the band scanner
+		config.acquire();
+		if (config.conf[name].contains("scanStart")) {
+			scanStart = config.conf[name]["scanStart"];
+		}
+		if (config.conf[name].contains("scanStop")) {
+			scanStop = config.conf[name]["scanStop"];
+		}
+		if (config.conf[name].contains("scanWaitForPS")) {
+			scanWaitForPS = config.conf[name]["scanWaitForPS"];
+		}
+		config.release();
+		scanner.init(scanTuneHandler, scanStatusHandler, this);
+		scanner.setWaitForPS(scanWaitForPS);
+
 		// Initialize the sink
+		config.acquire();
+		if (config.conf[name].contains("rdsOnly")) {
+			rdsOnly = config.conf[name]["rdsOnly"];
+		}
+		config.release();
 		srChangeHandler.ctx = this;
 		srChangeHandler.handler = sampleRateChangeHandler;
-		stream.init(afChain.out, &srChangeHandler, audioSampleRate);
+		stream.init(singleThread ? &executor.out : afChain.out, &srChangeHandler, audioSampleRate);
 		sigpath::sinkManager.registerStream(name, &stream);
 
 		// Start the demodulator
 		SelectDemod();
 
-		// Start IF chain
-		ifChain.start();
-
-		// Start AF chain
-		afChain.start();
+		// Start the chains, or the executor in their place
+		startDSP();
+		if (bandMonitorEnabled) { startBandMonitor(); }
 
 		// Start stream, the rest was started when selecting the demodulator
-		stream.start();
+		if (!rdsOnly) { stream.start(); }
 
 		// Register the menu
 		gui::menu.registerEntry(name, menuHandler, this, this);
@@ -97,6 +169,9 @@ public:
 			disable();
 		}
 		sigpath::sinkManager.unregisterStream(name);
+		dsp::buffer::free(executorIF[0]);
+		dsp::buffer::free(executorIF[1]);
+		dsp::buffer::free(executorAF);
 	}
 
 	void postInit() {}
@@ -108,16 +183,17 @@ public:
 			vfo->wtfVFO->onUserChangedBandwidth.bindHandler(&onUserChangedBandwidthHandler);
 		}
 		ifChain.setInput(vfo->output, [=](dsp::stream<dsp::complex_t>* out){ ifChainOutputChangeHandler(out, this); });
-		ifChain.start();
+		executor.setInput(vfo->output);
 		SelectDemod();
-		afChain.start();
+		startDSP();
+		if (bandMonitorEnabled) { startBandMonitor(); }
 	}
 
 	void disable() {
 		enabled = false;
-		ifChain.stop();
-		if (selectedDemod) { selectedDemod->stop(); }
-		afChain.stop();
+		stopScan();
+		stopDSP();
+		stopBandMonitor();
 		if (vfo) { sigpath::vfoManager.deleteVFO(vfo); }
 		vfo = NULL;
 	}
@@ -160,6 +236,13 @@ private:
 			config.release(true);
 		}
 
+		// IF samplerate, lower is cheaper but leaves less room for the bandwidth
+		ImGui::LeftLabel("IF Samplerate");
+		ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+		if (ImGui::Combo(("##_fm_radio_if_sr_" + _this->name).c_str(), &_this->ifSamplerateId, _this->ifSamplerates.txt)) {
+			_this->setIFSamplerate(_this->ifSamplerateId);
+		}
+
 		// Deemphasis mode
 		ImGui::LeftLabel("De-emphasis");
 		ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
@@ -184,6 +267,70 @@ private:
 			_this->setFMIFNREnabled(_this->FMIFNREnabled);
 		}
 
+		// No audio, only RDS
+		if (ImGui::Checkbox(("RDS Only##_fm_radio_rds_only_" + _this->name).c_str(), &_this->rdsOnly)) {
+			_this->setRDSOnly(_this->rdsOnly);
+		}
+
+		// Whole receiver on one thread
+		if (ImGui::Checkbox(("Single Thread##_fm_radio_single_thread_" + _this->name).c_str(), &_this->singleThread)) {
+			_this->setSingleThread(_this->singleThread);
+		}
+		if (_this->singleThread) {
+			ImGui::SameLine();
+			if (ImGui::Checkbox(("Shared Pool##_fm_radio_shared_pool_" + _this->name).c_str(), &_this->sharedPool)) {
+				_this->setSharedPool(_this->sharedPool);
+			}
+		}
+
+		// The pool is shared, so this is the same for every instance using it
+		if (_this->singleThread && _this->sharedPool) {
+			_this->poolThreads = DSPPool::shared().getWorkerCount();
+			ImGui::LeftLabel("Pool Threads");
+			ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+			if (ImGui::SliderInt(("##_fm_radio_pool_threads_" + _this->name).c_str(), &_this->poolThreads, 1, DSPPool::MAX_WORKERS)) {
+				_this->setPoolThreads(_this->poolThreads);
+			}
+		}
+
+		// Every station in the source's bandwidth
+		if (ImGui::Checkbox(("Band Monitor##_fm_radio_band_monitor_" + _this->name).c_str(), &_this->bandMonitorEnabled)) {
+			_this->setBandMonitorEnabled(_this->bandMonitorEnabled);
+		}
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+		if (ImGui::Combo(("##_fm_radio_band_spacing_" + _this->name).c_str(), &_this->bandSpacingId, _this->bandSpacings.txt)) {
+			_this->setBandSpacing(_this->bandSpacingId);
+		}
+		if (_this->bandMonitorRunning) { _this->showBandMonitor(); }
+
+		// Step the VFO through the band for stations with RDS
+		ImGui::LeftLabel("Scan Start");
+		ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+		if (ImGui::InputDouble(("##_fm_radio_scan_start_" + _this->name).c_str(), &_this->scanStart, 0.1, 1.0, "%.1f MHz")) {
+			_this->setScanRange(_this->scanStart, _this->scanStop);
+		}
+		ImGui::LeftLabel("Scan Stop");
+		ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+		if (ImGui::InputDouble(("##_fm_radio_scan_stop_" + _this->name).c_str(), &_this->scanStop, 0.1, 1.0, "%.1f MHz")) {
+			_this->setScanRange(_this->scanStart, _this->scanStop);
+		}
+		if (ImGui::Checkbox(("Wait for PS##_fm_radio_scan_ps_" + _this->name).c_str(), &_this->scanWaitForPS)) {
+			_this->setScanWaitForPS(_this->scanWaitForPS);
+		}
+		ImGui::SameLine();
+		if (_this->scanner.isRunning()) {
+			if (ImGui::Button(("Stop Scan##_fm_radio_scan_btn_" + _this->name).c_str(), ImVec2(menuWidth - ImGui::GetCursorPosX(), 0))) {
+				_this->stopScan();
+			}
+		}
+		else {
+			if (ImGui::Button(("Scan##_fm_radio_scan_btn_" + _this->name).c_str(), ImVec2(menuWidth - ImGui::GetCursorPosX(), 0))) {
+				_this->startScan();
+			}
+		}
+		_this->showScanner();
+
 		// Demodulator specific menu
 		_this->selectedDemod->showMenu();
 
@@ -221,19 +368,27 @@ private:
 	}
 
 	void SetupDemod(demod::Demodulator* demod) {
+		// The scanner talks to the demodulator about to be deleted
+		stopScan();
+
+		// The executor would still be running the old demodulator
+		if (singleThread) { executor.stop(); }
+
 		// Stopcurrently selected demodulator and select new
-		afChain.setInput(&dummyAudioStream, [=](dsp::stream<dsp::stereo_t>* out){ stream.setInput(out); });
+		afChain.setInput(&dummyAudioStream, [=](dsp::stream<dsp::stereo_t>* out){ if (!singleThread) { stream.setInput(out); } });
 		if (selectedDemod) {
 			selectedDemod->stop();
 			delete selectedDemod;
 		}
 		selectedDemod = demod;
+		selectedDemod->setIFSampleRate(ifSamplerates[ifSamplerateId]);
 
 		// Set the demodulator's input
 		selectedDemod->setInput(ifChain.out);
+		selectedDemod->setAudioEnabled(!rdsOnly);
 
 		// Set AF chain's input
-		afChain.setInput(selectedDemod->getOutput(), [=](dsp::stream<dsp::stereo_t>* out){ stream.setInput(out); });
+		afChain.setInput(selectedDemod->getOutput(), [=](dsp::stream<dsp::stereo_t>* out){ if (!singleThread) { stream.setInput(out); } });
 
 		// Load config
 		bandwidth = selectedDemod->getDefaultBandwidth();
@@ -297,13 +452,275 @@ private:
 		afChain.stop();
 		resamp.setInSamplerate(selectedDemod->getAFSampleRate());
 		setAudioSampleRate(audioSampleRate);
-		afChain.enableBlock(&resamp, [=](dsp::stream<dsp::stereo_t>* out){ stream.setInput(out); });
+		afChain.enableBlock(&resamp, [=](dsp::stream<dsp::stereo_t>* out){ if (!singleThread) { stream.setInput(out); } });
 
 		// Configure deemphasis
 		setDeemphasisMode(deempModes[deempId]);
 
-		// Start new demodulator
-		selectedDemod->start();
+		// Start new demodulator, the executor runs it itself in single thread mode
+		if (!singleThread) { selectedDemod->start(); }
+		else if (enabled) { executor.start(); }
+	}
+
+	// Either every block on its own thread, or all of them on the executor's
+	void startDSP() {
+		if (singleThread) {
+			executor.start();
+			return;
+		}
+		ifChain.start();
+		if (selectedDemod) { selectedDemod->start(); }
+		if (!rdsOnly) { afChain.start(); }
+	}
+
+	void stopDSP() {
+		executor.stop();
+		ifChain.stop();
+		if (selectedDemod) { selectedDemod->stop(); }
+		afChain.stop();
+	}
+
+	void setSingleThread(bool enable) {
+		if (enabled) { stopDSP(); }
+		singleThread = enable;
+		stream.setInput(singleThread ? &executor.out : afChain.out);
+		if (enabled) { startDSP(); }
+
+		// Save config
+		config.acquire();
+		config.conf[name]["singleThread"] = singleThread;
+		config.release(true);
+	}
+
+	// The demodulator stops producing audio, then nothing reads from it anymore. The other way around when turned off,
+	// so the demodulator never waits on a stopped reader.
+	void setRDSOnly(bool enable) {
+		if (singleThread && enabled) { executor.tempStop(); }
+		rdsOnly = enable;
+		if (rdsOnly) {
+			if (selectedDemod) { selectedDemod->setAudioEnabled(false); }
+			afChain.stop();
+			stream.stop();
+		}
+		else {
+			stream.start();
+			if (!singleThread && enabled) { afChain.start(); }
+			if (selectedDemod) { selectedDemod->setAudioEnabled(true); }
+		}
+		if (singleThread && enabled) { executor.tempStart(); }
+
+		// Save config
+		config.acquire();
+		config.conf[name]["rdsOnly"] = rdsOnly;
+		config.release(true);
+	}
+
+	// Hand the executor's buffers to the workers every instance shares instead of running them on its own thread
+	void setSharedPool(bool enable) {
+		sharedPool = enable;
+		if (enable) { DSPPool::shared().setWorkerCount(poolThreads); }
+		executor.setPool(enable ? &DSPPool::shared() : NULL);
+
+		// Save config
+		config.acquire();
+		config.conf[name]["sharedPool"] = sharedPool;
+		config.release(true);
+	}
+
+	void setPoolThreads(int threads) {
+		poolThreads = threads;
+		DSPPool::shared().setWorkerCount(poolThreads);
+
+		// Save config
+		config.acquire();
+		config.conf[name]["poolThreads"] = poolThreads;
+		config.release(true);
+	}
+
+	void startBandMonitor() {
+		if (bandMonitorRunning || !enabled) { return; }
+		bandMonitor.start();
+		sigpath::iqFrontEnd.bindIQStream(&bandIQ);
+		bandMonitorRunning = true;
+	}
+
+	// The front end has to stop writing to it before the monitor stops reading
+	void stopBandMonitor() {
+		if (!bandMonitorRunning) { return; }
+		sigpath::iqFrontEnd.unbindIQStream(&bandIQ);
+		bandMonitor.stop();
+		bandMonitorRunning = false;
+	}
+
+	void setBandMonitorEnabled(bool enable) {
+		bandMonitorEnabled = enable;
+		if (enable) { startBandMonitor(); }
+		else { stopBandMonitor(); }
+
+		// Save config
+		config.acquire();
+		config.conf[name]["bandMonitor"] = bandMonitorEnabled;
+		config.release(true);
+	}
+
+	void setBandSpacing(int id) {
+		bandSpacingId = id;
+		bandMonitor.setSpacing(bandSpacings[id]);
+
+		// Save config
+		config.acquire();
+		config.conf[name]["bandMonitorSpacing"] = bandSpacings.key(id);
+		config.release(true);
+	}
+
+	void showBandMonitor() {
+		if (!bandMonitor.isSupported()) {
+			ImGui::TextWrapped("The source's samplerate has to be a multiple of 400kHz");
+			return;
+		}
+
+		std::vector<BandStation> stations = bandMonitor.getStations();
+		ImGui::BeginTable(("##_fm_radio_band_tbl_" + name).c_str(), 4, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders);
+		ImGui::TableSetupColumn("Frequency");
+		ImGui::TableSetupColumn("SNR");
+		ImGui::TableSetupColumn("PI");
+		ImGui::TableSetupColumn("PS");
+		ImGui::TableHeadersRow();
+		for (auto& st : stations) {
+			ImGui::TableNextRow();
+			ImGui::TableSetColumnIndex(0);
+			ImGui::Text("%.1f MHz", st.frequency / 1e6);
+			ImGui::TableSetColumnIndex(1);
+			ImGui::Text("%.1f dB", st.snr);
+			ImGui::TableSetColumnIndex(2);
+			if (st.rds.piCodeValid()) { ImGui::Text("%04X", st.rds.piCode); }
+			else { ImGui::TextUnformatted("-"); }
+			ImGui::TableSetColumnIndex(3);
+			ImGui::TextUnformatted(st.rds.PSNameValid() ? st.rds.psUTF8 : "-");
+		}
+		ImGui::EndTable();
+	}
+
+	// Remember where the VFO was so it can go back there once the scan is stopped
+	void startScan() {
+		if (scanner.isRunning() || !enabled) { return; }
+		scanReturnFreq = gui::waterfall.getCenterFrequency() + sigpath::vfoManager.getOffset(name);
+		scanner.clear();
+		scanner.setRange(scanStart * 1e6, scanStop * 1e6, snapInterval);
+		// The scanner's early abort needs the pilot whether or not stereo is on
+		selectedDemod->setPilotDetection(true);
+		scanner.start();
+	}
+
+	void stopScan() {
+		if (!scanner.isRunning()) { return; }
+		scanner.stop();
+		selectedDemod->setPilotDetection(false);
+		scanTuneHandler(scanReturnFreq, this);
+	}
+
+	void setScanRange(double start, double stop) {
+		scanStart = std::clamp<double>(start, 1.0, 10000.0);
+		scanStop = std::clamp<double>(stop, 1.0, 10000.0);
+
+		// Save config
+		config.acquire();
+		config.conf[name]["scanStart"] = scanStart;
+		config.conf[name]["scanStop"] = scanStop;
+		config.release(true);
+	}
+
+	void setScanWaitForPS(bool enable) {
+		scanWaitForPS = enable;
+		scanner.setWaitForPS(enable);
+
+		// Save config
+		config.acquire();
+		config.conf[name]["scanWaitForPS"] = scanWaitForPS;
+		config.release(true);
+	}
+
+	void showScanner() {
+		std::vector<ScanEntry> table = scanner.getTable();
+		if (!scanner.isRunning() && table.empty()) { return; }
+
+		ScanStats stats = scanner.getStats();
+		if (scanner.isRunning()) { ImGui::Text("Scanning %.1f MHz, sweep %u", scanner.getFrequency() / 1e6, stats.sweeps + 1); }
+		if (stats.sweeps) { ImGui::Text("Last sweep: %.1f s", stats.lastSweepSeconds); }
+		ImGui::Text("Found %llu of %llu, %llu left early, %llu timed out", (unsigned long long)stats.found, (unsigned long long)stats.visited,
+			(unsigned long long)stats.earlyAborts, (unsigned long long)stats.deadlines);
+		ImGui::Text("Dwell: %.0f ms found, %.0f ms empty", stats.meanHitDwellMs, stats.meanMissDwellMs);
+		ImGui::Text("First PI: %.0f ms mean, %.0f ms max", stats.meanTimeToPIMs, stats.maxTimeToPIMs);
+
+		ImGui::BeginTable(("##_fm_radio_scan_tbl_" + name).c_str(), 6, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders);
+		ImGui::TableSetupColumn("Frequency");
+		ImGui::TableSetupColumn("PI");
+		ImGui::TableSetupColumn("PS");
+		ImGui::TableSetupColumn("PTY");
+		ImGui::TableSetupColumn("AF");
+		ImGui::TableSetupColumn("Dwell");
+		ImGui::TableHeadersRow();
+		for (auto& e : table) {
+			ImGui::TableNextRow();
+			ImGui::TableSetColumnIndex(0);
+			ImGui::Text("%.1f MHz", e.frequency / 1e6);
+			ImGui::TableSetColumnIndex(1);
+			ImGui::Text("%04X", e.pi);
+			ImGui::TableSetColumnIndex(2);
+			ImGui::TextUnformatted(e.ps);
+			ImGui::TableSetColumnIndex(3);
+			ImGui::Text("%d", e.pty);
+			ImGui::TableSetColumnIndex(4);
+			ImGui::Text("%d", e.afCount);
+			if (e.afCount && ImGui::IsItemHovered()) {
+				ImGui::BeginTooltip();
+				for (int i = 0; i < e.afCount; i++) { ImGui::Text("%.1f MHz", e.afs[i] / 1e3); }
+				ImGui::EndTooltip();
+			}
+			ImGui::TableSetColumnIndex(5);
+			ImGui::Text("%.0f ms", e.dwellMs);
+		}
+		ImGui::EndTable();
+	}
+
+	// From the scanner's thread, same as what the frequency manager does when jumping to a bookmark
+	static void scanTuneHandler(double freq, void* ctx) {
+		FMRadioModule* _this = (FMRadioModule*)ctx;
+		tuner::tune(tuner::TUNER_MODE_NORMAL, _this->name, freq);
+		_this->selectedDemod->FrequencyChanged();
+	}
+
+	static void scanStatusHandler(ScanStatus& status, void* ctx) {
+		FMRadioModule* _this = (FMRadioModule*)ctx;
+		status.pilot = _this->selectedDemod->hasPilot();
+		status.rdsQuality = _this->selectedDemod->getRDSQuality();
+		status.rds = _this->selectedDemod->getRDSState();
+	}
+
+	static void bandInputHandler(double& samplerate, double& center, void* ctx) {
+		samplerate = sigpath::iqFrontEnd.getEffectiveSamplerate();
+		center = gui::waterfall.getCenterFrequency();
+	}
+
+	// Same order as ifChain, the demodulator and afChain, with the same blocks enabled
+	static int executorHandler(int count, dsp::complex_t* in, dsp::stereo_t* out, void* ctx) {
+		FMRadioModule* _this = (FMRadioModule*)ctx;
+		dsp::complex_t* iq = in;
+		if (_this->squelchEnabled) {
+			count = coopStep(&_this->squelch, [&]() { return _this->squelch.process(count, iq, _this->executorIF[0]); });
+			iq = _this->executorIF[0];
+		}
+		if (_this->FMIFNREnabled) {
+			count = coopStep(&_this->fmnr, [&]() { return _this->fmnr.process(count, iq, _this->executorIF[1]); });
+			iq = _this->executorIF[1];
+		}
+		count = _this->selectedDemod->process(count, iq, _this->executorAF);
+		if (_this->rdsOnly) { return 0; }
+		count = coopStep(&_this->resamp, [&]() { return _this->resamp.process(count, _this->executorAF, out); });
+		if (_this->deempEnabled) {
+			count = coopStep(&_this->deemp, [&]() { return _this->deemp.process(count, out, out); });
+		}
+		return count;
 	}
 
 
@@ -319,10 +736,35 @@ private:
 		config.release(true);
 	}
 
+	// Everything between the VFO and the resampler runs at this rate, so the whole receiver is stopped while it changes
+	void setIFSamplerate(int id) {
+		ifSamplerateId = id;
+		if (!selectedDemod) { return; }
+		if (enabled) { stopDSP(); }
+
+		selectedDemod->setIFSampleRate(ifSamplerates[id]);
+		maxBandwidth = selectedDemod->getMaxBandwidth();
+		bandwidth = std::clamp<double>(bandwidth, minBandwidth, maxBandwidth);
+		if (vfo) {
+			vfo->setBandwidthLimits(minBandwidth, maxBandwidth, false);
+			vfo->setSampleRate(selectedDemod->getIFSampleRate(), bandwidth);
+		}
+		setBandwidth(bandwidth);
+		resamp.setInSamplerate(selectedDemod->getAFSampleRate());
+
+		if (enabled) { startDSP(); }
+
+		// Save config
+		config.acquire();
+		config.conf[name]["ifSamplerate"] = ifSamplerates.key(id);
+		config.release(true);
+	}
+
 	void setAudioSampleRate(double sr) {
 		audioSampleRate = sr;
 		if (!selectedDemod) { return; }
-		afChain.stop();
+		if (singleThread) { executor.tempStop(); }
+		else { afChain.stop(); }
 
 		// Configure resampler
 		resamp.setOutSamplerate(audioSampleRate);
@@ -330,15 +772,16 @@ private:
 		// Configure deemphasis sample rate
 		deemp.setSamplerate(audioSampleRate);
 
-		afChain.start();
+		if (singleThread) { executor.tempStart(); }
+		else if (!rdsOnly) { afChain.start(); }
 	}
 
 	void setDeemphasisMode(DeemphasisMode mode) {
 		deempId = deempModes.valueId(mode);
 		if (!selectedDemod) { return; }
-		bool deempEnabled = (mode != DEEMP_MODE_NONE);
+		deempEnabled = (mode != DEEMP_MODE_NONE);
 		if (deempEnabled) { deemp.setTau(deempTaus[mode]); }
-		afChain.setBlockEnabled(&deemp, deempEnabled, [=](dsp::stream<dsp::stereo_t>* out){ stream.setInput(out); });
+		afChain.setBlockEnabled(&deemp, deempEnabled, [=](dsp::stream<dsp::stereo_t>* out){ if (!singleThread) { stream.setInput(out); } });
 
 		// Save config
 		config.acquire();
@@ -461,10 +904,38 @@ private:
 	dsp::filter::Deemphasis<dsp::stereo_t> deemp;
 
 	SinkManager::Stream stream;
+	// The sink and afChain are stopped, the demodulator only decodes RDS
+	bool rdsOnly = false;
+
+	// Single thread mode
+	CoopExecutor<dsp::complex_t, dsp::stereo_t> executor;
+	dsp::complex_t* executorIF[2];
+	dsp::stereo_t* executorAF;
+	bool singleThread = false;
+	bool sharedPool = false;
+	// 0 is one per core
+	int poolThreads = 0;
+
+	// Band monitor
+	dsp::stream<dsp::complex_t> bandIQ;
+	BandMonitor bandMonitor;
+	OptionList<std::string, double> bandSpacings;
+	int bandSpacingId = 0;
+	bool bandMonitorEnabled = false;
+	bool bandMonitorRunning = false;
+
+	// Band scanner, the range is in MHz
+	BandScanner scanner;
+	double scanStart = 87.5;
+	double scanStop = 108.0;
+	bool scanWaitForPS = false;
+	double scanReturnFreq = 0.0;
 
 	demod::Demodulator* selectedDemod = NULL;
 
 	OptionList<std::string, DeemphasisMode> deempModes;
+	OptionList<std::string, double> ifSamplerates;
+	int ifSamplerateId = 0;
 
 	double audioSampleRate = 32000.0;
 	float minBandwidth;
@@ -476,6 +947,7 @@ private:
 	float squelchLevel;
 
 	int deempId = 0;
+	bool deempEnabled = false;
 
 	bool FMIFNREnabled = false;
 
@@ -1,26 +1,12 @@
 #include "rds.h"
+#include "rds_syndrome.h"
 #include <string.h>
+#include <stdio.h>
 #include <map>
 #include <algorithm>
-#include <utils/flog.h>
+#include <math.h>
 
 namespace rds {
-	std::map<uint16_t, BlockType> SYNDROMES = {
-		{ 0b1111011000, BLOCK_TYPE_A  },
-		{ 0b1111010100, BLOCK_TYPE_B  },
-		{ 0b1001011100, BLOCK_TYPE_C  },
-		{ 0b1111001100, BLOCK_TYPE_CP },
-		{ 0b1001011000, BLOCK_TYPE_D  }
-	};
-
-	std::map<BlockType, uint16_t> OFFSETS = {
-		{ BLOCK_TYPE_A,  0b0011111100 },
-		{ BLOCK_TYPE_B,  0b0110011000 },
-		{ BLOCK_TYPE_C,  0b0101101000 },
-		{ BLOCK_TYPE_CP, 0b1101010000 },
-		{ BLOCK_TYPE_D,  0b0110110100 }
-	};
-
 	std::map<uint16_t, const char*> THREE_LETTER_CALLS = {
 		{ 0x99A5, "KBW" },
 		{ 0x99A6, "KCY" },
@@ -113,107 +99,289 @@ namespace rds {
 		{ 0xB0E, "NPR-6" }
 	};
 
-	const uint16_t LFSR_POLY = 0b0110111001;
-	const uint16_t IN_POLY   = 0b1100011011;
+	void Decoder::process(const uint8_t* symbols, int count) {
+		checkReset();
+		CorrectionPolicy policy = getCorrectionPolicy();
 
-	const int BLOCK_LEN = 26;
-	const int DATA_LEN = 16;
-	const int POLY_LEN = 10;
+		// Hard bits carry no reliability information
+		softBits = 0;
 
-	void Decoder::process(uint8_t* symbols, int count) {
 		for (int i = 0; i < count; i++) {
-			// Shift in the bit
-			shiftReg = ((shiftReg << 1) & 0x3FFFFFF) | (symbols[i] & 1);
+			shiftIn(symbols[i] & 1);
+			bitCount++;
 
 			// Skip if we need to shift in new data
 			if (--skip > 0) continue;
 
-			// Calculate the syndrome and update sync status
-			uint16_t syn = calcSyndrome(shiftReg);
-			auto synIt = SYNDROMES.find(syn);
-			bool knownSyndrome = synIt != SYNDROMES.end();
-			sync = std::clamp<int>(knownSyndrome ? ++sync : --sync, 0, 4);
+			processBlock(SYNDROME_TO_TYPE[syndromeReg], policy);
+		}
 
-			// If we're still no longer in sync, try to resync
-			if (!sync) continue;
+		publish();
+	}
 
-			// Figure out which block we've got
-			BlockType type;
-			if (knownSyndrome) type = SYNDROMES[syn];
-			else type = (BlockType)((lastType + 1) % _BLOCK_TYPE_COUNT);
+	void Decoder::processSoft(const float* symbols, int count) {
+		checkReset();
+		CorrectionPolicy policy = getCorrectionPolicy();
 
-			// Save block while correcting errors
-			blocks[type] = correctErrors(shiftReg, type, blockAvail[type]);
+		for (int i = 0; i < count; i++) {
+			// Slice and differentially decode, the decoded bit is only as reliable as the weakest of the two symbols
+			bool hard = symbols[i] > 0.0f;
+			float mag = fabsf(symbols[i]);
+			reliability[softPos++ & 31] = std::min<float>(mag, lastSoftMag);
+			if (softBits < BLOCK_LEN) { softBits++; }
+			shiftIn(hard != lastSoftHard);
+			bitCount++;
+			lastSoftHard = hard;
+			lastSoftMag = mag;
 
-			// If block type is A, decode it directly, otherwise, update continous count
-			if (type == BLOCK_TYPE_A) decodeBlockA();
-			else if (type == BLOCK_TYPE_B)  contGroup = 1;
-			else if ((type == BLOCK_TYPE_C || type == BLOCK_TYPE_CP) && lastType == BLOCK_TYPE_B) contGroup++;
-			else if (type == BLOCK_TYPE_D && (lastType == BLOCK_TYPE_C || lastType == BLOCK_TYPE_CP)) contGroup++;
-			else {
-				// If block B is available, decode it alone.
-				if (contGroup == 1) decodeBlockB();
-				contGroup = 0;
-			}
+			// Skip if we need to shift in new data
+			if (--skip > 0) continue;
+
+			processBlock(SYNDROME_TO_TYPE[syndromeReg], policy);
+		}
 
-			// If we've got an entire group, process it
-			if (contGroup >= 3) {
-				contGroup = 0;
-				decodeGroup();
+		publish();
+	}
+
+	void Decoder::shiftIn(uint8_t bit) {
+		// Shift in the bit and slide the syndrome along with it
+		uint8_t outBit = (shiftReg >> (BLOCK_LEN - 1)) & 1;
+		shiftReg = ((shiftReg << 1) & BLOCK_MASK) | bit;
+		syndromeReg = shiftSyndrome(syndromeReg, outBit, bit);
+	}
+
+	// 26 bit window after shifting the k most significant bits of word into reg, 1 <= k <= 64
+	static inline uint32_t packedWindow(uint32_t reg, uint64_t word, int k) {
+		uint64_t hi = (k < BLOCK_LEN) ? ((uint64_t)reg << k) : 0;
+		return (uint32_t)((hi | (word >> (64 - k))) & BLOCK_MASK);
+	}
+
+	void Decoder::processPacked(const uint64_t* words, int count) {
+		checkReset();
+		CorrectionPolicy policy = getCorrectionPolicy();
+		softBits = 0;
+
+		for (int i = 0; i < count; i++) {
+			uint64_t word = words[i];
+			int avail = 64;
+
+			while (avail) {
+				if (skip <= 0) {
+					// Hunting for sync, evaluate every bit offset left in the word. The windows don't depend
+					// on each other so all their syndromes are computed up front, then scanned for a match.
+					uint16_t syns[64] = {};
+					for (int k = 1; k <= avail; k++) {
+						syns[k - 1] = calcSyndromeTable(packedWindow(shiftReg, word, k));
+					}
+					int k = 1;
+					while (k < avail && SYNDROME_TO_TYPE[syns[k - 1]] == _BLOCK_TYPE_COUNT) { k++; }
+
+					// Consume up to the first match, or the whole word if there's none
+					shiftReg = packedWindow(shiftReg, word, k);
+					syndromeReg = syns[k - 1];
+					word = (k < 64) ? (word << k) : 0;
+					avail -= k;
+					bitCount += k;
+					skip = 0;
+					processBlock(SYNDROME_TO_TYPE[syndromeReg], policy);
+					continue;
+				}
+
+				// In sync, jump straight to the end of the next block
+				int n = skip;
+				if (n > avail) {
+					shiftReg = packedWindow(shiftReg, word, avail);
+					skip -= avail;
+					bitCount += avail;
+					break;
+				}
+				shiftReg = packedWindow(shiftReg, word, n);
+				syndromeReg = calcSyndromeTable(shiftReg);
+				word <<= n;
+				avail -= n;
+				bitCount += n;
+				skip = 0;
+				processBlock(SYNDROME_TO_TYPE[syndromeReg], policy);
 			}
+		}
+
+		// Keep the sliding syndrome valid in case bits are fed through process() next
+		syndromeReg = calcSyndromeTable(shiftReg);
 
-			// Remember the last block type and skip to new block
-			lastType = type;
-			skip = BLOCK_LEN;
+		publish();
+	}
+
+	void Decoder::processBlock(BlockType synType, CorrectionPolicy policy) {
+		// Update sync status
+		bool knownSyndrome = synType != _BLOCK_TYPE_COUNT;
+		sync = std::clamp(knownSyndrome ? sync + 1 : sync - 1, 0, SYNC_MAX);
+		updateSyncState();
+
+		// If we're still no longer in sync, try to resync
+		if (!sync) return;
+
+		// Figure out which block we've got
+		BlockType type;
+		if (knownSyndrome) type = synType;
+		else type = (BlockType)((lastType + 1) % _BLOCK_TYPE_COUNT);
+
+		// Save block while correcting errors
+		blocks[type] = correctErrors(shiftReg, type, policy, blockAvail[type], blockCorrected[type]);
+
+		// If that failed and we know how reliable each bit was, try flipping the weakest ones
+		if (!blockAvail[type] && softBits >= BLOCK_LEN && policy != CORRECTION_POLICY_DETECT_ONLY) {
+			blockAvail[type] = chaseDecode(type, blocks[type]);
+		}
+		else {
+			updateBlockStats(blockAvail[type], blockCorrected[type]);
+		}
+
+		if (blockHandler) {
+			BlockEvent ev = { bitCount, type, blocks[type], blockAvail[type], blockCorrected[type] };
+			blockHandler(ev, blockHandlerCtx);
 		}
+
+		assembleBlock(type);
+		skip = BLOCK_LEN;
+
+		// Publish what we've got
+		publish();
 	}
 
-	uint16_t Decoder::calcSyndrome(uint32_t block) {
-		uint16_t syn = 0;
+	void Decoder::processBlocks(const BlockEvent* events, int count) {
+		checkReset();
 
-		// Calculate the syndrome using a LFSR
-		for (int i = BLOCK_LEN - 1; i >= 0; i--) {
-			// Shift the syndrome and keep the output
-			uint8_t outBit = (syn >> (POLY_LEN - 1)) & 1;
-			syn = (syn << 1) & 0b1111111111;
+		for (int i = 0; i < count; i++) {
+			const BlockEvent& ev = events[i];
+			bitCount = std::max<Timestamp>(bitCount, ev.time);
 
-			// Apply LFSR polynomial
-			syn ^= LFSR_POLY * outBit;
+			// Nothing to sync to, a valid block counts the same as a known syndrome would
+			sync = std::clamp(ev.avail ? sync + 1 : sync - 1, 0, SYNC_MAX);
+			updateSyncState();
+			if (!sync) continue;
 
-			// Apply input polynomial.
-			syn ^= IN_POLY * ((block >> i) & 1);
+			blocks[ev.type] = ev.block;
+			blockAvail[ev.type] = ev.avail;
+			blockCorrected[ev.type] = ev.corrected;
+			updateBlockStats(ev.avail, ev.corrected);
+			assembleBlock(ev.type);
 		}
 
-		return syn;
+		publish();
 	}
 
-	uint32_t Decoder::correctErrors(uint32_t block, BlockType type, bool& recovered) {
-		// Subtract the offset from block
-		block ^= (uint32_t)OFFSETS[type];
-		uint32_t out = block;
+	void Decoder::assembleBlock(BlockType type) {
+		// If block type is A, decode it directly, otherwise, update continous count
+		if (type == BLOCK_TYPE_A) decodeBlockA();
+		else if (type == BLOCK_TYPE_B) {
+			contGroup = 1;
+			groupHasA = (lastType == BLOCK_TYPE_A);
+		}
+		else if ((type == BLOCK_TYPE_C || type == BLOCK_TYPE_CP) && lastType == BLOCK_TYPE_B) {
+			contGroup++;
+			groupCType = type;
+		}
+		else if (type == BLOCK_TYPE_D && (lastType == BLOCK_TYPE_C || lastType == BLOCK_TYPE_CP)) contGroup++;
+		else {
+			// If block B is available, decode it alone.
+			if (contGroup == 1) decodeBlockB();
+			contGroup = 0;
+		}
 
-		// Calculate syndrome of corrected block
-		uint16_t syn = calcSyndrome(block);
+		// If we've got an entire group, process it
+		if (contGroup >= 3) {
+			contGroup = 0;
+			decodeGroup();
+		}
 
-		// Use the syndrome register to do error correction if errors are present
-		uint8_t errorFound = 0;
-		if (syn) {
-			for (int i = DATA_LEN - 1; i >= 0; i--) {
-				// Check if the 5 leftmost bits are all zero
-				errorFound |= !(syn & 0b11111);
+		// Remember the last block type
+		lastType = type;
+	}
 
-				// Write output
-				uint8_t outBit = (syn >> (POLY_LEN - 1)) & 1;
-				out ^= (errorFound & outBit) << (i + POLY_LEN);
+	bool Decoder::chaseDecode(BlockType type, uint32_t& block) {
+		// Find the least reliable bits of the block, bit 0 is the last one received
+		int weak[CHASE_BITS];
+		float weakRel[CHASE_BITS];
+		int weakCount = 0;
+		for (int i = 0; i < BLOCK_LEN; i++) {
+			float rel = reliability[(softPos - 1 - i) & 31];
+			int j = std::min<int>(weakCount, CHASE_BITS - 1);
+			if (weakCount == CHASE_BITS && rel >= weakRel[j]) { continue; }
+			for (; j > 0 && weakRel[j - 1] > rel; j--) {
+				weak[j] = weak[j - 1];
+				weakRel[j] = weakRel[j - 1];
+			}
+			weak[j] = i;
+			weakRel[j] = rel;
+			if (weakCount < CHASE_BITS) { weakCount++; }
+		}
 
-				// Shift syndrome
-				syn = (syn << 1) & 0b1111111111;
-				syn ^= LFSR_POLY * outBit * !errorFound;
+		// Try every combination of flips, keeping the valid candidate that flips the least total reliability.
+		// The syndrome is linear so each test is a handful of xors. Candidates aren't finished off with the
+		// burst decoder, doing so recovers more blocks but most of the extra ones are miscorrections.
+		uint16_t syn = calcSyndrome(shiftReg ^ OFFSET_WORDS[type]);
+		uint32_t bestPattern = 0;
+		float bestCost = INFINITY;
+		for (int comb = 1; comb < (1 << weakCount); comb++) {
+			uint16_t candSyn = syn;
+			uint32_t pattern = 0;
+			float cost = 0.0f;
+			for (int j = 0; j < weakCount; j++) {
+				if (!((comb >> j) & 1)) { continue; }
+				candSyn ^= BIT_SYNDROMES[weak[j]];
+				pattern |= 1 << weak[j];
+				cost += weakRel[j];
+			}
+			if (!candSyn && cost < bestCost) {
+				bestCost = cost;
+				bestPattern = pattern;
 			}
 		}
-		recovered = !(syn & 0b11111);
 
-		return out;
+		state.blockStats.blocks++;
+		if (!bestPattern) {
+			state.blockStats.uncorrectable++;
+			return false;
+		}
+		state.blockStats.softRecovered++;
+		state.blockStats.softFlippedBits += countBits(bestPattern);
+		blockCorrected[type] = countBits(bestPattern);
+		block = shiftReg ^ OFFSET_WORDS[type] ^ bestPattern;
+		return true;
+	}
+
+	uint16_t Decoder::calcSyndrome(uint32_t block) {
+		return calcSyndromeTable(block);
+	}
+
+	uint32_t Decoder::correctErrors(uint32_t block, BlockType type, CorrectionPolicy policy, bool& recovered, uint8_t& corrected) {
+		// Subtract the offset from block
+		block ^= (uint32_t)OFFSET_WORDS[type];
+
+		// A zero syndrome means the block is intact
+		uint16_t syn = calcSyndrome(block);
+		corrected = 0;
+		recovered = !syn;
+		if (recovered || policy == CORRECTION_POLICY_DETECT_ONLY) { return block; }
+
+		// Look up the burst that produced this syndrome
+		const BurstError& err = BURST_ERRORS[syn];
+		if (!err.bits || (policy == CORRECTION_POLICY_SINGLE_BIT && err.bits > 1)) { return block; }
+
+		recovered = true;
+		corrected = err.bits;
+		return block ^ err.pattern;
+	}
+
+	void Decoder::updateBlockStats(bool recovered, uint8_t corrected) {
+		state.blockStats.blocks++;
+		if (!recovered) {
+			state.blockStats.uncorrectable++;
+		}
+		else if (corrected) {
+			state.blockStats.corrected++;
+			state.blockStats.correctedBits += corrected;
+		}
 	}
 
 	unsigned int Decoder::getMJDYear(double mjd) {
@@ -241,38 +409,35 @@ namespace rds {
 	}
 
 	void Decoder::decodeBlockA() {
-		// Acquire lock
-		std::lock_guard<std::mutex> lck(blockAMtx);
 
 		// If it didn't decode properly return
 		if (!blockAvail[BLOCK_TYPE_A]) { return; }
 
 		// Decode PI code
-		piCode = (blocks[BLOCK_TYPE_A] >> 10) & 0xFFFF; /* bitwise by ten because we still have the offset here */
-		programCoverage = (AreaCoverage)((blocks[BLOCK_TYPE_A] >> 18) & 0xF);
-		callsign = decodeCallsign(piCode);
+		state.piCode = (blocks[BLOCK_TYPE_A] >> 10) & 0xFFFF; /* bitwise by ten because we still have the offset here */
+		state.programCoverage = (AreaCoverage)((blocks[BLOCK_TYPE_A] >> 18) & 0xF);
+		snprintf(state.callsign, sizeof(state.callsign), "%s", decodeCallsign(state.piCode).c_str());
 
 		// Update timeout
-		blockALastUpdate = std::chrono::high_resolution_clock::now();;
+		state.blockALastUpdate = bitCount;
+		if (!state.firstPI) { state.firstPI = bitCount; }
 	}
 
 	void Decoder::decodeBlockB() {
-		// Acquire lock
-		std::lock_guard<std::mutex> lck(blockBMtx);
 
 		// If it didn't decode properly return (TODO: Make sure this is not needed)
 		if (!blockAvail[BLOCK_TYPE_B]) { return; }
 
 		// Decode group type and version
-		groupType = (blocks[BLOCK_TYPE_B] >> 22) & 0xF;
-		groupVer = (GroupVersion)((blocks[BLOCK_TYPE_B] >> 21) & 1);
+		state.groupType = (blocks[BLOCK_TYPE_B] >> 22) & 0xF;
+		state.groupVer = (GroupVersion)((blocks[BLOCK_TYPE_B] >> 21) & 1);
 
 		// Decode traffic program and program type
-		trafficProgram = (blocks[BLOCK_TYPE_B] >> 20) & 1;
-		programType = (ProgramType)((blocks[BLOCK_TYPE_B] >> 15) & 0x1F);
+		state.trafficProgram = (blocks[BLOCK_TYPE_B] >> 20) & 1;
+		state.programType = (ProgramType)((blocks[BLOCK_TYPE_B] >> 15) & 0x1F);
 
 		// Update timeout
-		blockBLastUpdate = std::chrono::high_resolution_clock::now();
+		state.blockBLastUpdate = bitCount;
 	}
 
 	void Decoder::decodeAlternativeFrequencies() {
@@ -281,11 +446,11 @@ namespace rds {
 			uint8_t af1 = alternativeFrequency & 0xff;
 
 			if (af0 >= ALTERNATIVE_FREQUENCY_SPECIAL_CODES_AF_COUNT_BASE && af0 <= ALTERNATIVE_FREQUENCY_SPECIAL_CODES_AF_COUNT_BASE+25) {
-				// First message is 224+n with n being the number of AFs, when we receive that we set the afCount and reset the afState in order to be in sync with the encoder
-				afCount = af0 - ALTERNATIVE_FREQUENCY_SPECIAL_CODES_AF_COUNT_BASE;
-				if(afCount > 25) {
+				// First message is 224+n with n being the number of AFs, when we receive that we set the state.afCount and reset the afState in order to be in sync with the encoder
+				state.afCount = af0 - ALTERNATIVE_FREQUENCY_SPECIAL_CODES_AF_COUNT_BASE;
+				if(state.afCount > 25) {
 					// If the count is greater than 25, we set it to 25
-					afCount = 25;
+					state.afCount = 25;
 				}
 				if(af1 == ALTERNATIVE_FREQUENCY_SPECIAL_CODES_LFMF_FOLLOWS) {
 					// If the first AF is 250, we set the afLfMfIncoming to 1, because af0 here is the len, so if af1 is lfmf incoming then it is logical that the lfmf is in the next message
@@ -297,15 +462,15 @@ namespace rds {
 
 			if(afState == 0) {
 				// Decode the first AF, which is next to the count
-				if(afCount != 0) {
+				if(state.afCount != 0) {
 					if(af1 == ALTERNATIVE_FREQUENCY_SPECIAL_CODES_LFMF_FOLLOWS) afLfMfIncoming = 1;
 					else if(af1 != ALTERNATIVE_FREQUENCY_SPECIAL_CODES_FILLER) {
 						if(afLfMfIncoming) {
 							afLfMfIncoming = 0;
-							if (af1 <= 15) afs[0] = (af1 - 1) * 9 + 153;
-							else afs[0] = 9 * (af1 - 16) + 531;
+							if (af1 <= 15) state.afs[0] = (af1 - 1) * 9 + 153;
+							else state.afs[0] = 9 * (af1 - 16) + 531;
 						} else {
-							afs[0] = (af1 + 875) * 100;
+							state.afs[0] = (af1 + 875) * 100;
 						}
 					}
 					afState++;
@@ -313,31 +478,31 @@ namespace rds {
 				return;
 			} else {
 				// Ensure we're in bounds
-				if (afState >= afs.size()) return;
+				if (afState >= state.afs.size()) return;
 
 				// Decode rest of the AFs
 				if(afLfMfIncoming) {
 					afLfMfIncoming = 0;
-					if (af0 <= 15) afs[afState] = (af0 - 1) * 9 + 153;
-					else afs[afState] = 9 * (af0 - 16) + 531;
+					if (af0 <= 15) state.afs[afState] = (af0 - 1) * 9 + 153;
+					else state.afs[afState] = 9 * (af0 - 16) + 531;
 					afState++;
 
 					if(af1 == ALTERNATIVE_FREQUENCY_SPECIAL_CODES_LFMF_FOLLOWS) afLfMfIncoming = 1;
 					else if(af1 != 205 && afState < 23) {
-						afs[afState] = (af1 + 875) * 100;
+						state.afs[afState] = (af1 + 875) * 100;
 						afState++;
 					}
 				} else if(af0 == ALTERNATIVE_FREQUENCY_SPECIAL_CODES_LFMF_FOLLOWS) {
-					if (af1 <= 15) afs[afState] = (af1 - 1) * 9 + 153;
-					else afs[afState] = 9 * (af1 - 16) + 531;
+					if (af1 <= 15) state.afs[afState] = (af1 - 1) * 9 + 153;
+					else state.afs[afState] = 9 * (af1 - 16) + 531;
 					afState++;
 				} else {
-					afs[afState] = (af0 + 875) * 100;
+					state.afs[afState] = (af0 + 875) * 100;
 					afState++;
 
 					if(af1 == ALTERNATIVE_FREQUENCY_SPECIAL_CODES_LFMF_FOLLOWS) afLfMfIncoming = 1;
 					else if(af1 != ALTERNATIVE_FREQUENCY_SPECIAL_CODES_FILLER && afState < 23) {
-						afs[afState] = (af1 + 875) * 100;
+						state.afs[afState] = (af1 + 875) * 100;
 						afState++;
 					}
 				}
@@ -346,39 +511,35 @@ namespace rds {
 	}
 
 	void Decoder::decodeGroup0() {
-		// Acquire lock
-		std::lock_guard<std::mutex> lck(group0Mtx);
 
 		// Decode Block B data
-		trafficAnnouncement = (blocks[BLOCK_TYPE_B] >> 14) & 1;
+		state.trafficAnnouncement = (blocks[BLOCK_TYPE_B] >> 14) & 1;
 		uint8_t diBit = (blocks[BLOCK_TYPE_B] >> 12) & 1;
 		uint8_t segment = ((blocks[BLOCK_TYPE_B] >> 10) & 0b11);
 		uint8_t diBitPlacement = 3 - segment;
 		uint8_t psSegment = segment * 2;
 
 		// Decode Block C data
-		if (groupVer == GROUP_VER_A && blockAvail[BLOCK_TYPE_C]) {
+		if (state.groupVer == GROUP_VER_A && blockAvail[BLOCK_TYPE_C]) {
 			alternativeFrequency = (blocks[BLOCK_TYPE_C] >> 10) & 0xFFFF;
 			decodeAlternativeFrequencies();
 		}
 
 		// Write DI bit to the decoder identification
-		decoderIdent &= ~(1 << diBitPlacement);
-		decoderIdent |= (diBit << diBitPlacement);
+		state.decoderIdent &= ~(1 << diBitPlacement);
+		state.decoderIdent |= (diBit << diBitPlacement);
 
 		// Write chars at segment the PSName
 		if (blockAvail[BLOCK_TYPE_D]) {
-			ps[psSegment + 0] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
-			ps[psSegment + 1] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
+			setChars(state.ps, psSegment, blocks[BLOCK_TYPE_D], TEXT_PS);
+			state.psSegments |= 1 << segment;
 		}
 
 		// Update timeout
-		group0LastUpdate = std::chrono::high_resolution_clock::now();
+		state.group0LastUpdate = bitCount;
 	}
 
 	void Decoder::decodeGroup1A() {
-		// Acquire lock
-		std::lock_guard<std::mutex> lck(group1Mtx);
 
 		if (blockAvail[BLOCK_TYPE_C]) {
 			/* Decode the Slow Labeling Codes, these are only in group 1A */
@@ -386,18 +547,16 @@ namespace rds {
 
 			if(variant_code == 0) {
 				/* ECC */
-				ecc = (blocks[BLOCK_TYPE_C] >> 10) & 0xFF; /* ECC is a single byte, 8 bits */
-				eccLastUpdate = std::chrono::high_resolution_clock::now();
+				state.ecc = (blocks[BLOCK_TYPE_C] >> 10) & 0xFF; /* ECC is a single byte, 8 bits */
+				state.eccLastUpdate = bitCount;
 			}
 		}
 
 		// Update timeout
-		group1LastUpdate = std::chrono::high_resolution_clock::now();
+		state.group1LastUpdate = bitCount;
 	}
 
 	void Decoder::decodeGroup2() {
-		// Acquire lock
-		std::lock_guard<std::mutex> lck(group2Mtx);
 
 		// Get char segment and write chars in the Radiotext
 		bool rtAB = (blocks[BLOCK_TYPE_B] >> 14) & 1;
@@ -407,36 +566,34 @@ namespace rds {
 		if(segment > 15) return;
 
 		// Clear text field if the A/B flag changed
-		if (rtAB != lastRTAB) radioText = "                                                                ";
-		lastRTAB = rtAB;
+		if (rtAB != state.lastRTAB) {
+			memset(state.radioText, ' ', 64);
+			textDirty |= TEXT_RT;
+		}
+		state.lastRTAB = rtAB;
 
 		// Write char at segment in Radiotext
-		if (groupVer == GROUP_VER_A) {
+		if (state.groupVer == GROUP_VER_A) {
 			uint8_t rtSegment = segment * 4;
 			if (blockAvail[BLOCK_TYPE_C]) {
-				radioText[rtSegment + 0] = (blocks[BLOCK_TYPE_C] >> 18) & 0xFF;
-				radioText[rtSegment + 1] = (blocks[BLOCK_TYPE_C] >> 10) & 0xFF;
+				setChars(state.radioText, rtSegment, blocks[BLOCK_TYPE_C], TEXT_RT);
 			}
 			if (blockAvail[BLOCK_TYPE_D]) {
-				radioText[rtSegment + 2] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
-				radioText[rtSegment + 3] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
+				setChars(state.radioText, rtSegment + 2, blocks[BLOCK_TYPE_D], TEXT_RT);
 			}
 		}
 		else {
 			uint8_t rtSegment = segment * 2;
 			if (blockAvail[BLOCK_TYPE_D]) {
-				radioText[rtSegment] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
-				radioText[rtSegment + 1] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
+				setChars(state.radioText, rtSegment, blocks[BLOCK_TYPE_D], TEXT_RT);
 			}
 		}
 
 		// Update timeout
-		group2LastUpdate = std::chrono::high_resolution_clock::now();
+		state.group2LastUpdate = bitCount;
 	}
 
 	void Decoder::decodeGroup3A() {
-		// Acquire lock
-		std::lock_guard<std::mutex> lck(group3AMtx);
 
 		GroupVersion groupVer_oda = (GroupVersion)((blocks[BLOCK_TYPE_B] >> 10) & 1);
 		uint8_t groupType_oda = (blocks[BLOCK_TYPE_B] >> 11) & 0xF;
@@ -447,29 +604,29 @@ namespace rds {
 			return;
 		}
 
-		if (oda_aid_count >= odas_aid.size()) return;
+		if (state.oda_aid_count >= state.odas_aid.size()) return;
 
-		for(int i = 0; i < oda_aid_count; i++) {
-			if(odas_aid[i].AID == aid) {
+		for(int i = 0; i < state.oda_aid_count; i++) {
+			if(state.odas_aid[i].AID == aid) {
 				// If we already have this AID, just update the group type
-				odas_aid[i].GroupType = groupType_oda;
-				odas_aid[i].GroupVer = groupVer_oda;
+				state.odas_aid[i].GroupType = groupType_oda;
+				state.odas_aid[i].GroupVer = groupVer_oda;
 				return;
 			}
 		}
 
 		// If we don't have this AID, add it to the list
-		if(oda_aid_count < 8) {
-			odas_aid[oda_aid_count].AID = aid;
-			odas_aid[oda_aid_count].GroupType = groupType_oda;
-			odas_aid[oda_aid_count].GroupVer = groupVer_oda;
-			oda_aid_count++;
+		if(state.oda_aid_count < 8) {
+			state.odas_aid[state.oda_aid_count].AID = aid;
+			state.odas_aid[state.oda_aid_count].GroupType = groupType_oda;
+			state.odas_aid[state.oda_aid_count].GroupVer = groupVer_oda;
+			state.oda_aid_count++;
 		}
 		else {
 			// If we don't have space, remove the oldest AID and add the new one
-			odas_aid[0].AID = aid;
-			odas_aid[0].GroupType = groupType_oda;
-			odas_aid[0].GroupVer = groupVer_oda;
+			state.odas_aid[0].AID = aid;
+			state.odas_aid[0].GroupType = groupType_oda;
+			state.odas_aid[0].GroupVer = groupVer_oda;
 		}
 
 		switch(aid) {
@@ -481,35 +638,34 @@ namespace rds {
 	}
 
 	void Decoder::decodeGroup4A() {
-		// Acquire lock
-		std::lock_guard<std::mutex> lck(group4AMtx);
 
 		if(blockAvail[BLOCK_TYPE_C]) {
 			// MJD is in the last bits of block b and whole block c
-			clock_mjd = (((blocks[BLOCK_TYPE_B] >> 10) & 0x03) << 15) | (((blocks[BLOCK_TYPE_C] >> 10) >> 1) & 0x7fff);
+			state.clock_mjd = (((blocks[BLOCK_TYPE_B] >> 10) & 0x03) << 15) | (((blocks[BLOCK_TYPE_C] >> 10) >> 1) & 0x7fff);
 		}
 		if(blockAvail[BLOCK_TYPE_C] && blockAvail[BLOCK_TYPE_D]) {
 			// Hour is somewhat in block C but rest are in D
-			clock_hour = ((blocks[BLOCK_TYPE_C] >> 10) & 1);
-			clock_hour <<= 4;
-			clock_hour |= blocks[BLOCK_TYPE_D] >> 22;
+			state.clock_hour = ((blocks[BLOCK_TYPE_C] >> 10) & 1);
+			state.clock_hour <<= 4;
+			state.clock_hour |= blocks[BLOCK_TYPE_D] >> 22;
 
-			clock_minute = ((blocks[BLOCK_TYPE_D] >> 16) & 0x3f);
+			state.clock_minute = ((blocks[BLOCK_TYPE_D] >> 16) & 0x3f);
 
-			clock_offset_sense = ((blocks[BLOCK_TYPE_D] >> 15) & 1);
+			state.clock_offset_sense = ((blocks[BLOCK_TYPE_D] >> 15) & 1);
 
-			clock_offset = ((blocks[BLOCK_TYPE_D] >> 10) & 0x1f);
+			state.clock_offset = ((blocks[BLOCK_TYPE_D] >> 10) & 0x1f);
 		}
 	}
 
 	void Decoder::decodeGroup10A() {
-		// Acquire lock
-		std::lock_guard<std::mutex> lck(group10AMtx);
 
 		// Check if the text needs to be cleared
 		bool ab = (blocks[BLOCK_TYPE_B] >> 14) & 1;
-		if (ab != lastPTYNAB) programTypeName = "        ";
-		lastPTYNAB = ab;
+		if (ab != state.lastPTYNAB) {
+			memset(state.programTypeName, ' ', 8);
+			textDirty |= TEXT_PTYN;
+		}
+		state.lastPTYNAB = ab;
 
 		// Decode segment address
 		bool seg = (blocks[BLOCK_TYPE_B] >> 10) & 1;
@@ -517,51 +673,43 @@ namespace rds {
 		// Save text depending on address
 		if (seg) {
 			if (blockAvail[BLOCK_TYPE_C]) {
-				programTypeName[4] = (blocks[BLOCK_TYPE_C] >> 18) & 0xFF;
-				programTypeName[5] = (blocks[BLOCK_TYPE_C] >> 10) & 0xFF;
+				setChars(state.programTypeName, 4, blocks[BLOCK_TYPE_C], TEXT_PTYN);
 			}
 			if (blockAvail[BLOCK_TYPE_D]) {
-				programTypeName[6] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
-				programTypeName[7] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
+				setChars(state.programTypeName, 6, blocks[BLOCK_TYPE_D], TEXT_PTYN);
 			}
 		}
 		else {
 			if (blockAvail[BLOCK_TYPE_C]) {
-				programTypeName[0] = (blocks[BLOCK_TYPE_C] >> 18) & 0xFF;
-				programTypeName[1] = (blocks[BLOCK_TYPE_C] >> 10) & 0xFF;
+				setChars(state.programTypeName, 0, blocks[BLOCK_TYPE_C], TEXT_PTYN);
 			}
 			if (blockAvail[BLOCK_TYPE_D]) {
-				programTypeName[2] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
-				programTypeName[3] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
+				setChars(state.programTypeName, 2, blocks[BLOCK_TYPE_D], TEXT_PTYN);
 			}
 		}
 
 		// Update timeout
-		group10ALastUpdate = std::chrono::high_resolution_clock::now();
+		state.group10ALastUpdate = bitCount;
 	}
 
 	void Decoder::decodeGroup15A() {
-		// Acquire lock
-		std::lock_guard<std::mutex> lck(group15AMtx);
 
 		if (blockAvail[BLOCK_TYPE_C] && blockAvail[BLOCK_TYPE_D]) {
 			/* Decode Long PS */
 
 			uint8_t segment = (blocks[BLOCK_TYPE_B] >> 10) & 0b111;
 			uint8_t lpsSegment = segment * 4;
-			longPS[lpsSegment + 0] = (blocks[BLOCK_TYPE_C] >> 18) & 0xFF;
-			longPS[lpsSegment + 1] = (blocks[BLOCK_TYPE_C] >> 10) & 0xFF;
-			longPS[lpsSegment + 2] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
-			longPS[lpsSegment + 3] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
+			state.longPS[lpsSegment + 0] = (blocks[BLOCK_TYPE_C] >> 18) & 0xFF;
+			state.longPS[lpsSegment + 1] = (blocks[BLOCK_TYPE_C] >> 10) & 0xFF;
+			state.longPS[lpsSegment + 2] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
+			state.longPS[lpsSegment + 3] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
 		}
 
 		// Update timeout
-		group15ALastUpdate = std::chrono::high_resolution_clock::now();
+		state.group15ALastUpdate = bitCount;
 	}
 
 	void Decoder::decodeGroup15B() {
-		// Acquire lock
-		std::lock_guard<std::mutex> lck(group0Mtx);
 
 		bool ta_c = 0;
 		bool di_c = 0;
@@ -581,52 +729,49 @@ namespace rds {
 			di_d = (blocks[BLOCK_TYPE_D] >> 12) & 1;
 		}
 		if (blockAvail[BLOCK_TYPE_C] && blockAvail[BLOCK_TYPE_D] && (segment_c != segment_d || ta_c != ta_d || di_c != di_d)) return;
-		trafficAnnouncement = ta_c;
+		state.trafficAnnouncement = ta_c;
 
 		uint8_t diBit = di_c;
 		uint8_t diBitPlacement = 3 - segment_c;
-		decoderIdent &= ~(1 << diBitPlacement);
-		decoderIdent |= (diBit << diBitPlacement);
+		state.decoderIdent &= ~(1 << diBitPlacement);
+		state.decoderIdent |= (diBit << diBitPlacement);
 	}
 
 	void Decoder::decodeGroupRTP() {
-		std::lock_guard<std::mutex> lck(rtpMtx);
 
 		uint8_t b_lower = (blocks[BLOCK_TYPE_B] >> 10) & 0xFF;
 
-		rtp_item_toggle = (b_lower >> 4) & 0x01;
-		rtp_item_running = (b_lower >> 3) & 0x01;
+		state.rtp_item_toggle = (b_lower >> 4) & 0x01;
+		state.rtp_item_running = (b_lower >> 3) & 0x01;
 
 		uint8_t type1_upper = b_lower & 0x07;
 
 		if (blockAvail[BLOCK_TYPE_C]) {
 			uint16_t c = blocks[BLOCK_TYPE_C] >> 10;
 			uint8_t type1_lower = (c >> 13) & 0x07;
-			rtp_content_type_1 = (type1_upper << 3) | type1_lower;
-			rtp_content_type_1_start = (c >> 7) & 0x3F;
-			rtp_content_type_1_len   = (c >> 1) & 0x3F;
-			if (rtp_content_type_1_start > 63) rtp_content_type_1_start = 0;
-			if (rtp_content_type_1_len > 64 || rtp_content_type_1_start + rtp_content_type_1_len > 64) rtp_content_type_1_len = 64 - rtp_content_type_1_start;
+			state.rtp_content_type_1 = (type1_upper << 3) | type1_lower;
+			state.rtp_content_type_1_start = (c >> 7) & 0x3F;
+			state.rtp_content_type_1_len   = (c >> 1) & 0x3F;
+			if (state.rtp_content_type_1_start > 63) state.rtp_content_type_1_start = 0;
+			if (state.rtp_content_type_1_len > 64 || state.rtp_content_type_1_start + state.rtp_content_type_1_len > 64) state.rtp_content_type_1_len = 64 - state.rtp_content_type_1_start;
 			uint8_t type2_upper = c & 0x01;
 
 			if (blockAvail[BLOCK_TYPE_D]) {
 				uint16_t d = blocks[BLOCK_TYPE_D] >> 10;
 				uint8_t type2_lower = (d >> 11) & 0x1F;
-				rtp_content_type_2 = (type2_upper << 5) | type2_lower;
-				rtp_content_type_2_start = (d >> 5) & 0x3F;
-				rtp_content_type_2_len = d & 0x1F;
-				if (rtp_content_type_2_start > 63) rtp_content_type_2_start = 0;
-				if (rtp_content_type_2_len > 64 || rtp_content_type_2_start + rtp_content_type_2_len > 64) rtp_content_type_2_len = 64 - rtp_content_type_2_start;
+				state.rtp_content_type_2 = (type2_upper << 5) | type2_lower;
+				state.rtp_content_type_2_start = (d >> 5) & 0x3F;
+				state.rtp_content_type_2_len = d & 0x1F;
+				if (state.rtp_content_type_2_start > 63) state.rtp_content_type_2_start = 0;
+				if (state.rtp_content_type_2_len > 64 || state.rtp_content_type_2_start + state.rtp_content_type_2_len > 64) state.rtp_content_type_2_len = 64 - state.rtp_content_type_2_start;
 
 			}
 		}
 
-		rtpLastUpdate = std::chrono::high_resolution_clock::now();
+		state.rtpLastUpdate = bitCount;
 	}
 
 	void Decoder::decodeGroupERT() {
-		// Acquire lock
-		std::lock_guard<std::mutex> lck(ertMtx);
 
 		// Get char segment and write chars in the Radiotext
 		// No AB flag in this group
@@ -637,49 +782,64 @@ namespace rds {
 
 		// Write char at segment in Radiotext
 		uint8_t ertSegment = segment * 4;
-		if(ert_direction) ertSegment = 128-ertSegment;
+		if(state.ert_direction) ertSegment = 128-ertSegment;
+		if (ertSegment + 4 > 128) return;
 		if (blockAvail[BLOCK_TYPE_C]) {
-			ert[ertSegment + 0] = (blocks[BLOCK_TYPE_C] >> 18) & 0xFF;
-			ert[ertSegment + 1] = (blocks[BLOCK_TYPE_C] >> 10) & 0xFF;
-
-			// Clear ert if \r is present
-			if (ert[ertSegment + 0] == 0x0D) {
-				for (size_t i = ertSegment; i < 128; ++i) ert[i] = ' ';
-			} else if(ert[ertSegment + 1] == 0x0D) {
-				for (size_t i = ertSegment + 1; i < 128; ++i) ert[i] = ' ';
+			setChars(state.ert, ertSegment, blocks[BLOCK_TYPE_C], TEXT_ERT);
+
+			// Clear state.ert if \r is present
+			if (state.ert_ucs2) {
+				if (((blocks[BLOCK_TYPE_C] >> 10) & 0xFFFF) == 0x0D) clearERT(ertSegment);
+			} else if (state.ert[ertSegment + 0] == 0x0D) {
+				clearERT(ertSegment);
+			} else if(state.ert[ertSegment + 1] == 0x0D) {
+				clearERT(ertSegment + 1);
 			}
 		}
 		if (blockAvail[BLOCK_TYPE_D]) {
-			ert[ertSegment + 2] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
-			ert[ertSegment + 3] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
-
-			// Clear ert if \r is present
-			if (ert[ertSegment + 2] == 0x0D) {
-				for (size_t i = ertSegment + 2; i < 128; ++i) ert[i] = ' ';
-			} else if(ert[ertSegment + 3] == 0x0D) {
-				for (size_t i = ertSegment + 3; i < 128; ++i) ert[i] = ' ';
+			setChars(state.ert, ertSegment + 2, blocks[BLOCK_TYPE_D], TEXT_ERT);
+
+			// Clear state.ert if \r is present
+			if (state.ert_ucs2) {
+				if (((blocks[BLOCK_TYPE_D] >> 10) & 0xFFFF) == 0x0D) clearERT(ertSegment + 2);
+			} else if (state.ert[ertSegment + 2] == 0x0D) {
+				clearERT(ertSegment + 2);
+			} else if(state.ert[ertSegment + 3] == 0x0D) {
+				clearERT(ertSegment + 3);
 			}
 		}
 
 		// Update timeout
-		ertLastUpdate = std::chrono::high_resolution_clock::now();
+		state.ertLastUpdate = bitCount;
+	}
+
+	void Decoder::clearERT(int from) {
+		// UCS-2 blanks are 0x0020, so every even byte is zero
+		for (int i = from; i < 128; i++) {
+			state.ert[i] = (state.ert_ucs2 && !(i & 1)) ? 0 : ' ';
+		}
+		textDirty |= TEXT_ERT;
 	}
 
 	void Decoder::decodeDataERT() {
-		std::lock_guard<std::mutex> lck(ertMtx);
 
-		ert_ucs2 = (blocks[BLOCK_TYPE_C] >> 10) & 1;
-		ert_direction = (blocks[BLOCK_TYPE_C] >> 11) & 1;
+		// Text received in the other encoding is meaningless now
+		bool ucs2 = (blocks[BLOCK_TYPE_C] >> 10) & 1;
+		if (ucs2 != state.ert_ucs2) {
+			state.ert_ucs2 = ucs2;
+			clearERT(0);
+		}
+		state.ert_direction = (blocks[BLOCK_TYPE_C] >> 11) & 1;
 	}
 
 	void Decoder::decodeGroupODA() {
 		uint16_t aid = 0;
 
 		// First check if we know what this is
-		for(int i = 0; i < oda_aid_count; i++) {
-			if(odas_aid[i].GroupType == groupType && odas_aid[i].GroupVer == groupVer) {
+		for(int i = 0; i < state.oda_aid_count; i++) {
+			if(state.odas_aid[i].GroupType == state.groupType && state.odas_aid[i].GroupVer == state.groupVer) {
 				// Found it!
-				aid = odas_aid[i].AID;
+				aid = state.odas_aid[i].AID;
 				break;
 			}
 		}
@@ -689,11 +849,11 @@ namespace rds {
 		switch(aid) {
 			case 0x4BD7:
 				// RTP
-				if(groupVer == GROUP_VER_A) decodeGroupRTP();
+				if(state.groupVer == GROUP_VER_A) decodeGroupRTP();
 				break;
 			case 0x6552:
 				// ERT
-				if(groupVer == GROUP_VER_A) decodeGroupERT();
+				if(state.groupVer == GROUP_VER_A) decodeGroupERT();
 				break;
 			default:
 				// Unknown AID
@@ -701,6 +861,25 @@ namespace rds {
 		}
 	}
 
+	void Decoder::pushGroup() {
+		const BlockType order[4] = { BLOCK_TYPE_A, BLOCK_TYPE_B, groupCType, BLOCK_TYPE_D };
+
+		GroupEvent ev;
+		ev.time = bitCount;
+		ev.avail = 0;
+		for (int i = 0; i < 4; i++) {
+			BlockType t = order[i];
+			bool avail = blockAvail[t] && (t != BLOCK_TYPE_A || groupHasA);
+			ev.blocks[i] = avail ? (blocks[t] >> 10) & 0xFFFF : 0;
+			ev.corrected[i] = avail ? blockCorrected[t] : 0;
+			ev.avail |= avail << i;
+		}
+		ev.groupType = state.groupType;
+		ev.groupVer = state.groupVer;
+
+		groups.push(ev);
+	}
+
 	void Decoder::decodeGroup() {
 		// Make sure blocks B is available
 		if (!blockAvail[BLOCK_TYPE_B]) { return; }
@@ -708,42 +887,45 @@ namespace rds {
 		// Decode block B
 		decodeBlockB();
 
+		// Hand the raw group to whoever is logging
+		pushGroup();
+
 		// Decode depending on group type
-		switch (groupType) {
+		switch (state.groupType) {
 		case 0:
 			// PS, AF
 			decodeGroup0();
 			break;
 		case 1:
 			// ECC
-			if(groupVer == GROUP_VER_A) decodeGroup1A();
-			if(groupVer == GROUP_VER_B) decodeGroupODA();
+			if(state.groupVer == GROUP_VER_A) decodeGroup1A();
+			if(state.groupVer == GROUP_VER_B) decodeGroupODA();
 			break;
 		case 2:
 			// RT
 			decodeGroup2();
 			break;
 		case 3:
-			if(groupVer == GROUP_VER_A) decodeGroup3A();
-			if(groupVer == GROUP_VER_B) decodeGroupODA();
+			if(state.groupVer == GROUP_VER_A) decodeGroup3A();
+			if(state.groupVer == GROUP_VER_B) decodeGroupODA();
 			break;
 		case 4:
 			// CT
-			if(groupVer == GROUP_VER_A) decodeGroup4A();
-			if(groupVer == GROUP_VER_B) decodeGroupODA();
+			if(state.groupVer == GROUP_VER_A) decodeGroup4A();
+			if(state.groupVer == GROUP_VER_B) decodeGroupODA();
 			break;
 		case 10:
 			// PTYN
-			if(groupVer == GROUP_VER_A) decodeGroup10A();
-			if(groupVer == GROUP_VER_B) decodeGroupODA();
+			if(state.groupVer == GROUP_VER_A) decodeGroup10A();
+			if(state.groupVer == GROUP_VER_B) decodeGroupODA();
 			break;
 		case 14:
 			// TODO: handle EON
 			break;
 		case 15:
 			// LPS
-			if(groupVer == GROUP_VER_A) decodeGroup15A();
-			if(groupVer == GROUP_VER_B) decodeGroup15B();
+			if(state.groupVer == GROUP_VER_A) decodeGroup15A();
+			if(state.groupVer == GROUP_VER_B) decodeGroup15B();
 			break;
 		default:
 			decodeGroupODA();
@@ -800,113 +982,83 @@ namespace rds {
 		return "Not Assigned";
 	}
 
-	void Decoder::reset() {
-		piCode = 0;
-		programCoverage = AREA_COVERAGE_LOCAL;
-		callsign = "";
-
-		groupType = 0;
-		groupVer = GROUP_VER_A;
-		trafficProgram = false;
-		programType = PROGRAM_TYPE_EU_NONE;
-
-		trafficAnnouncement = false;
-
-		decoderIdent = 0;
-		alternativeFrequency = 0;
-		ps = "        ";
-
-		radioText = "                                                                ";
-		lastRTAB = false;
-
-		lastPTYNAB = false;
-		programTypeName = "        ";
-
-		ecc = 0;
-
-		longPS = "                                ";
-
-		clock_hour = 0;
-		clock_minute = 0;
-		clock_offset_sense = false;
-		clock_offset = 0;
-		clock_mjd = 0;
-
-		afCount = 0;
-		afState = 0;
-		afLfMfIncoming = 0;
-		afs.fill(0);
-
-		oda_aid_count = 0;
-		odas_aid.fill(ODAAID{});
-
-		ert = "                                                                                                                                ";
-		ert_ucs2 = false;
-        ert_direction = false;
-
-		rtp_content_type_1 = 0;
-        rtp_content_type_1_start = 0;
-        rtp_content_type_1_len = 0;
-
-        rtp_content_type_2 = 0;
-        rtp_content_type_2_start = 0;
-        rtp_content_type_2_len = 0;
-
-		rtp_item_running = false;
-        rtp_item_toggle = false;
-
-		blockALastUpdate = std::chrono::high_resolution_clock::time_point();
-		blockBLastUpdate = std::chrono::high_resolution_clock::time_point();
-		group0LastUpdate = std::chrono::high_resolution_clock::time_point();
-		group1LastUpdate = std::chrono::high_resolution_clock::time_point();
-		group2LastUpdate = std::chrono::high_resolution_clock::time_point();
-		group10ALastUpdate = std::chrono::high_resolution_clock::time_point();
-		group15ALastUpdate = std::chrono::high_resolution_clock::time_point();
-		eccLastUpdate = std::chrono::high_resolution_clock::time_point();
-		rtpLastUpdate = std::chrono::high_resolution_clock::time_point();
+	void Decoder::updateSyncState() {
+		// Stable takes a full count of good blocks and is kept until most of it is gone, so the state doesn't flap on every bad block
+		SyncState next;
+		if (!sync) { next = SYNC_STATE_SEARCHING; }
+		else if (sync == SYNC_MAX) { next = SYNC_STATE_STABLE; }
+		else if (state.syncState == SYNC_STATE_STABLE && sync > 1) { next = SYNC_STATE_STABLE; }
+		else { next = SYNC_STATE_ACQUIRING; }
+		if (next == state.syncState) { return; }
+
+		state.syncState = next;
+		state.syncStateSince = bitCount;
+		state.syncTransitions++;
+		if (next == SYNC_STATE_STABLE && !state.firstStableSync) { state.firstStableSync = bitCount; }
+		syncStateNow.store(next, std::memory_order_relaxed);
 	}
 
-	bool Decoder::blockAValid() {
-		auto now = std::chrono::high_resolution_clock::now();
-		return (std::chrono::duration_cast<std::chrono::milliseconds>(now - blockALastUpdate)).count() < RDS_BLOCK_A_TIMEOUT_MS;
+	void Decoder::checkReset() {
+		if (!resetPending.exchange(false)) { return; }
+		resetState();
+		publish();
 	}
 
-	bool Decoder::blockBValid() {
-		auto now = std::chrono::high_resolution_clock::now();
-		return (std::chrono::duration_cast<std::chrono::milliseconds>(now - blockBLastUpdate)).count() < RDS_BLOCK_B_TIMEOUT_MS;
+	void Decoder::publish() {
+		if (textDirty) { updateText(); }
+		state.time = bitCount;
+		snapshot.store(state);
 	}
 
-	bool Decoder::group0Valid() {
-		auto now = std::chrono::high_resolution_clock::now();
-		return (std::chrono::duration_cast<std::chrono::milliseconds>(now - group0LastUpdate)).count() < RDS_GROUP_0_TIMEOUT_MS;
-	}
+	void Decoder::resetState() {
+		state = RDSState();
 
-	bool Decoder::eccValid() {
-		auto now = std::chrono::high_resolution_clock::now();
-		return (std::chrono::duration_cast<std::chrono::milliseconds>(now - eccLastUpdate)).count() < RDS_ECC_TIMEOUT_MS;
+		// Whatever was in sync before doesn't mean anything anymore, start acquiring from scratch
+		sync = 0;
+		skip = 0;
+		syncStateNow.store(SYNC_STATE_SEARCHING, std::memory_order_relaxed);
+		state.syncStateSince = bitCount;
+		state.acquisitionStart = bitCount;
+		alternativeFrequency = 0;
+		afState = 0;
+		afLfMfIncoming = 0;
+		textDirty = 0;
 	}
 
-	bool Decoder::group2Valid() {
-		auto now = std::chrono::high_resolution_clock::now();
-		return (std::chrono::duration_cast<std::chrono::milliseconds>(now - group2LastUpdate)).count() < RDS_GROUP_2_TIMEOUT_MS;
-	}
+	void Decoder::setChars(char* text, int pos, uint32_t block, uint8_t field) {
+		char c0 = (block >> 18) & 0xFF;
+		char c1 = (block >> 10) & 0xFF;
 
-	bool Decoder::group10AValid() {
-		auto now = std::chrono::high_resolution_clock::now();
-		return (std::chrono::duration_cast<std::chrono::milliseconds>(now - group10ALastUpdate)).count() < RDS_GROUP_10_TIMEOUT_MS;
+		// Only invalidate the converted text if something actually changed
+		if (text[pos] == c0 && text[pos + 1] == c1) { return; }
+		text[pos] = c0;
+		text[pos + 1] = c1;
+		textDirty |= field;
 	}
 
-	bool Decoder::group15AValid() {
-		auto now = std::chrono::high_resolution_clock::now();
-		return (std::chrono::duration_cast<std::chrono::milliseconds>(now - group15ALastUpdate)).count() < RDS_GROUP_15_TIMEOUT_MS;
+	void Decoder::updateText() {
+		if (textDirty & TEXT_PS) {
+			convert_from_rdscharset(state.ps, 8, state.psUTF8, sizeof(state.psUTF8));
+		}
+		if (textDirty & TEXT_RT) {
+			convert_from_rdscharset(state.radioText, 64, state.radioTextUTF8, sizeof(state.radioTextUTF8));
+		}
+		if (textDirty & TEXT_PTYN) {
+			convert_from_rdscharset(state.programTypeName, 8, state.programTypeNameUTF8, sizeof(state.programTypeNameUTF8));
+		}
+		if (textDirty & TEXT_ERT) {
+			// ERT is already UTF-8 unless it's flagged as UCS-2
+			if (state.ert_ucs2) {
+				convert_from_ucs2(state.ert, 128, state.ertUTF8, sizeof(state.ertUTF8));
+			}
+			else {
+				snprintf(state.ertUTF8, sizeof(state.ertUTF8), "%s", state.ert);
+			}
+		}
+		textDirty = 0;
 	}
 
-	bool Decoder::groupRTPvalid() {
-		auto now = std::chrono::high_resolution_clock::now();
-		return (std::chrono::duration_cast<std::chrono::milliseconds>(now - rtpLastUpdate)).count() < RDS_GROUP_RTP_TIMEOUT_MS;
-	}
-	bool Decoder::groupERTvalid() {
-		auto now = std::chrono::high_resolution_clock::now();
-		return (std::chrono::duration_cast<std::chrono::milliseconds>(now - ertLastUpdate)).count() < RDS_GROUP_ERT_TIMEOUT_MS;
+	bool RDSState::CTReceived() const {
+		return Decoder::getMJDMonth(clock_mjd) != 0;
 	}
 }
\ No newline at end of file
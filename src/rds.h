@@ -2,9 +2,10 @@
 #include <stdint.h>
 #include <string>
 #include <array>
-#include <chrono>
-#include <mutex>
+#include <atomic>
 #include "charset.h"
+#include "seqlock.h"
+#include "spsc_ring.h"
 
 #define RDS_BLOCK_A_TIMEOUT_MS  15000.0
 #define RDS_BLOCK_B_TIMEOUT_MS  4000.0
@@ -17,6 +18,8 @@
 #define RDS_GROUP_RTP_TIMEOUT_MS 15000.0
 #define RDS_GROUP_ERT_TIMEOUT_MS 13000.0
 
+#define RDS_BIT_RATE    1187.5
+
 namespace rds {
     enum BlockType {
         BLOCK_TYPE_A,
@@ -27,11 +30,36 @@ namespace rds {
         _BLOCK_TYPE_COUNT
     };
 
+    enum CorrectionPolicy {
+        CORRECTION_POLICY_DETECT_ONLY,
+        CORRECTION_POLICY_SINGLE_BIT,
+        CORRECTION_POLICY_BURST,
+        _CORRECTION_POLICY_COUNT
+    };
+
+    struct BlockStats {
+        uint64_t blocks = 0;
+        uint64_t corrected = 0;
+        uint64_t correctedBits = 0;
+        uint64_t uncorrectable = 0;
+        uint64_t softRecovered = 0;
+        uint64_t softFlippedBits = 0;
+    };
+
     enum GroupVersion {
         GROUP_VER_A,
         GROUP_VER_B
     };
 
+    enum SyncState {
+        // No block boundaries found
+        SYNC_STATE_SEARCHING,
+        // Some blocks lined up, not enough to trust them yet
+        SYNC_STATE_ACQUIRING,
+        // A whole group of good blocks, only lost again after several bad ones
+        SYNC_STATE_STABLE
+    };
+
     enum AreaCoverage {
         AREA_COVERAGE_INVALID           = -1,
         AREA_COVERAGE_LOCAL             = 0,
@@ -306,86 +334,217 @@ namespace rds {
         DECODER_IDENT_DYNAMIC_PTY = (1 << 3)
     };
 
-    class Decoder {
-    public:
-        unsigned int getMJDDay(double mjd);
-        unsigned int getMJDMonth(double mjd);
-        unsigned int getMJDYear(double mjd);
+    // Time is measured in bits received by the decoder, 0 means never
+    typedef uint64_t Timestamp;
 
-        void process(uint8_t* symbols, int count);
+    constexpr Timestamp msToBits(double ms) { return (Timestamp)(ms * RDS_BIT_RATE / 1000.0); }
+    constexpr double bitsToMs(Timestamp bits) { return (double)bits * 1000.0 / RDS_BIT_RATE; }
 
-        bool piCodeValid() { std::lock_guard<std::mutex> lck(blockAMtx); return blockAValid(); }
-        uint16_t getPICode() { std::lock_guard<std::mutex> lck(blockAMtx); return piCode; }
-        uint8_t getProgramCoverage() { std::lock_guard<std::mutex> lck(blockAMtx); return programCoverage; }
-        std::string getCallsign() { std::lock_guard<std::mutex> lck(blockAMtx); return callsign; }
+    // Everything the decoder knows about the station. Plain data so that it can be published as a whole, see Decoder::getState()
+    struct RDSState {
+        // Decoder time when this state was published
+        Timestamp time = 0;
+
+        // Block A (All groups)
+        Timestamp blockALastUpdate = 0;
+        uint16_t piCode = 0;
+        AreaCoverage programCoverage = AREA_COVERAGE_LOCAL;
+        char callsign[64] = "";
 
-        bool programTypeValid() { std::lock_guard<std::mutex> lck(blockBMtx); return blockBValid(); }
-        ProgramType getProgramType() { std::lock_guard<std::mutex> lck(blockBMtx); return programType; }
+        // Block B (All groups)
+        Timestamp blockBLastUpdate = 0;
+        uint8_t groupType = 0;
+        GroupVersion groupVer = GROUP_VER_A;
+        bool trafficProgram = false;
+        ProgramType programType = PROGRAM_TYPE_EU_NONE;
+
+        // Group type 0
+        Timestamp group0LastUpdate = 0;
+        bool trafficAnnouncement = false;
+        uint8_t decoderIdent = 0;
+        char ps[9] = "        ";
+        char psUTF8[8 * UTF8_MAX_CHAR_LEN + 1] = "        ";
+        // One bit per PS segment received since the last reset
+        uint8_t psSegments = 0;
+        std::array<uint32_t, 25> afs{};
+        uint8_t afCount = 0;
 
-        double getClockMJD() { std::lock_guard<std::mutex> lck(group4AMtx) ;return clock_mjd; }
-        uint8_t getClockHour() { std::lock_guard<std::mutex> lck(group4AMtx); return clock_hour; }
-        uint8_t getClockMinute() { std::lock_guard<std::mutex> lck(group4AMtx); return clock_minute; }
-        uint8_t getClockOffset() { std::lock_guard<std::mutex> lck(group4AMtx); return clock_offset; }
-        bool getClockOffsetSense() { std::lock_guard<std::mutex> lck(group4AMtx); return clock_offset_sense; }
+        // Group type 1
+        Timestamp group1LastUpdate = 0;
+        Timestamp eccLastUpdate = 0;
+        uint8_t ecc = 0;
 
-        bool CTReceived() { std::lock_guard<std::mutex> lck(group4AMtx); return getMJDMonth(clock_mjd) != 0; }
+        // Group type 2
+        Timestamp group2LastUpdate = 0;
+        bool lastRTAB = false;
+        char radioText[65] = "                                                                ";
+        char radioTextUTF8[64 * UTF8_MAX_CHAR_LEN + 1] = "                                                                ";
 
-        bool LPSNameValid() { std::lock_guard<std::mutex> lck(group15AMtx); return group15AValid(); }
-        std::string getLPSName() { std::lock_guard<std::mutex> lck(group15AMtx); return longPS; }
+        // Group type 3A
+        std::array<ODAAID, 8> odas_aid{};
+        uint8_t oda_aid_count = 0;
 
-        bool eccValid();
-        uint16_t getEcc() { std::lock_guard<std::mutex> lck(group1Mtx); return ecc; }
+        // Group type 4A
+        uint8_t clock_hour = 0;
+        uint8_t clock_minute = 0;
+        bool clock_offset_sense = false;
+        uint8_t clock_offset = 0;
+        double clock_mjd = 0;
 
-        bool tpValid() { std::lock_guard<std::mutex> lck(group0Mtx); return group0Valid(); }
-        bool getTp() { std::lock_guard<std::mutex> lck(group0Mtx); return trafficProgram; }
+        // Group type 10A
+        Timestamp group10ALastUpdate = 0;
+        bool lastPTYNAB = false;
+        char programTypeName[9] = "        ";
+        char programTypeNameUTF8[8 * UTF8_MAX_CHAR_LEN + 1] = "        ";
 
-        bool taValid() { std::lock_guard<std::mutex> lck(group0Mtx); return group0Valid(); }
-        bool getTa() { std::lock_guard<std::mutex> lck(group0Mtx); return trafficAnnouncement; }
+        // Group type 15A
+        Timestamp group15ALastUpdate = 0;
+        char longPS[33] = "                                ";
 
-        bool diValid() { std::lock_guard<std::mutex> lck(group0Mtx); return group0Valid(); }
-        uint8_t getDi() { std::lock_guard<std::mutex> lck(group0Mtx); return decoderIdent; }
+        // RT+
+        Timestamp rtpLastUpdate = 0;
+        bool rtp_item_running = false;
+        bool rtp_item_toggle = false;
 
-        bool musicValid() { std::lock_guard<std::mutex> lck(group0Mtx); return group0Valid(); }
+        uint8_t rtp_content_type_1 = 0;
+        uint8_t rtp_content_type_1_start = 0;
+        uint8_t rtp_content_type_1_len = 0;
 
-        bool afValid() { std::lock_guard<std::mutex> lck(group0Mtx); return group0Valid() && afCount != 0; }
-        uint8_t getAFCount() { std::lock_guard<std::mutex> lck(group0Mtx); return afCount; }
-        std::array<uint32_t, 25> getAFs() { std::lock_guard<std::mutex> lck(group0Mtx); return afs; }
+        uint8_t rtp_content_type_2 = 0;
+        uint8_t rtp_content_type_2_start = 0;
+        uint8_t rtp_content_type_2_len = 0;
 
-        bool odaAIDValid() { std::lock_guard<std::mutex> lck(group3AMtx); return oda_aid_count != 0; }
-        std::array<ODAAID, 8> getOdaAID() { std::lock_guard<std::mutex> lck(group3AMtx); return odas_aid; }
-        uint8_t getOdaAIDCount() { std::lock_guard<std::mutex> lck(group3AMtx); return oda_aid_count; }
+        // ERT
+        Timestamp ertLastUpdate = 0;
+        char ert[129] = "                                                                                                                                ";
+        char ertUTF8[64 * UTF8_MAX_CHAR_LEN + 1] = "                                                                                                                                ";
+        bool ert_ucs2 = false;
+        bool ert_direction = false;
 
-        bool rtpValid() { std::lock_guard<std::mutex> lck(rtpMtx); return groupRTPvalid(); }
-        bool getRTPRunning() { std::lock_guard<std::mutex> lck(rtpMtx); return rtp_item_running; }
-        bool getRTPToggle() { std::lock_guard<std::mutex> lck(rtpMtx); return rtp_item_toggle; }
-        uint8_t getRTPContentType1() { std::lock_guard<std::mutex> lck(rtpMtx); return rtp_content_type_1; }
-        uint8_t getRTPContentType1Start() { std::lock_guard<std::mutex> lck(rtpMtx); return rtp_content_type_1_start; }
-        uint8_t getRTPContentType1Len() { std::lock_guard<std::mutex> lck(rtpMtx); return rtp_content_type_1_len+1; }
-        uint8_t getRTPContentType2() { std::lock_guard<std::mutex> lck(rtpMtx); return rtp_content_type_2; }
-        uint8_t getRTPContentType2Start() { std::lock_guard<std::mutex> lck(rtpMtx); return rtp_content_type_2_start; }
-        uint8_t getRTPContentType2Len() { std::lock_guard<std::mutex> lck(rtpMtx); return rtp_content_type_2_len+1; }
+        // Error correction
+        BlockStats blockStats;
+
+        // Block sync, transitions counts every change of syncState since the last reset
+        SyncState syncState = SYNC_STATE_SEARCHING;
+        Timestamp syncStateSince = 0;
+        uint32_t syncTransitions = 0;
+
+        // Acquisition, the first PI and the first stable sync since the last reset
+        Timestamp acquisitionStart = 0;
+        Timestamp firstPI = 0;
+        Timestamp firstStableSync = 0;
+
+        // Negative until it happens
+        double timeToFirstPIMs() const { return firstPI ? bitsToMs(firstPI - acquisitionStart) : -1.0; }
+        double timeToStableSyncMs() const { return firstStableSync ? bitsToMs(firstStableSync - acquisitionStart) : -1.0; }
+
+        bool piCodeValid() const { return fresh(blockALastUpdate, RDS_BLOCK_A_TIMEOUT_MS); }
+        bool programTypeValid() const { return fresh(blockBLastUpdate, RDS_BLOCK_B_TIMEOUT_MS); }
+        bool group0Valid() const { return fresh(group0LastUpdate, RDS_GROUP_0_TIMEOUT_MS); }
+        bool PSNameValid() const { return group0Valid(); }
+        bool psComplete() const { return psSegments == 0xF; }
+        bool tpValid() const { return group0Valid(); }
+        bool taValid() const { return group0Valid(); }
+        bool diValid() const { return group0Valid(); }
+        bool musicValid() const { return group0Valid(); }
+        bool afValid() const { return group0Valid() && afCount != 0; }
+        bool eccValid() const { return fresh(eccLastUpdate, RDS_ECC_TIMEOUT_MS); }
+        bool radioTextValid() const { return fresh(group2LastUpdate, RDS_GROUP_2_TIMEOUT_MS); }
+        bool odaAIDValid() const { return oda_aid_count != 0; }
+        bool programTypeNameValid() const { return fresh(group10ALastUpdate, RDS_GROUP_10_TIMEOUT_MS); }
+        bool LPSNameValid() const { return fresh(group15ALastUpdate, RDS_GROUP_15_TIMEOUT_MS); }
+        bool rtpValid() const { return fresh(rtpLastUpdate, RDS_GROUP_RTP_TIMEOUT_MS); }
+        bool ertValid() const { return fresh(ertLastUpdate, RDS_GROUP_ERT_TIMEOUT_MS); }
+        bool CTReceived() const;
 
-        bool ertValid() { std::lock_guard<std::mutex> lck(ertMtx); return groupERTvalid(); }
-        std::string getERT() {
-            std::lock_guard<std::mutex> lck(ertMtx);
-            if(ert_ucs2) return convert_from_rdscharset(ert.c_str());
-            else return ert;
+    private:
+        bool fresh(Timestamp since, double timeoutMs) const {
+            return since && (time - since) < msToBits(timeoutMs);
         }
-        
-        bool PSNameValid() { std::lock_guard<std::mutex> lck(group0Mtx); return group0Valid(); }
-        std::string getPSName() { std::lock_guard<std::mutex> lck(group0Mtx); return convert_from_rdscharset(ps.c_str()); }
+    };
 
-        bool radioTextValid() { std::lock_guard<std::mutex> lck(group2Mtx); return group2Valid(); }
-        std::string getRadioText() { std::lock_guard<std::mutex> lck(group2Mtx); return convert_from_rdscharset(radioText.c_str()); }
-        std::string getRadioTextAB() { std::lock_guard<std::mutex> lck(group2Mtx); return lastRTAB ? (std::string)"B" : (std::string)"A"; }
+    // A single group exactly as it was received, in transmission order
+    struct GroupEvent {
+        // Decoder time at the end of block D
+        Timestamp time;
 
-        bool programTypeNameValid() { std::lock_guard<std::mutex> lck(group10AMtx); return group10AValid(); }
-        std::string getProgramTypeName() { std::lock_guard<std::mutex> lck(group10AMtx); return convert_from_rdscharset(programTypeName.c_str()); }
+        // Data words of blocks A, B, C or C' and D
+        uint16_t blocks[4];
 
-        void reset();
-    private:
+        // Bit n set if block n was received, corrected gives the number of bits fixed in each block
+        uint8_t avail;
+        uint8_t corrected[4];
+
+        uint8_t groupType;
+        GroupVersion groupVer;
+    };
+
+    // A single block from a decoder in sync, before it's assembled into a group
+    struct BlockEvent {
+        // Decoder time at the last bit of the block
+        Timestamp time;
+        BlockType type;
+        // All 26 bits, after error correction
+        uint32_t block;
+        bool avail;
+        uint8_t corrected;
+    };
+
+    class Decoder {
+    public:
+        Decoder() {}
+
+        static unsigned int getMJDDay(double mjd);
+        static unsigned int getMJDMonth(double mjd);
+        static unsigned int getMJDYear(double mjd);
+
+        // Differentially decoded hard bits, one per byte
+        void process(const uint8_t* symbols, int count);
+        // Same as process() but takes hard bits packed MSB first into 64 bit words
+        void processPacked(const uint64_t* words, int count);
+        // Soft-decision input, takes the clock recovery output before slicing and differential decoding
+        void processSoft(const float* symbols, int count);
+        // Blocks that were already synced and corrected elsewhere, e.g. picked among several decoders by a
+        // DiversityCombiner. Their time becomes the decoder's time so it has to keep going up. Unavailable
+        // blocks count against sync just like unknown syndromes do.
+        void processBlocks(const BlockEvent* blocks, int count);
+
+        // Called from the decoding thread with every block as it's received, before it's decoded
+        void setBlockHandler(void (*handler)(const BlockEvent& block, void* ctx), void* ctx) {
+            blockHandler = handler;
+            blockHandlerCtx = ctx;
+        }
+
+        // Consistent copy of everything decoded so far. Safe to call from any thread, never blocks the decoding thread.
+        RDSState getState() { return snapshot.load(); }
+        // Changes every time a new state is published
+        uint32_t getStateVersion() { return snapshot.version(); }
+        // Cheaper than getState() when that's all that's needed, e.g. to drive the demodulator's loops
+        SyncState getSyncState() { return syncStateNow.load(std::memory_order_relaxed); }
+
+        // Every decoded group, in order. Only one thread may pop groups.
+        bool popGroup(GroupEvent& group) { return groups.pop(group); }
+        // Groups lost because nobody popped them in time
+        uint64_t getDroppedGroups() { return groups.droppedCount(); }
+
+        void setCorrectionPolicy(CorrectionPolicy policy) { this->policy = policy; }
+        CorrectionPolicy getCorrectionPolicy() { return policy; }
+
+        // Clear everything decoded so far. Safe to call from any thread, the reset is carried out by the decoding thread before it processes new bits.
+        void reset() { resetPending = true; }
+
+        // Stateless helpers the decoder is built from
         static uint16_t calcSyndrome(uint32_t block);
-        static uint32_t correctErrors(uint32_t block, BlockType type, bool& recovered);
+        static uint32_t correctErrors(uint32_t block, BlockType type, CorrectionPolicy policy, bool& recovered, uint8_t& corrected);
+        static std::string base26ToCall(uint16_t pi);
+        static std::string decodeCallsign(uint16_t pi);
+
+    private:
+        void updateBlockStats(bool recovered, uint8_t corrected);
+        void shiftIn(uint8_t bit);
+        void processBlock(BlockType synType, CorrectionPolicy policy);
+        void assembleBlock(BlockType type);
+        bool chaseDecode(BlockType type, uint32_t& block);
         void decodeBlockA();
         void decodeBlockB();
         void decodeGroup0();
@@ -400,120 +559,75 @@ namespace rds {
         void decodeGroupERT();
         void decodeGroupODA();
         void decodeGroup();
+        void pushGroup();
 
         void decodeDataERT();
 
         void decodeAlternativeFrequencies();
 
-        static std::string base26ToCall(uint16_t pi);
-        static std::string decodeCallsign(uint16_t pi);
+        void updateSyncState();
+        void checkReset();
+        void resetState();
+        void publish();
 
-        bool blockAValid();
-        bool blockBValid();
-        bool group0Valid();
-        bool group2Valid();
-        bool group10AValid();
-        bool group15AValid();
-
-        bool groupRTPvalid();
-        bool groupERTvalid();
+        void setChars(char* text, int pos, uint32_t block, uint8_t field);
+        void clearERT(int from);
+        void updateText();
 
+        // Bits received so far, this is the decoder's clock
+        Timestamp bitCount = 0;
 
         // State machine
         uint32_t shiftReg = 0;
+        uint16_t syndromeReg = 0;
+        static constexpr int SYNC_MAX = 4;
         int sync = 0;
         int skip = 0;
+        std::atomic<SyncState> syncStateNow{ SYNC_STATE_SEARCHING };
         BlockType lastType = BLOCK_TYPE_A;
         int contGroup = 0;
+        bool groupHasA = false;
+        BlockType groupCType = BLOCK_TYPE_C;
         uint32_t blocks[_BLOCK_TYPE_COUNT];
         bool blockAvail[_BLOCK_TYPE_COUNT];
-
-        // Block A (All groups)
-        std::mutex blockAMtx;
-        std::chrono::time_point<std::chrono::high_resolution_clock> blockALastUpdate{};  // 1970-01-01
-        uint16_t piCode;
-        AreaCoverage programCoverage;
-        std::string callsign;
-
-        // Block B (All groups)
-        std::mutex blockBMtx;
-        std::chrono::time_point<std::chrono::high_resolution_clock> blockBLastUpdate{};  // 1970-01-01
-        uint8_t groupType;
-        GroupVersion groupVer;
-        bool trafficProgram;
-        ProgramType programType;
-
-        // Group type 0
-        std::mutex group0Mtx;
-        std::chrono::time_point<std::chrono::high_resolution_clock> group0LastUpdate{};  // 1970-01-01
-        bool trafficAnnouncement;
-        uint8_t decoderIdent;
-        uint16_t alternativeFrequency;        
-        std::string ps = "        ";
-
-        std::array<uint32_t, 25> afs;
-        uint8_t afCount;
-        uint8_t afState;
-        uint8_t afLfMfIncoming;
-
-        // Group type 1
-        std::mutex group1Mtx;
-        std::chrono::time_point<std::chrono::high_resolution_clock> group1LastUpdate{};  // 1970-01-01
-        std::chrono::time_point<std::chrono::high_resolution_clock> eccLastUpdate{};  // 1970-01-01
-        uint8_t ecc = 0;
-
-        // Group type 2
-        std::mutex group2Mtx;
-        std::chrono::time_point<std::chrono::high_resolution_clock> group2LastUpdate{};  // 1970-01-01
-        bool lastRTAB = false;
-        std::string radioText = "                                                                ";
-
-        // Group type 3A
-        std::mutex group3AMtx;
-        std::array<ODAAID, 8> odas_aid;
-        uint8_t oda_aid_count = 0;
-
-        // Group type 4A
-        std::mutex group4AMtx;
-        uint8_t clock_hour = 0;
-        uint8_t clock_minute = 0;
-        bool clock_offset_sense = false;
-        uint8_t clock_offset = 0;
-        double clock_mjd = 0;
-
-        // Group type 10A
-        std::mutex group10AMtx;
-        std::chrono::time_point<std::chrono::high_resolution_clock> group10ALastUpdate{};  // 1970-01-01
-        bool lastPTYNAB = false;
-        std::string programTypeName = "        ";
-
-        // Group type 15A
-        std::mutex group15AMtx;
-        std::chrono::time_point<std::chrono::high_resolution_clock> group15ALastUpdate{};  // 1970-01-01
-        std::string longPS = "                                ";
-
-        // Group type 15B doesnt have anything
-
-        // ODA
-        std::mutex odaMtx;
-        // RT+
-        std::mutex rtpMtx;
-        std::chrono::time_point<std::chrono::high_resolution_clock> rtpLastUpdate{};  // 1970-01-01
-        bool rtp_item_running = false;
-        bool rtp_item_toggle = false;
-
-        uint8_t rtp_content_type_1 = 0;
-        uint8_t rtp_content_type_1_start = 0;
-        uint8_t rtp_content_type_1_len = 0;
-
-        uint8_t rtp_content_type_2 = 0;
-        uint8_t rtp_content_type_2_start = 0;
-        uint8_t rtp_content_type_2_len = 0;
-        // ERT
-        std::mutex ertMtx;
-        std::chrono::time_point<std::chrono::high_resolution_clock> ertLastUpdate{};  // 1970-01-01
-        std::string ert = "                                                                                                                                ";
-        bool ert_ucs2 = false;
-        bool ert_direction = false;
+        uint8_t blockCorrected[_BLOCK_TYPE_COUNT];
+
+        // Error correction
+        std::atomic<CorrectionPolicy> policy{ CORRECTION_POLICY_BURST };
+
+        // Corrected blocks are also handed to this, see setBlockHandler()
+        void (*blockHandler)(const BlockEvent& block, void* ctx) = NULL;
+        void* blockHandlerCtx = NULL;
+
+        // Soft-decision state, reliability of the last 32 bits indexed by softPos
+        static const int CHASE_BITS = 5;
+        float reliability[32];
+        uint32_t softPos = 0;
+        int softBits = 0;
+        bool lastSoftHard = false;
+        float lastSoftMag = 0.0f;
+
+        // Decoded data, only ever touched by the decoding thread and published to readers through the snapshot
+        RDSState state;
+        SeqLock<RDSState> snapshot;
+        std::atomic<bool> resetPending{ false };
+
+        // Raw groups for logging, about 20s worth at the nominal group rate
+        static const uint32_t GROUP_RING_SIZE = 256;
+        SPSCRing<GroupEvent, GROUP_RING_SIZE> groups;
+
+        // Text fields whose UTF-8 copy is out of date
+        enum TextField {
+            TEXT_PS     = (1 << 0),
+            TEXT_RT     = (1 << 1),
+            TEXT_PTYN   = (1 << 2),
+            TEXT_ERT    = (1 << 3)
+        };
+        uint8_t textDirty = 0;
+
+        // Group type 0 AF decoding
+        uint16_t alternativeFrequency = 0;
+        uint8_t afState = 0;
+        uint8_t afLfMfIncoming = 0;
     };
 }
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "rds_combiner.h"
+#include "rds_syndrome.h"
+#include <math.h>
+#include <algorithm>
+#include <limits>
+
+namespace rds {
+	// Position of each block type in the group, C and C' share a slot
+	static const int BLOCK_POS[_BLOCK_TYPE_COUNT] = { 0, 1, 2, 2, 3 };
+	static const BlockType POS_TYPE[4] = { BLOCK_TYPE_A, BLOCK_TYPE_B, BLOCK_TYPE_C, BLOCK_TYPE_D };
+
+	// Nearest slot to grid time x that holds blocks at position pos
+	static inline int64_t nearestSlot(int64_t x, int pos) {
+		return pos + 4 * llround(((double)x / BLOCK_LEN - pos) / 4.0);
+	}
+
+	void DiversityCombiner::init(int variants, Decoder* out) {
+		this->variants = std::clamp<int>(variants, 1, MAX_DIVERSITY);
+		this->out = out;
+
+		for (int v = 0; v < this->variants; v++) {
+			decoders[v] = std::make_unique<Decoder>();
+			ctxs[v] = { this, v };
+			decoders[v]->setBlockHandler(blockHandler, &ctxs[v]);
+			progress[v] = 0;
+		}
+
+		resetPending = true;
+		checkReset();
+	}
+
+	void DiversityCombiner::process(int v, const uint8_t* bits, int count) {
+		checkReset();
+		decoders[v]->setCorrectionPolicy(out->getCorrectionPolicy());
+		decoders[v]->process(bits, count);
+		progress[v] += count;
+	}
+
+	void DiversityCombiner::processSoft(int v, const float* symbols, int count) {
+		checkReset();
+		decoders[v]->setCorrectionPolicy(out->getCorrectionPolicy());
+		decoders[v]->processSoft(symbols, count);
+		progress[v] += count;
+	}
+
+	void DiversityCombiner::combine() {
+		checkReset();
+
+		if (originKnown) {
+			// How far every variant has got on the grid
+			int64_t done = std::numeric_limits<int64_t>::max();
+			for (int v = 0; v < variants; v++) {
+				done = std::min<int64_t>(done, progress[v] - (offsetKnown[v] ? offset[v] : 0));
+			}
+
+			// Give each slot an extra block before deciding it in case a variant is running a little late
+			while (origin + (nextSlot + 1) * BLOCK_LEN <= done) { decideSlot(); }
+		}
+
+		flush();
+	}
+
+	void DiversityCombiner::blockHandler(const BlockEvent& block, void* ctx) {
+		VariantCtx* vctx = (VariantCtx*)ctx;
+		vctx->_this->addBlock(vctx->v, block);
+	}
+
+	void DiversityCombiner::addBlock(int v, const BlockEvent& block) {
+		int pos = BLOCK_POS[block.type];
+		int64_t t = (int64_t)block.time;
+
+		bool clean = block.avail && !block.corrected;
+		bool anchor = clean && t - lastClean[v] == BLOCK_LEN && pos == (lastCleanPos[v] + 1) % 4;
+		if (clean) {
+			lastClean[v] = t;
+			lastCleanPos[v] = pos;
+		}
+
+		// The first anchor from any variant lays out the grid
+		if (!originKnown) {
+			if (!anchor) { return; }
+			origin = t - pos * BLOCK_LEN;
+			nextSlot = pos;
+			originKnown = true;
+		}
+
+		// Variants never drift apart by anywhere near a whole group so the nearest slot with the right position is the
+		// one. Anchors keep the offset up to date when a variant slips bits.
+		int64_t n;
+		if (!offsetKnown[v]) {
+			if (!anchor) { return; }
+			n = nearestSlot(t - origin, pos);
+			offsetKnown[v] = true;
+		}
+		else {
+			n = nearestSlot(t - offset[v] - origin, pos);
+		}
+		if (anchor) { offset[v] = t - (origin + n * BLOCK_LEN); }
+
+		if (n < nextSlot) {
+			stats.late++;
+			return;
+		}
+
+		// Make room if this variant is far enough ahead of the slowest one
+		while (n >= nextSlot + SLOT_RING_SIZE) { decideSlot(); }
+
+		// Don't let a slipped invalid block replace a valid one
+		Slot& slot = slots[n % SLOT_RING_SIZE];
+		bool present = (slot.present >> v) & 1;
+		if (present && slot.blocks[v].avail && !block.avail) { return; }
+		slot.blocks[v] = block;
+		slot.present |= (1 << v);
+	}
+
+	void DiversityCombiner::decideSlot() {
+		Slot& slot = slots[nextSlot % SLOT_RING_SIZE];
+		BlockEvent ev = { 0, POS_TYPE[nextSlot % 4], 0, false, 0 };
+
+		if (slot.present) {
+			// The valid block most variants agree on wins, then the one with the fewest corrected bits, then the first
+			// variant. Miscorrections rarely agree with each other.
+			uint8_t valid = 0;
+			for (int v = 0; v < variants; v++) {
+				if (((slot.present >> v) & 1) && slot.blocks[v].avail) { valid |= (1 << v); }
+			}
+			int win = -1;
+			int winVotes = 0;
+			int validCount = 0;
+			for (int v = 0; v < variants; v++) {
+				if (!((slot.present >> v) & 1)) { continue; }
+				const BlockEvent& b = slot.blocks[v];
+				if (!b.avail) {
+					if (win < 0) { ev = b; }
+					continue;
+				}
+				stats.variantValid[v]++;
+				validCount++;
+
+				int votes = 0;
+				for (int w = 0; w < variants; w++) {
+					if (((valid >> w) & 1) && slot.blocks[w].block == b.block) { votes++; }
+				}
+				if (win < 0 || votes > winVotes || (votes == winVotes && b.corrected < slot.blocks[win].corrected)) {
+					win = v;
+					winVotes = votes;
+				}
+			}
+
+			stats.slots++;
+			if (win >= 0) {
+				ev = slot.blocks[win];
+				stats.valid++;
+				stats.wins[win]++;
+				if (validCount == 1) { stats.soleWins[win]++; }
+			}
+		}
+
+		// Nobody had anything still counts as a bad block so the output decoder loses sync and keeps its clock going
+		ev.time = (Timestamp)std::max<int64_t>(origin + nextSlot * BLOCK_LEN, 0);
+		outBlocks[outCount++] = ev;
+		if (outCount == SLOT_RING_SIZE) { flush(); }
+
+		slot.present = 0;
+		nextSlot++;
+	}
+
+	void DiversityCombiner::flush() {
+		if (!outCount) { return; }
+		out->processBlocks(outBlocks, outCount);
+		outCount = 0;
+		snapshot.store(stats);
+	}
+
+	void DiversityCombiner::checkReset() {
+		if (!resetPending.exchange(false)) { return; }
+
+		// Variants may have settled anywhere, relearn the grid from scratch
+		for (int v = 0; v < variants; v++) {
+			decoders[v]->reset();
+			offsetKnown[v] = false;
+			offset[v] = 0;
+			lastClean[v] = -BLOCK_LEN;
+		}
+		for (int i = 0; i < SLOT_RING_SIZE; i++) { slots[i].present = 0; }
+		originKnown = false;
+		nextSlot = 0;
+		outCount = 0;
+		stats = DiversityStats();
+		snapshot.store(stats);
+	}
+}
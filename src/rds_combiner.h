@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <atomic>
+#include "rds.h"
+
+namespace rds {
+    const int MAX_DIVERSITY = 8;
+
+    struct DiversityStats {
+        // Block slots that at least one variant had something for, and how many of those ended up valid
+        uint64_t slots = 0;
+        uint64_t valid = 0;
+        // Slots each variant won, and the ones where no other variant had a valid block
+        uint64_t wins[MAX_DIVERSITY] = {};
+        uint64_t soleWins[MAX_DIVERSITY] = {};
+        // Valid blocks from each variant, won or not
+        uint64_t variantValid[MAX_DIVERSITY] = {};
+        // Blocks that showed up after their slot was already decided
+        uint64_t late = 0;
+    };
+
+    // Runs one decoder per demodulator variant and forwards, block by block, whichever variant got it right to a
+    // single output decoder. Variants can lag each other by a few bits since they don't share filters or clock
+    // recovery, so their blocks are lined up on a common grid of block slots first. Everything except reset() and
+    // getStats() must be called from the same thread.
+    class DiversityCombiner {
+    public:
+        void init(int variants, Decoder* out);
+
+        // Safe to call from any thread, carried out before the next bits are processed
+        void reset() { resetPending = true; }
+
+        // Bits or soft symbols from variant v, see Decoder::process() and Decoder::processSoft()
+        void process(int v, const uint8_t* bits, int count);
+        void processSoft(int v, const float* symbols, int count);
+
+        // Decide every slot all variants are past and hand the winners to the output decoder
+        void combine();
+
+        DiversityStats getStats() { return snapshot.load(); }
+        int getVariantCount() { return variants; }
+
+    private:
+        struct Slot {
+            BlockEvent blocks[MAX_DIVERSITY];
+            uint8_t present = 0;
+        };
+
+        struct VariantCtx {
+            DiversityCombiner* _this;
+            int v;
+        };
+
+        static void blockHandler(const BlockEvent& block, void* ctx);
+        void addBlock(int v, const BlockEvent& block);
+        void decideSlot();
+        void flush();
+        void checkReset();
+
+        int variants = 0;
+        Decoder* out = NULL;
+        std::unique_ptr<Decoder> decoders[MAX_DIVERSITY];
+        VariantCtx ctxs[MAX_DIVERSITY];
+
+        // Bits fed to each variant so far, the same as its decoder's clock
+        int64_t progress[MAX_DIVERSITY] = {};
+        // Variant time minus grid time, learned from its anchored blocks
+        int64_t offset[MAX_DIVERSITY] = {};
+        bool offsetKnown[MAX_DIVERSITY] = {};
+
+        // Last block each variant got without any correction. A clean block right after another one is an anchor,
+        // a false sync on noise almost never manages two in a row.
+        int64_t lastClean[MAX_DIVERSITY] = {};
+        int lastCleanPos[MAX_DIVERSITY] = {};
+
+        // Slot n ends at origin + n * BLOCK_LEN on the grid, n % 4 is the block's position in the group
+        static const int SLOT_RING_SIZE = 16;
+        bool originKnown = false;
+        int64_t origin = 0;
+        int64_t nextSlot = 0;
+        Slot slots[SLOT_RING_SIZE];
+
+        // Winners waiting to be handed to the output decoder
+        BlockEvent outBlocks[SLOT_RING_SIZE];
+        int outCount = 0;
+
+        DiversityStats stats;
+        SeqLock<DiversityStats> snapshot;
+        std::atomic<bool> resetPending{ false };
+    };
+}
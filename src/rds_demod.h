@@ -1,102 +1,364 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <math.h>
+#include <string.h>
 #include <dsp/processor.h>
+#include <dsp/buffer/buffer.h>
 #include <dsp/loop/fast_agc.h>
 #include <dsp/loop/costas.h>
-#include <dsp/taps/band_pass.h>
-#include <dsp/filter/fir.h>
 #include <dsp/convert/complex_to_real.h>
+#include <dsp/math/hz_to_rads.h>
 #include <dsp/clock_recovery/mm.h>
 #include <dsp/digital/binary_slicer.h>
 #include <dsp/digital/differential_decoder.h>
+#include "rds_filter.h"
+#include "gardner.h"
+
+enum RDSOutputMode {
+	RDS_OUTPUT_HARD,
+	RDS_OUTPUT_PACKED,
+	RDS_OUTPUT_SOFT
+};
+
+enum RDSTimingMode {
+	// Mueller and Muller at 5000 S/s, about 4.2 samples per bit
+	RDS_TIMING_MM,
+	// Decimated to 2375 S/s right in the filter, then Gardner at exactly 2 samples per bit
+	RDS_TIMING_GARDNER
+};
+
+enum RDSLoopGear {
+	// Wide loops to pull in the carrier and bit timing quickly after a retune
+	RDS_GEAR_ACQUIRE,
+	// Narrow loops once the decoder has stable block sync, for the best BER
+	RDS_GEAR_TRACK,
+	// The fixed bandwidths used when gear shifting is off
+	RDS_GEAR_FIXED
+};
 
 class RDSDemod : public dsp::Processor<dsp::complex_t, uint8_t> {
 	using base_type = dsp::Processor<dsp::complex_t, uint8_t>;
 public:
 	RDSDemod() {}
-	RDSDemod(dsp::stream<dsp::complex_t>* in, bool enableSoft) { init(in, enableSoft); }
-	~RDSDemod() {}
+	RDSDemod(dsp::stream<dsp::complex_t>* in, RDSOutputMode outputMode = RDS_OUTPUT_HARD) { init(in, outputMode); }
+	~RDSDemod() {
+		if (!base_type::_block_init) { return; }
+		base_type::stop();
+		dsp::buffer::free(softBuf);
+		if (diagBuf) { dsp::buffer::free(diagBuf); }
+	}
 
-	void init(dsp::stream<dsp::complex_t>* in, bool enableSoft) {
+	void init(dsp::stream<dsp::complex_t>* in, RDSOutputMode outputMode = RDS_OUTPUT_HARD) {
 		// Save config
-		this->enableSoft = enableSoft;
+		this->outputMode = outputMode;
 
 		// Initialize the DSP
+		const LoopParams& loops = LOOP_PARAMS[RDS_GEAR_FIXED];
 		agc.init(NULL, 1.0, 1e6, 0.1);
-		costas.init(NULL, 0.005f);
-		taps = dsp::taps::bandPass<dsp::complex_t>(0, 2375, 100, 5000);
-		fir.init(NULL, taps);
+		costas.init(NULL, loops.costasBw);
+		filter.init(filterShape);
 		double baudfreq = dsp::math::hzToRads(2375.0/2.0, 5000);
-		costas2.init(NULL, 0.01, 0.0, baudfreq, baudfreq - (baudfreq*0.1), baudfreq + (baudfreq*0.1));
-		recov.init(NULL, 5000.0 / (2375.0 / 2.0), 1e-6, 0.01, 0.01);
+		// The filter already shifted the upper sideband down by the bit rate
+		costas2.init(NULL, loops.costas2Bw, 0.0, 0.0, -(baudfreq*0.1), baudfreq*0.1);
+		recov.init(NULL, 5000.0 / (2375.0 / 2.0), loops.omegaGain, loops.muGain, 0.01);
+		// Same loop bandwidth in Hz at the decimated rate
+		double halfBaudfreq = dsp::math::hzToRads(2375.0/2.0, 2375.0);
+		halfCostas2.init(NULL, loops.costas2Bw * 5000.0 / 2375.0, 0.0, 0.0, -(halfBaudfreq*0.1), halfBaudfreq*0.1);
+		gardner.init(2.0, loops.muGain, loops.omegaGain, 0.01);
 		diff.init(NULL, 2);
 
 		// Free useless buffers
 		agc.out.free();
-		fir.out.free();
 		costas2.out.free();
+		halfCostas2.out.free();
 		recov.out.free();
 
+		// Soft symbols when they don't go straight to the symbols stream
+		softBuf = dsp::buffer::alloc<float>(STREAM_BUFFER_SIZE);
+
 		// Init the rest
+		base_type::registerOutput(&packed);
+		base_type::registerOutput(&symbols);
 		base_type::init(in);
 	}
 
-	void setSoftEnabled(bool enable) {
+	void setOutputMode(RDSOutputMode mode) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		outputMode = mode;
+		base_type::tempStart();
+	}
+
+	// Turn off the first Costas loop when the input is already coherent with the carrier, like BroadcastFM's pilot mode
+	void setCarrierRecovery(bool enable) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		recoverCarrier = enable;
+		costas.reset();
+		base_type::tempStart();
+	}
+
+	void setTimingMode(RDSTimingMode mode) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		timingMode = mode;
+		filter.reset();
+		costas2.reset();
+		halfCostas2.reset();
+		recov.reset();
+		gardner.reset();
+		base_type::tempStart();
+	}
+
+	// Start wide after every reset and narrow down on requestGear(RDS_GEAR_TRACK), off uses the fixed bandwidths
+	void setGearShifting(bool enable) {
+		assert(base_type::_block_init);
+		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+		base_type::tempStop();
+		gearShifting = enable;
+		requestedGear = RDS_GEAR_ACQUIRE;
+		setGear(enable ? RDS_GEAR_ACQUIRE : RDS_GEAR_FIXED);
+		base_type::tempStart();
+	}
+
+	// Lock free so the decoder side can call it for every buffer, takes effect at the start of the next one.
+	// Ignored while gear shifting is off.
+	void requestGear(RDSLoopGear gear) {
+		requestedGear.store(gear, std::memory_order_relaxed);
+	}
+
+	RDSLoopGear getGear() { return currentGear.load(std::memory_order_relaxed); }
+
+	RDSOutputMode getOutputMode() { return outputMode; }
+
+	void setFilterShape(RDSFilterShape shape) {
 		assert(base_type::_block_init);
 		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
 		base_type::tempStop();
-		enableSoft = enable;
+		filterShape = shape;
+		filter.init(shape);
 		base_type::tempStart();
 	}
 
+	// Latest soft symbols for a constellation display, oldest first. Every call keeps the demodulator collecting them
+	// for another second, nothing is collected or even allocated until the first one. Returns false without touching
+	// out until there's enough new symbols to be worth a redraw, so calling it every frame still copies at the display rate.
+	bool readDiagram(float* out, int count) {
+		std::lock_guard<std::mutex> lck(diagMtx);
+		if (!diagBuf) { diagBuf = dsp::buffer::alloc<float>(DIAG_SIZE); }
+
+		// Whatever is left from the last time it was shown is too old to be drawn
+		if (diagHold.exchange(DIAG_HOLD, std::memory_order_relaxed) <= 0) {
+			memset(diagBuf, 0, DIAG_SIZE * sizeof(float));
+			diagFresh = 0;
+		}
+
+		if (diagFresh < DIAG_INTERVAL) { return false; }
+		diagFresh = 0;
+		count = std::min<int>(count, DIAG_SIZE);
+		for (int i = 0; i < count; i++) { out[i] = diagBuf[(diagPos - count + i) & (DIAG_SIZE - 1)]; }
+		return true;
+	}
+
+	// How much the soft symbols look like BPSK rather than noise: (mean |x|)^2 / mean x^2 over the last window. 1 for
+	// clean symbols, 2/pi for Gaussian noise, 0 until the first window after a reset.
+	float getSymbolQuality() { return symbolQuality.load(std::memory_order_relaxed); }
+
 	void reset() {
 		assert(base_type::_block_init);
 		std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
 		base_type::tempStop();
 		agc.reset();
 		costas.reset();
-		fir.reset();
+		filter.reset();
 		costas2.reset();
+		halfCostas2.reset();
 		recov.reset();
+		gardner.reset();
 		diff.reset();
+		packWord = 0;
+		packBits = 0;
+		qualityAbs = 0.0f;
+		qualitySq = 0.0f;
+		qualityCount = 0;
+		symbolQuality.store(0.0f, std::memory_order_relaxed);
+		if (gearShifting) {
+			requestedGear = RDS_GEAR_ACQUIRE;
+			setGear(RDS_GEAR_ACQUIRE);
+		}
 		base_type::tempStart();
 	}
 
 	inline int process(int count, dsp::complex_t* in, float* softOut, uint8_t* hardOut) {
+		shiftGear();
 		count = agc.process(count, in, costas.out.readBuf);
-		count = costas.process(count, costas.out.readBuf, costas.out.writeBuf);
-		count = fir.process(count, costas.out.writeBuf, costas.out.writeBuf);
-		count = costas2.process(count, costas.out.writeBuf, costas.out.readBuf);
-		count = dsp::convert::ComplexToReal::process(count, costas.out.readBuf, softOut);
-		count = recov.process(count, softOut, softOut);
+		dsp::complex_t* carrier = costas.out.readBuf;
+		if (recoverCarrier) {
+			count = costas.process(count, costas.out.readBuf, costas.out.writeBuf);
+			carrier = costas.out.writeBuf;
+		}
+		if (timingMode == RDS_TIMING_GARDNER) {
+			count = filter.processDecimated(count, carrier, costas.out.writeBuf);
+			count = halfCostas2.process(count, costas.out.writeBuf, costas.out.readBuf);
+			count = dsp::convert::ComplexToReal::process(count, costas.out.readBuf, softOut);
+			count = gardner.process(count, softOut, softOut);
+		}
+		else {
+			count = filter.process(count, carrier, costas.out.writeBuf);
+			count = costas2.process(count, costas.out.writeBuf, costas.out.readBuf);
+			count = dsp::convert::ComplexToReal::process(count, costas.out.readBuf, softOut);
+			count = recov.process(count, softOut, softOut);
+		}
 		count = dsp::digital::BinarySlicer::process(count, softOut, diff.out.readBuf);
 		count = diff.process(count, diff.out.readBuf, hardOut);
 		return count;
 	}
 
+	// Pack hard bits MSB first into 64 bit words, leftover bits are carried over to the next call
+	inline int pack(int count, uint8_t* bits, uint64_t* out) {
+		int words = 0;
+		for (int i = 0; i < count; i++) {
+			packWord = (packWord << 1) | (bits[i] & 1);
+			if (++packBits == 64) {
+				out[words++] = packWord;
+				packBits = 0;
+			}
+		}
+		return words;
+	}
+
+	// Everything run() does before writing to the output streams, for running the block from another thread's loop
+	inline int processBuffer(int count, dsp::complex_t* in, float* softOut, uint8_t* hardOut) {
+		count = process(count, in, softOut, hardOut);
+		if (diagHold.load(std::memory_order_relaxed) > 0) { tapDiagram(softOut, count); }
+		updateQuality(softOut, count);
+		return count;
+	}
+
 	int run() {
 		int count = base_type::_in->read();
 		if (count < 0) { return -1; }
 
-		count = process(count, base_type::_in->readBuf, soft.writeBuf, base_type::out.writeBuf);
+		// In soft output mode the symbols go straight to the decoder's stream
+		float* softOut = (outputMode == RDS_OUTPUT_SOFT) ? symbols.writeBuf : softBuf;
+		count = processBuffer(count, base_type::_in->readBuf, softOut, base_type::out.writeBuf);
 
 		base_type::_in->flush();
-		if (!base_type::out.swap(count)) { return -1; }
-		if (enableSoft) {
-			if (!soft.swap(count)) { return -1; }
+		if (outputMode == RDS_OUTPUT_PACKED) {
+			int words = pack(count, base_type::out.writeBuf, packed.writeBuf);
+			if (words && !packed.swap(words)) { return -1; }
+		}
+		else if (outputMode == RDS_OUTPUT_SOFT) {
+			if (!symbols.swap(count)) { return -1; }
+		}
+		else {
+			if (!base_type::out.swap(count)) { return -1; }
 		}
 		return count;
 	}
 
-	dsp::stream<float> soft;
+	// Symbols kept for readDiagram()
+	static const int DIAG_SIZE = 4096;
+
+	dsp::stream<uint64_t> packed;
+	dsp::stream<float> symbols;
 
 private:
-	bool enableSoft = false;
+	// Bandwidths at 5000 S/s, the decimated Gardner path gets the same ones in Hz
+	struct LoopParams {
+		double costasBw;
+		double costas2Bw;
+		double muGain;
+		double omegaGain;
+	};
+
+	// Acquire is 4x the fixed loops, track is half of them
+	static constexpr LoopParams LOOP_PARAMS[] = {
+		{ 0.02, 0.04, 0.04, 4e-6 },
+		{ 0.0025, 0.005, 0.005, 5e-7 },
+		{ 0.005, 0.01, 0.01, 1e-6 }
+	};
+
+	inline void shiftGear() {
+		if (!gearShifting) { return; }
+		RDSLoopGear gear = requestedGear.load(std::memory_order_relaxed);
+		if (gear != currentGear.load(std::memory_order_relaxed)) { setGear(gear); }
+	}
+
+	// Only the gains change, the loops keep their phase, frequency and timing
+	void setGear(RDSLoopGear gear) {
+		const LoopParams& loops = LOOP_PARAMS[gear];
+		costas.setBandwidth(loops.costasBw);
+		costas2.setBandwidth(loops.costas2Bw);
+		halfCostas2.setBandwidth(loops.costas2Bw * 5000.0 / 2375.0);
+		recov.setMuGain(loops.muGain);
+		recov.setOmegaGain(loops.omegaGain);
+		gardner.setGains(loops.muGain, loops.omegaGain);
+		currentGear.store(gear, std::memory_order_relaxed);
+	}
+
+	void tapDiagram(const float* soft, int count) {
+		std::lock_guard<std::mutex> lck(diagMtx);
+		for (int i = 0; i < count; i++) { diagBuf[diagPos++ & (DIAG_SIZE - 1)] = soft[i]; }
+		diagFresh += count;
+		diagHold.fetch_sub(count, std::memory_order_relaxed);
+	}
+
+	inline void updateQuality(const float* soft, int count) {
+		for (int i = 0; i < count; i++) {
+			qualityAbs += fabsf(soft[i]);
+			qualitySq += soft[i] * soft[i];
+			if (++qualityCount < QUALITY_WINDOW) { continue; }
+			float mean = qualityAbs / (float)QUALITY_WINDOW;
+			float power = qualitySq / (float)QUALITY_WINDOW;
+			symbolQuality.store((power > 0.0f) ? (mean * mean / power) : 0.0f, std::memory_order_relaxed);
+			qualityAbs = 0.0f;
+			qualitySq = 0.0f;
+			qualityCount = 0;
+		}
+	}
+
+	// A second of symbols after the last readDiagram(), redraws at about 30fps
+	static const int DIAG_HOLD = 1187;
+	static const int DIAG_INTERVAL = 1187 / 30;
+
+	// About 50ms of symbols
+	static const int QUALITY_WINDOW = 64;
+
+	bool recoverCarrier = true;
+	RDSTimingMode timingMode = RDS_TIMING_MM;
+	bool gearShifting = false;
+	std::atomic<RDSLoopGear> requestedGear{ RDS_GEAR_ACQUIRE };
+	std::atomic<RDSLoopGear> currentGear{ RDS_GEAR_FIXED };
+	RDSOutputMode outputMode = RDS_OUTPUT_HARD;
+	uint64_t packWord = 0;
+	int packBits = 0;
 
 	dsp::loop::FastAGC<dsp::complex_t> agc;
 	dsp::loop::Costas<2> costas;
-	dsp::tap<dsp::complex_t> taps;
-	dsp::filter::FIR<dsp::complex_t, dsp::complex_t> fir;
+	RDSFilterShape filterShape = RDS_FILTER_LOWPASS;
+	RDSFilter filter;
 	dsp::loop::Costas<2> costas2;
+	dsp::loop::Costas<2> halfCostas2;
 	dsp::clock_recovery::MM<float> recov;
+	GardnerRecovery gardner;
 	dsp::digital::DifferentialDecoder diff;
+
+	float* softBuf = NULL;
+
+	std::mutex diagMtx;
+	float* diagBuf = NULL;
+	uint32_t diagPos = 0;
+	int diagFresh = 0;
+	std::atomic<int> diagHold{ 0 };
+
+	float qualityAbs = 0.0f;
+	float qualitySq = 0.0f;
+	int qualityCount = 0;
+	std::atomic<float> symbolQuality{ 0.0f };
 };
\ No newline at end of file
@@ -0,0 +1,170 @@
+#pragma once
+#include <algorithm>
+#include <dsp/block.h>
+#include <dsp/routing/splitter.h>
+#include "rds_demod.h"
+#include "rds_combiner.h"
+#include "coop_executor.h"
+
+// Demodulator settings of each diversity variant, the first ones are used when running fewer
+struct RDSDiversityVariant {
+	const char* name;
+	RDSTimingMode timing;
+	RDSFilterShape filter;
+	// RDS_GEAR_FIXED for the usual loops, the others are held for good
+	RDSLoopGear gear;
+};
+
+static const RDSDiversityVariant RDS_DIVERSITY_VARIANTS[] = {
+	{ "MM", RDS_TIMING_MM, RDS_FILTER_LOWPASS, RDS_GEAR_FIXED },
+	{ "Gardner", RDS_TIMING_GARDNER, RDS_FILTER_LOWPASS, RDS_GEAR_FIXED },
+	{ "MM Matched", RDS_TIMING_MM, RDS_FILTER_MATCHED, RDS_GEAR_FIXED },
+	{ "MM Wide", RDS_TIMING_MM, RDS_FILTER_LOWPASS, RDS_GEAR_ACQUIRE },
+	{ "Gardner Narrow", RDS_TIMING_GARDNER, RDS_FILTER_MATCHED, RDS_GEAR_TRACK }
+};
+const int RDS_DIVERSITY_MAX_VARIANTS = sizeof(RDS_DIVERSITY_VARIANTS) / sizeof(RDS_DIVERSITY_VARIANTS[0]);
+
+// Gear shifting is only used to pin the loops, nothing ever asks for another gear. Has to be repeated after a reset.
+inline void holdDiversityGear(RDSDemod& demod, int v) {
+	const RDSDiversityVariant& variant = RDS_DIVERSITY_VARIANTS[v];
+	if (variant.gear != RDS_GEAR_FIXED) { demod.requestGear(variant.gear); }
+}
+
+inline void configureDiversityVariant(RDSDemod& demod, int v) {
+	const RDSDiversityVariant& variant = RDS_DIVERSITY_VARIANTS[v];
+	demod.setTimingMode(variant.timing);
+	demod.setFilterShape(variant.filter);
+	if (variant.gear != RDS_GEAR_FIXED) { demod.setGearShifting(true); }
+	holdDiversityGear(demod, v);
+}
+
+// Runs several RDSDemod variants on the same RDS baseband, each on its own thread, and combines their bits block by
+// block into a single decoder. See rds::DiversityCombiner for how a block's winner is picked.
+class RDSDiversity : public dsp::block {
+public:
+	RDSDiversity() {}
+	RDSDiversity(dsp::stream<dsp::complex_t>* in, rds::Decoder* out, int variants) { init(in, out, variants); }
+	~RDSDiversity() {
+		if (!_block_init) { return; }
+		stop();
+		dsp::buffer::free(soft);
+		dsp::buffer::free(bits);
+	}
+
+	void init(dsp::stream<dsp::complex_t>* in, rds::Decoder* out, int variants) {
+		this->out = out;
+		split.init(in);
+		for (int v = 0; v < RDS_DIVERSITY_MAX_VARIANTS; v++) {
+			demods[v].init(&streams[v], RDS_OUTPUT_SOFT);
+			configureDiversityVariant(demods[v], v);
+		}
+		bindVariants(variants);
+		soft = dsp::buffer::alloc<float>(STREAM_BUFFER_SIZE);
+		bits = dsp::buffer::alloc<uint8_t>(STREAM_BUFFER_SIZE);
+		_block_init = true;
+	}
+
+	void setInput(dsp::stream<dsp::complex_t>* in) {
+		assert(_block_init);
+		std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+		tempStop();
+		split.setInput(in);
+		tempStart();
+	}
+
+	void setVariantCount(int variants) {
+		assert(_block_init);
+		std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+		tempStop();
+		for (int v = 0; v < this->variants; v++) {
+			split.unbindStream(&streams[v]);
+			unregisterInput(&demods[v].symbols);
+		}
+		bindVariants(variants);
+		tempStart();
+	}
+
+	int getVariantCount() { return variants; }
+
+	// Same as RDSDemod::setCarrierRecovery(), for every variant
+	void setCarrierRecovery(bool enable) {
+		assert(_block_init);
+		std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+		for (int v = 0; v < RDS_DIVERSITY_MAX_VARIANTS; v++) { demods[v].setCarrierRecovery(enable); }
+	}
+
+	// Restart every variant's loops and the combiner, the output decoder is left alone
+	void reset() {
+		assert(_block_init);
+		std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+		for (int v = 0; v < RDS_DIVERSITY_MAX_VARIANTS; v++) {
+			demods[v].reset();
+			holdDiversityGear(demods[v], v);
+		}
+		combiner.reset();
+	}
+
+	rds::DiversityStats getStats() { return combiner.getStats(); }
+
+	// The first variant's symbols, see RDSDemod::readDiagram()
+	bool readDiagram(float* out, int count) { return demods[0].readDiagram(out, count); }
+
+	// The first variant's, see RDSDemod::getSymbolQuality()
+	float getSymbolQuality() { return demods[0].getSymbolQuality(); }
+
+	// Same as run(), but every variant runs on the caller's thread instead of its own. Only while stopped.
+	void process(int count, dsp::complex_t* in) {
+		std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+		for (int v = 0; v < variants; v++) {
+			int n = coopStep(&demods[v], [&]() { return demods[v].processBuffer(count, in, soft, bits); });
+			combiner.processSoft(v, soft, n);
+		}
+		combiner.combine();
+	}
+
+	int run() {
+		// Every variant outputs one buffer per input buffer, so taking them in turn never stalls the splitter
+		for (int v = 0; v < variants; v++) {
+			int count = demods[v].symbols.read();
+			if (count < 0) { return -1; }
+			combiner.processSoft(v, demods[v].symbols.readBuf, count);
+			demods[v].symbols.flush();
+		}
+		combiner.combine();
+		return 0;
+	}
+
+protected:
+	void doStart() {
+		split.start();
+		for (int v = 0; v < variants; v++) { demods[v].start(); }
+		dsp::block::doStart();
+	}
+
+	void doStop() {
+		dsp::block::doStop();
+		split.stop();
+		for (int v = 0; v < RDS_DIVERSITY_MAX_VARIANTS; v++) { demods[v].stop(); }
+	}
+
+private:
+	void bindVariants(int variants) {
+		this->variants = std::clamp<int>(variants, 1, RDS_DIVERSITY_MAX_VARIANTS);
+		for (int v = 0; v < this->variants; v++) {
+			split.bindStream(&streams[v]);
+			registerInput(&demods[v].symbols);
+		}
+		combiner.init(this->variants, out);
+	}
+
+	int variants = 0;
+	rds::Decoder* out = NULL;
+	dsp::routing::Splitter<dsp::complex_t> split;
+	dsp::stream<dsp::complex_t> streams[RDS_DIVERSITY_MAX_VARIANTS];
+	RDSDemod demods[RDS_DIVERSITY_MAX_VARIANTS];
+	rds::DiversityCombiner combiner;
+
+	// Scratch for process()
+	float* soft = NULL;
+	uint8_t* bits = NULL;
+};
@@ -0,0 +1,236 @@
+#pragma once
+#include <dsp/types.h>
+#include <dsp/stream.h>
+#include <dsp/buffer/buffer.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "dot_product.h"
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+enum RDSFilterShape {
+	// Same response as the old complex band-pass: flat over the upper sideband of the biphase signal, 100Hz transition
+	RDS_FILTER_LOWPASS,
+	// Half cosine spanning the upper sideband, the symmetric part of the biphase matched response. Much shorter too.
+	RDS_FILTER_MATCHED
+};
+
+// Selects the upper sideband of the biphase RDS signal. Instead of running complex band-pass taps over the
+// signal, it's shifted down by the symbol rate and filtered with real, symmetric low-pass taps, which does a
+// quarter of the multiplies. The output is centered on 0Hz instead of 1187.5Hz.
+class RDSFilter {
+public:
+	RDSFilter() {}
+	~RDSFilter() {
+		if (buffer) { dsp::buffer::free(buffer); }
+	}
+
+	void init(RDSFilterShape shape) {
+		this->shape = shape;
+
+		// 1187.5Hz at 5000Hz is exactly 19 turns every 80 samples, so the mixer is a lookup table that never drifts
+		for (int i = 0; i < MIX_PERIOD; i++) {
+			double phase = -2.0 * M_PI * (double)MIX_TURNS * (double)i / (double)MIX_PERIOD;
+			mix[i] = { (float)cos(phase), (float)sin(phase) };
+		}
+
+		designTaps();
+
+		// The decimated path reads up to a padded tap set past the last sample, that has to be zeros times something finite
+		if (buffer) { dsp::buffer::free(buffer); }
+		int bufSize = STREAM_BUFFER_SIZE + phaseLen / 2;
+		buffer = dsp::buffer::alloc<dsp::complex_t>(bufSize);
+		memset(buffer, 0, bufSize * sizeof(dsp::complex_t));
+		bufStart = &buffer[taps.size() - 1];
+		reset();
+	}
+
+	void reset() {
+		memset(buffer, 0, (taps.size() - 1) * sizeof(dsp::complex_t));
+		mixPhase = 0;
+		decimIdx = 0;
+		decimPhase = 0;
+	}
+
+	// Can run in place
+	inline int process(int count, const dsp::complex_t* in, dsp::complex_t* out) {
+		mixIn(count, in);
+		filter(count, out);
+
+		// Keep the last samples for the next call
+		memmove(buffer, &buffer[count], (taps.size() - 1) * sizeof(dsp::complex_t));
+		return count;
+	}
+
+	// Same filter, but only the outputs that land on a 2375Hz grid, two per bit. That's 19 outputs for every 40 inputs,
+	// each one computed straight from the input with the taps for its fractional position. Can run in place too.
+	inline int processDecimated(int count, const dsp::complex_t* in, dsp::complex_t* out) {
+		mixIn(count, in);
+
+		int outCount = 0;
+		while (decimIdx < count) {
+			out[outCount++] = dotInterleaved(&phaseTaps[decimPhase * phaseLen], (const float*)&buffer[decimIdx], phaseLen);
+
+			// Next output is 40/19 input samples later
+			decimIdx += DECIM_STEP / DECIM_PHASES;
+			decimPhase += DECIM_STEP % DECIM_PHASES;
+			if (decimPhase >= DECIM_PHASES) {
+				decimPhase -= DECIM_PHASES;
+				decimIdx++;
+			}
+		}
+		decimIdx -= count;
+
+		// Keep the last samples for the next call
+		memmove(buffer, &buffer[count], (taps.size() - 1) * sizeof(dsp::complex_t));
+		return outCount;
+	}
+
+	RDSFilterShape getShape() { return shape; }
+
+private:
+	// Shift down into the history buffer
+	inline void mixIn(int count, const dsp::complex_t* in) {
+		for (int i = 0; i < count; i++) {
+			bufStart[i] = in[i] * mix[mixPhase];
+			if (++mixPhase == MIX_PERIOD) { mixPhase = 0; }
+		}
+	}
+
+	// Impulse response, t in samples from the center
+	double impulse(double t) {
+		const double HALF_BW = 2375.0 / 2.0 / SAMPLERATE;
+		if (shape == RDS_FILTER_MATCHED) {
+			// Impulse response of cos(pi*f/(2*B)) over [-B, B]
+			double d = 1.0 - 16.0 * HALF_BW * HALF_BW * t * t;
+			return (fabs(d) < 1e-9) ? HALF_BW : (4.0 * HALF_BW / M_PI) * cos(2.0 * M_PI * HALF_BW * t) / d;
+		}
+
+		// Sinc
+		double x = 2.0 * HALF_BW * t;
+		return (fabs(x) < 1e-9) ? 2.0 * HALF_BW : 2.0 * HALF_BW * sin(M_PI * x) / (M_PI * x);
+	}
+
+	// Nuttall window, u goes from 0 to 1 across the taps
+	static double window(double u) {
+		if (u < 0.0 || u > 1.0) { return 0.0; }
+		double w = 2.0 * M_PI * u;
+		return 0.355768 - 0.487396 * cos(w) + 0.144232 * cos(2.0 * w) - 0.012604 * cos(3.0 * w);
+	}
+
+	void designTaps() {
+		int count;
+		if (shape == RDS_FILTER_MATCHED) {
+			// About 4 bit periods is plenty for such a smooth response
+			count = 17;
+		}
+		else {
+			// Same length as the band-pass it replaces
+			count = (int)round(3.8 * SAMPLERATE / 100.0);
+			if (!(count & 1)) { count++; }
+		}
+		taps.resize(count);
+
+		// The decimated path keeps every tap twice so it lines up with both halves of a complex sample, padded to 8 floats
+		phaseLen = (2 * count + 7) & ~7;
+		phaseTaps.assign(DECIM_PHASES * phaseLen, 0.0f);
+		std::vector<float> set(count);
+
+		// Output i + p/19 is centered on input sample i + half + p/19, phase 0 is the regular symmetric set
+		const int half = count / 2;
+		for (int p = 0; p < DECIM_PHASES; p++) {
+			double offset = (double)p / (double)DECIM_PHASES;
+			double sum = 0.0;
+			for (int k = 0; k < count; k++) {
+				double t = (double)half + offset - (double)k;
+				set[k] = impulse(t) * window((t + (double)half) / (double)(count - 1));
+				sum += set[k];
+			}
+
+			// Unity gain at DC
+			float* h = &phaseTaps[p * phaseLen];
+			for (int k = 0; k < count; k++) {
+				h[2 * k] = h[2 * k + 1] = set[k] / sum;
+			}
+			if (p == 0) {
+				for (int k = 0; k < count; k++) { taps[k] = h[2 * k]; }
+			}
+		}
+	}
+
+	// out[i] = sum(taps[k] * buffer[i + k]), folded around the middle tap since taps[k] == taps[n - 1 - k]
+	inline void filter(int count, dsp::complex_t* out) {
+		const int n = taps.size();
+		const int half = n / 2;
+		const float* h = taps.data();
+		int i = 0;
+
+#if defined(__AVX2__) && defined(__FMA__)
+		// 4 outputs per iteration
+		for (; i + 4 <= count; i += 4) {
+			const float* x = (const float*)&buffer[i];
+			__m256 acc = _mm256_mul_ps(_mm256_set1_ps(h[half]), _mm256_loadu_ps(&x[2 * half]));
+			for (int k = 0; k < half; k++) {
+				__m256 pair = _mm256_add_ps(_mm256_loadu_ps(&x[2 * k]), _mm256_loadu_ps(&x[2 * (n - 1 - k)]));
+				acc = _mm256_fmadd_ps(_mm256_set1_ps(h[k]), pair, acc);
+			}
+			_mm256_storeu_ps((float*)&out[i], acc);
+		}
+#elif defined(__SSE2__) || defined(_M_X64)
+		// 2 outputs per iteration
+		for (; i + 2 <= count; i += 2) {
+			const float* x = (const float*)&buffer[i];
+			__m128 acc = _mm_mul_ps(_mm_set1_ps(h[half]), _mm_loadu_ps(&x[2 * half]));
+			for (int k = 0; k < half; k++) {
+				__m128 pair = _mm_add_ps(_mm_loadu_ps(&x[2 * k]), _mm_loadu_ps(&x[2 * (n - 1 - k)]));
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(h[k]), pair));
+			}
+			_mm_storeu_ps((float*)&out[i], acc);
+		}
+#elif defined(__ARM_NEON)
+		// 2 outputs per iteration
+		for (; i + 2 <= count; i += 2) {
+			const float* x = (const float*)&buffer[i];
+			float32x4_t acc = vmulq_n_f32(vld1q_f32(&x[2 * half]), h[half]);
+			for (int k = 0; k < half; k++) {
+				float32x4_t pair = vaddq_f32(vld1q_f32(&x[2 * k]), vld1q_f32(&x[2 * (n - 1 - k)]));
+				acc = vmlaq_n_f32(acc, pair, h[k]);
+			}
+			vst1q_f32((float*)&out[i], acc);
+		}
+#endif
+
+		// Whatever is left, or everything without SIMD
+		for (; i < count; i++) {
+			const dsp::complex_t* x = &buffer[i];
+			dsp::complex_t acc = { h[half] * x[half].re, h[half] * x[half].im };
+			for (int k = 0; k < half; k++) {
+				acc.re += h[k] * (x[k].re + x[n - 1 - k].re);
+				acc.im += h[k] * (x[k].im + x[n - 1 - k].im);
+			}
+			out[i] = acc;
+		}
+	}
+
+	static constexpr double SAMPLERATE = 5000.0;
+	static const int MIX_PERIOD = 80;
+	static const int MIX_TURNS = 19;
+	static const int DECIM_PHASES = 19;
+	static const int DECIM_STEP = 40;
+
+	RDSFilterShape shape = RDS_FILTER_LOWPASS;
+	dsp::complex_t mix[MIX_PERIOD];
+	int mixPhase = 0;
+	std::vector<float> taps;
+	std::vector<float> phaseTaps;
+	int phaseLen = 0;
+	int decimIdx = 0;
+	int decimPhase = 0;
+	dsp::complex_t* buffer = NULL;
+	dsp::complex_t* bufStart = NULL;
+};
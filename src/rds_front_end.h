@@ -0,0 +1,338 @@
+#pragma once
+#include <dsp/types.h>
+#include <dsp/stream.h>
+#include <dsp/buffer/buffer.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include "dot_product.h"
+
+// Brings the 57kHz RDS subcarrier of the real MPX down to complex baseband at 5000 S/s, for RDSDemod. The mixer is a
+// lookup table, then a 4th order integer CIC does most of the decimation for a handful of adds per input sample, and
+// a polyphase FIR resamples what's left to 5000 S/s while flattening the CIC's droop. The input goes through in tiles
+// so the intermediate data stays in L1.
+//
+// Every stage is linear phase, output sample k is the input around sample k * samplerate / 5000 - getGroupDelay()
+// seconds, whatever way the input is split up. At 250kHz that's a CIC by 25 (192us) and 153 taps at 10kHz (7.6ms).
+//
+// Not used by BroadcastFM yet, rds_demod_bench compares it against the mixer and resampler BroadcastFM uses.
+class RDSFrontEnd {
+public:
+	RDSFrontEnd() {}
+	~RDSFrontEnd() {
+		if (buffer) { dsp::buffer::free(buffer); }
+		if (mixed) { dsp::buffer::free(mixed); }
+	}
+
+	void init(double samplerate) {
+		_samplerate = samplerate;
+		initMixer();
+		initCIC();
+		designTaps();
+
+		// The dot product reads a padded tap set past the newest sample, that has to be zeros times something finite
+		if (buffer) { dsp::buffer::free(buffer); }
+		int bufSize = tapsPerPhase - 1 + MID_TILE + phaseLen / 2;
+		buffer = dsp::buffer::alloc<dsp::complex_t>(bufSize);
+		memset(buffer, 0, bufSize * sizeof(dsp::complex_t));
+		bufStart = &buffer[tapsPerPhase - 1];
+
+		if (mixed) { dsp::buffer::free(mixed); }
+		mixed = dsp::buffer::alloc<dsp::complex_t>(decim * MID_TILE);
+		reset();
+	}
+
+	void reset() {
+		memset(buffer, 0, (tapsPerPhase - 1) * sizeof(dsp::complex_t));
+		mixPhase = 0;
+		osc = { 1.0f, 0.0f };
+		oscCount = 0;
+		memset(integ, 0, sizeof(integ));
+		memset(comb, 0, sizeof(comb));
+		cicPhase = 0;
+		polyIdx = 0;
+		polyPhase = 0;
+	}
+
+	// Mix with the built in 57kHz oscillator and decimate. Can't run in place.
+	inline int process(int count, const float* mpx, dsp::complex_t* out) {
+		int outCount = 0;
+		for (int i = 0; i < count; i += decim * MID_TILE) {
+			int n = std::min<int>(decim * MID_TILE, count - i);
+			mix(n, &mpx[i]);
+			outCount += decimate(n, mixed, &out[outCount]);
+		}
+		return outCount;
+	}
+
+	// Decimate a signal that's already been brought down to baseband, e.g. with a carrier derived from the pilot.
+	// Can run in place.
+	inline int processMixed(int count, const dsp::complex_t* in, dsp::complex_t* out) {
+		int outCount = 0;
+		for (int i = 0; i < count; i += decim * MID_TILE) {
+			int n = std::min<int>(decim * MID_TILE, count - i);
+			outCount += decimate(n, &in[i], &out[outCount]);
+		}
+		return outCount;
+	}
+
+	// In seconds, see above
+	double getGroupDelay() {
+		double cicDelay = (double)(CIC_ORDER * (decim - 1)) / 2.0 / _samplerate;
+		double firDelay = (double)(tapCount - 1) / 2.0 / (midSamplerate * (double)interp);
+		return cicDelay + firDelay;
+	}
+
+	int getDecimation() { return decim; }
+
+private:
+	void initMixer() {
+		// With an integer samplerate the oscillator repeats exactly every samplerate / gcd(samplerate, 57000) samples,
+		// a single period is all the table needs and it never drifts. Repeated up to a few hundred samples so the mixing
+		// loop gets long runs, 228kHz for instance repeats every 4 samples.
+		table.clear();
+		int64_t rate = llround(_samplerate);
+		if (fabs(_samplerate - (double)rate) < 1e-6) {
+			int64_t period = rate / std::gcd<int64_t>(rate, (int64_t)CARRIER_FREQ);
+			if (period <= MAX_MIX_PERIOD) {
+				int64_t len = period * ((MIX_RUN + period - 1) / period);
+				table.resize(len);
+				for (int64_t i = 0; i < len; i++) {
+					double phase = -2.0 * M_PI * CARRIER_FREQ * (double)(i % period) / _samplerate;
+					table[i] = { (float)cos(phase), (float)sin(phase) };
+				}
+			}
+		}
+
+		// Anything else runs a recursive oscillator, pulled back onto the unit circle every so often
+		double step = -2.0 * M_PI * CARRIER_FREQ / _samplerate;
+		oscStep = { (float)cos(step), (float)sin(step) };
+	}
+
+	void initCIC() {
+		// Decimate to somewhere around 10kHz, on a rate that goes to 5000 with the smallest interpolation possible
+		int minDecim = std::max<int>(1, (int)ceil(_samplerate / MAX_MID_RATE));
+		int maxDecim = std::max<int>(minDecim, (int)floor(_samplerate / MIN_MID_RATE));
+		decim = 0;
+		int64_t bestInterp = 0;
+		for (int r = maxDecim; r >= minDecim; r--) {
+			int64_t mid = llround(_samplerate / (double)r);
+			int64_t l = (int64_t)OUT_RATE / std::gcd<int64_t>(mid, (int64_t)OUT_RATE);
+			if (!decim || l < bestInterp) {
+				decim = r;
+				bestInterp = l;
+			}
+		}
+
+		// A rate that doesn't divide evenly ends up a few ppm off, well within what the timing recovery tracks
+		midSamplerate = _samplerate / (double)decim;
+		int64_t mid = llround(midSamplerate);
+		int64_t g = std::gcd<int64_t>(mid, (int64_t)OUT_RATE);
+		interp = (int)((int64_t)OUT_RATE / g);
+		polyDecim = (int)(mid / g);
+
+		// The integrators grow by decim^order, with the input at 24 bits it all still fits easily in 64
+		cicGain = 1.0f / (float)(pow((double)decim, (double)CIC_ORDER) * CIC_SCALE);
+	}
+
+	// CIC magnitude response, f in Hz at the input rate
+	double cicResponse(double f) {
+		double x = M_PI * f / _samplerate;
+		if (fabs(x) < 1e-12) { return 1.0; }
+		return pow(fabs(sin((double)decim * x) / ((double)decim * sin(x))), (double)CIC_ORDER);
+	}
+
+	// Nuttall window, u goes from 0 to 1 across the taps
+	static double window(double u) {
+		if (u < 0.0 || u > 1.0) { return 0.0; }
+		double w = 2.0 * M_PI * u;
+		return 0.355768 - 0.487396 * cos(w) + 0.144232 * cos(2.0 * w) - 0.012604 * cos(3.0 * w);
+	}
+
+	void designTaps() {
+		// Low-pass at the output's Nyquist frequency at the interpolated rate, same cutoff and transition as the
+		// resampler BroadcastFM uses. The passband is the inverse of the CIC response, integrated numerically.
+		double tapRate = midSamplerate * (double)interp;
+		tapCount = (int)round(3.8 * tapRate / TRANSITION);
+		if (!(tapCount & 1)) { tapCount++; }
+		const double cutoff = OUT_RATE / 2.0;
+		const int STEPS = 256;
+		std::vector<double> inverse(STEPS);
+		for (int s = 0; s < STEPS; s++) { inverse[s] = 1.0 / cicResponse(((double)s + 0.5) * cutoff / (double)STEPS); }
+
+		std::vector<double> h(tapCount);
+		double sum = 0.0;
+		const double center = (double)(tapCount - 1) / 2.0;
+		for (int k = 0; k < tapCount; k++) {
+			double acc = 0.0;
+			for (int s = 0; s < STEPS; s++) {
+				double f = ((double)s + 0.5) * cutoff / (double)STEPS;
+				acc += inverse[s] * cos(2.0 * M_PI * f * ((double)k - center) / tapRate);
+			}
+			h[k] = acc * window((double)k / (double)(tapCount - 1));
+			sum += h[k];
+		}
+
+		// Every phase gets unity gain at DC
+		for (auto& t : h) { t *= (double)interp / sum; }
+
+		// Phase p is taps p, p + interp, p + 2 * interp..., reversed so the newest sample lines up with the first one.
+		// Every tap is stored twice for dotInterleaved(), padded to 8 floats.
+		tapsPerPhase = (tapCount + interp - 1) / interp;
+		phaseLen = (2 * tapsPerPhase + 7) & ~7;
+		phaseTaps.assign(interp * phaseLen, 0.0f);
+		for (int p = 0; p < interp; p++) {
+			float* set = &phaseTaps[p * phaseLen];
+			for (int j = 0; j < tapsPerPhase; j++) {
+				int k = p + j * interp;
+				float t = (k < tapCount) ? (float)h[k] : 0.0f;
+				int idx = tapsPerPhase - 1 - j;
+				set[2 * idx] = set[2 * idx + 1] = t;
+			}
+		}
+	}
+
+	// Shift the real MPX down into the scratch buffer, the table runs are long enough to vectorize
+	inline void mix(int count, const float* mpx) {
+		if (table.empty()) {
+			for (int i = 0; i < count; i++) {
+				mixed[i] = { mpx[i] * osc.re, mpx[i] * osc.im };
+				osc = osc * oscStep;
+				if (++oscCount == OSC_RENORM) {
+					float mag = sqrtf(osc.re * osc.re + osc.im * osc.im);
+					osc = { osc.re / mag, osc.im / mag };
+					oscCount = 0;
+				}
+			}
+			return;
+		}
+
+		const int len = table.size();
+		for (int i = 0; i < count;) {
+			int n = std::min<int>(count - i, len - mixPhase);
+			const dsp::complex_t* t = &table[mixPhase];
+			dsp::complex_t* o = &mixed[i];
+			const float* x = &mpx[i];
+			for (int k = 0; k < n; k++) {
+				o[k].re = x[k] * t[k].re;
+				o[k].im = x[k] * t[k].im;
+			}
+			i += n;
+			mixPhase += n;
+			if (mixPhase == len) { mixPhase = 0; }
+		}
+	}
+
+	inline dsp::complex_t combOut(uint64_t re, uint64_t im) {
+		for (int s = 0; s < CIC_ORDER; s++) {
+			uint64_t dre = re - comb[s][0];
+			uint64_t dim = im - comb[s][1];
+			comb[s][0] = re;
+			comb[s][1] = im;
+			re = dre;
+			im = dim;
+		}
+		return { (float)(int64_t)re * cicGain, (float)(int64_t)im * cicGain };
+	}
+
+	// CIC then polyphase FIR, at most decim * MID_TILE input samples
+	inline int decimate(int count, const dsp::complex_t* in, dsp::complex_t* out) {
+		// Integrate at the input rate, comb at the decimated rate. Unsigned so the wraparound is well defined, the
+		// comb undoes it as long as the output fits. The integrators are unrolled into locals so they stay in
+		// registers, and the samples between two outputs go through a loop of their own without any branches.
+		uint64_t r0 = integ[0][0], r1 = integ[1][0], r2 = integ[2][0], r3 = integ[3][0];
+		uint64_t i0 = integ[0][1], i1 = integ[1][1], i2 = integ[2][1], i3 = integ[3][1];
+		auto integrate = [&](dsp::complex_t x) {
+			r0 += (uint64_t)(int64_t)(x.re * CIC_SCALE);
+			i0 += (uint64_t)(int64_t)(x.im * CIC_SCALE);
+			r1 += r0;
+			i1 += i0;
+			r2 += r1;
+			i2 += i1;
+			r3 += r2;
+			i3 += i2;
+		};
+
+		int midCount = 0;
+		for (int i = 0; i < count;) {
+			if (cicPhase == 0) {
+				integrate(in[i++]);
+				bufStart[midCount++] = combOut(r3, i3);
+				if (++cicPhase == decim) { cicPhase = 0; }
+				if (!cicPhase) { continue; }
+			}
+			int n = std::min<int>(count - i, decim - cicPhase);
+			for (int k = 0; k < n; k++) { integrate(in[i + k]); }
+			i += n;
+			cicPhase += n;
+			if (cicPhase == decim) { cicPhase = 0; }
+		}
+
+		integ[0][0] = r0;
+		integ[1][0] = r1;
+		integ[2][0] = r2;
+		integ[3][0] = r3;
+		integ[0][1] = i0;
+		integ[1][1] = i1;
+		integ[2][1] = i2;
+		integ[3][1] = i3;
+
+		// Output k is at interpolated sample k * polyDecim, so the newest input it needs is k * polyDecim / interp
+		int outCount = 0;
+		while (polyIdx < midCount) {
+			out[outCount++] = dotInterleaved(&phaseTaps[polyPhase * phaseLen], (const float*)&buffer[polyIdx], phaseLen);
+			polyPhase += polyDecim;
+			polyIdx += polyPhase / interp;
+			polyPhase %= interp;
+		}
+		polyIdx -= midCount;
+
+		// Keep the last samples for the next call
+		memmove(buffer, &buffer[midCount], (tapsPerPhase - 1) * sizeof(dsp::complex_t));
+		return outCount;
+	}
+
+	static constexpr double CARRIER_FREQ = 57000.0;
+	static constexpr double OUT_RATE = 5000.0;
+	static constexpr double MIN_MID_RATE = 8000.0;
+	static constexpr double MAX_MID_RATE = 12500.0;
+	static constexpr double TRANSITION = 250.0;
+	static constexpr float CIC_SCALE = 16777216.0f;
+	// decimate() has the integrators unrolled for exactly this many stages
+	static const int CIC_ORDER = 4;
+	static const int MID_TILE = 256;
+	static const int MIX_RUN = 256;
+	static const int MAX_MIX_PERIOD = 65536;
+	static const int OSC_RENORM = 1024;
+
+	double _samplerate = 250000.0;
+	double midSamplerate = 10000.0;
+
+	std::vector<dsp::complex_t> table;
+	int mixPhase = 0;
+	dsp::complex_t osc = { 1.0f, 0.0f };
+	dsp::complex_t oscStep = { 1.0f, 0.0f };
+	int oscCount = 0;
+
+	int decim = 1;
+	float cicGain = 1.0f;
+	uint64_t integ[CIC_ORDER][2];
+	uint64_t comb[CIC_ORDER][2];
+	int cicPhase = 0;
+
+	int interp = 1;
+	int polyDecim = 1;
+	int tapCount = 0;
+	int tapsPerPhase = 1;
+	int phaseLen = 0;
+	std::vector<float> phaseTaps;
+	int polyIdx = 0;
+	int polyPhase = 0;
+
+	dsp::complex_t* mixed = NULL;
+	dsp::complex_t* buffer = NULL;
+	dsp::complex_t* bufStart = NULL;
+};
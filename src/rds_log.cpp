@@ -0,0 +1,41 @@
+#include "rds_log.h"
+#include <stdio.h>
+
+namespace rds {
+	// Hex data word of each block, "----" if it wasn't received
+	static void formatBlocks(const GroupEvent& group, char words[4][5]) {
+		for (int i = 0; i < 4; i++) {
+			if ((group.avail >> i) & 1) { snprintf(words[i], 5, "%04X", group.blocks[i]); }
+			else { snprintf(words[i], 5, "----"); }
+		}
+	}
+
+	int formatRDSSpy(const GroupEvent& group, char* buf, size_t size) {
+		char words[4][5];
+		formatBlocks(group, words);
+		return snprintf(buf, size, "%s %s %s %s\n", words[0], words[1], words[2], words[3]);
+	}
+
+	int formatJSON(const GroupEvent& group, char* buf, size_t size) {
+		char words[4][5];
+		formatBlocks(group, words);
+
+		// PI comes from block A, or from block C' in version B groups
+		char pi[16] = "";
+		if (group.avail & (1 << 0)) {
+			snprintf(pi, sizeof(pi), "\"pi\":\"0x%04X\",", group.blocks[0]);
+		}
+		else if (group.groupVer == GROUP_VER_B && (group.avail & (1 << 2))) {
+			snprintf(pi, sizeof(pi), "\"pi\":\"0x%04X\",", group.blocks[2]);
+		}
+
+		return snprintf(buf, size, "{%s\"group\":\"%d%c\",\"tp\":%s,\"prog_type\":%d,\"bit\":%llu,\"raw\":\"%s %s %s %s\",\"corrected_bits\":[%d,%d,%d,%d]}\n",
+						pi,
+						group.groupType, (group.groupVer == GROUP_VER_A) ? 'A' : 'B',
+						((group.blocks[1] >> 10) & 1) ? "true" : "false",
+						(group.blocks[1] >> 5) & 0x1F,
+						(unsigned long long)group.time,
+						words[0], words[1], words[2], words[3],
+						group.corrected[0], group.corrected[1], group.corrected[2], group.corrected[3]);
+	}
+}
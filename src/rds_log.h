@@ -0,0 +1,14 @@
+#pragma once
+#include <stddef.h>
+#include "rds.h"
+
+namespace rds {
+    // Both formatters write a single newline terminated line into buf and return its length like snprintf does.
+    // Nothing is allocated so the same buffer can be reused for every group.
+
+    // RDS Spy style hex log, "AAAA BBBB CCCC DDDD" with "----" for missing blocks
+    int formatRDSSpy(const GroupEvent& group, char* buf, size_t size);
+
+    // redsea style JSON line with the raw group and its error correction info
+    int formatJSON(const GroupEvent& group, char* buf, size_t size);
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include "rds.h"
+
+namespace rds {
+	const uint16_t LFSR_POLY = 0b0110111001;
+	const uint16_t IN_POLY   = 0b1100011011;
+
+	const int BLOCK_LEN = 26;
+	const int DATA_LEN = 16;
+	const int POLY_LEN = 10;
+
+	const uint32_t BLOCK_MASK = (1 << BLOCK_LEN) - 1;
+	const uint16_t SYNDROME_MASK = (1 << POLY_LEN) - 1;
+
+	// Clock the syndrome LFSR once without any input
+	constexpr uint16_t syndromeStep(uint16_t syn) {
+		uint8_t outBit = (syn >> (POLY_LEN - 1)) & 1;
+		return ((syn << 1) & SYNDROME_MASK) ^ (LFSR_POLY * outBit);
+	}
+
+	// Bit-serial reference implementation, one LFSR clock per bit of the block
+	constexpr uint16_t calcSyndromeSerial(uint32_t block) {
+		uint16_t syn = 0;
+		for (int i = BLOCK_LEN - 1; i >= 0; i--) {
+			syn = syndromeStep(syn);
+			syn ^= IN_POLY * ((block >> i) & 1);
+		}
+		return syn;
+	}
+
+	// The syndrome is linear in the block, so the syndrome of a block is the xor of the syndromes of each of its bytes
+	constexpr std::array<std::array<uint16_t, 256>, 4> makeSyndromeTables() {
+		std::array<std::array<uint16_t, 256>, 4> tables{};
+		for (int t = 0; t < 4; t++) {
+			for (int b = 0; b < 256; b++) {
+				tables[t][b] = calcSyndromeSerial(((uint32_t)b << (t * 8)) & BLOCK_MASK);
+			}
+		}
+		return tables;
+	}
+
+	inline constexpr std::array<std::array<uint16_t, 256>, 4> SYNDROME_TABLES = makeSyndromeTables();
+
+	// Syndrome contribution of the bit that falls off the top of the block when shifting a new one in
+	inline constexpr uint16_t SYNDROME_SHIFT_OUT = syndromeStep(calcSyndromeSerial(1 << (BLOCK_LEN - 1)));
+
+	constexpr std::array<uint16_t, BLOCK_LEN> makeBitSyndromes() {
+		std::array<uint16_t, BLOCK_LEN> syns{};
+		for (int i = 0; i < BLOCK_LEN; i++) { syns[i] = calcSyndromeSerial(1 << i); }
+		return syns;
+	}
+
+	// Syndrome of a single bit error at each position of the block
+	inline constexpr std::array<uint16_t, BLOCK_LEN> BIT_SYNDROMES = makeBitSyndromes();
+
+	// Table driven syndrome of a whole 26 bit block
+	inline uint16_t calcSyndromeTable(uint32_t block) {
+		return SYNDROME_TABLES[0][block & 0xFF] ^
+			   SYNDROME_TABLES[1][(block >> 8) & 0xFF] ^
+			   SYNDROME_TABLES[2][(block >> 16) & 0xFF] ^
+			   SYNDROME_TABLES[3][(block >> 24) & 0b11];
+	}
+
+	// Slide the syndrome of a 26 bit window by one bit. outBit is the MSB of the window before the shift, inBit the new LSB.
+	inline uint16_t shiftSyndrome(uint16_t syn, uint8_t outBit, uint8_t inBit) {
+		return syndromeStep(syn) ^ (SYNDROME_SHIFT_OUT * outBit) ^ (IN_POLY * inBit);
+	}
+
+	constexpr std::array<BlockType, 1 << POLY_LEN> makeSyndromeTypeTable() {
+		std::array<BlockType, 1 << POLY_LEN> table{};
+		for (auto& t : table) { t = _BLOCK_TYPE_COUNT; }
+		table[0b1111011000] = BLOCK_TYPE_A;
+		table[0b1111010100] = BLOCK_TYPE_B;
+		table[0b1001011100] = BLOCK_TYPE_C;
+		table[0b1111001100] = BLOCK_TYPE_CP;
+		table[0b1001011000] = BLOCK_TYPE_D;
+		return table;
+	}
+
+	// Syndrome to block type lookup, _BLOCK_TYPE_COUNT when the syndrome doesn't match any offset word
+	inline constexpr std::array<BlockType, 1 << POLY_LEN> SYNDROME_TO_TYPE = makeSyndromeTypeTable();
+
+	// Offset words added to the checkword of each block type
+	inline constexpr uint16_t OFFSET_WORDS[_BLOCK_TYPE_COUNT] = {
+		0b0011111100, // A
+		0b0110011000, // B
+		0b0101101000, // C
+		0b1101010000, // C'
+		0b0110110100  // D
+	};
+
+	// Longest error burst the (26,16) code is guaranteed to correct
+	const int MAX_BURST_LEN = 5;
+
+	struct BurstError {
+		uint32_t pattern;
+		uint8_t bits;
+	};
+
+	constexpr uint8_t countBits(uint32_t v) {
+		uint8_t n = 0;
+		for (; v; v &= v - 1) { n++; }
+		return n;
+	}
+
+	// Map each syndrome to the burst error that produces it, every burst of up to 5 bits has a unique syndrome
+	constexpr std::array<BurstError, 1 << POLY_LEN> makeBurstErrorTable() {
+		std::array<BurstError, 1 << POLY_LEN> table{};
+		for (int len = 1; len <= MAX_BURST_LEN; len++) {
+			for (uint32_t burst = 0; burst < (1u << len); burst++) {
+				// A burst of length len must start and end with an error
+				if (!(burst & 1) || !((burst >> (len - 1)) & 1)) { continue; }
+				for (int pos = 0; pos + len <= BLOCK_LEN; pos++) {
+					uint32_t pattern = burst << pos;
+					BurstError& err = table[calcSyndromeSerial(pattern)];
+					if (!err.bits) { err = { pattern, countBits(pattern) }; }
+				}
+			}
+		}
+		return table;
+	}
+
+	// Syndrome to error pattern lookup, entries with 0 bits are uncorrectable
+	inline constexpr std::array<BurstError, 1 << POLY_LEN> BURST_ERRORS = makeBurstErrorTable();
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <string.h>
+#include <thread>
+#include <type_traits>
+
+// Single writer, multiple reader snapshot of a trivially copyable value.
+// The writer never waits. A reader only retries if it raced with a write in progress.
+template <class T>
+class SeqLock {
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock values are copied with memcpy");
+public:
+	SeqLock() {}
+	SeqLock(const T& value) : data(value) {}
+
+	// Must only ever be called from one thread
+	void store(const T& value) {
+		uint32_t s = seq.load(std::memory_order_relaxed);
+		seq.store(s + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(&data, &value, sizeof(T));
+		seq.store(s + 2, std::memory_order_release);
+	}
+
+	T load() const {
+		T out;
+		while (true) {
+			uint32_t s = seq.load(std::memory_order_acquire);
+			if (s & 1) {
+				std::this_thread::yield();
+				continue;
+			}
+			memcpy(&out, &data, sizeof(T));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (seq.load(std::memory_order_relaxed) == s) { return out; }
+		}
+	}
+
+	// Number of stores so far, lets readers skip work when nothing changed
+	uint32_t version() const {
+		return seq.load(std::memory_order_acquire) >> 1;
+	}
+
+private:
+	std::atomic<uint32_t> seq{ 0 };
+	T data;
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// Bounded single producer, single consumer queue. Neither side ever blocks or allocates.
+// When the consumer falls behind, new items are dropped and counted instead of overwriting unread ones.
+template <class T, uint32_t N>
+class SPSCRing {
+	static_assert(N && (N & (N - 1)) == 0, "Ring size must be a power of two");
+public:
+	// Producer side only
+	bool push(const T& item) {
+		uint32_t w = writeIdx.load(std::memory_order_relaxed);
+		if (w - readIdx.load(std::memory_order_acquire) == N) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		items[w & (N - 1)] = item;
+		writeIdx.store(w + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side only
+	bool pop(T& item) {
+		uint32_t r = readIdx.load(std::memory_order_relaxed);
+		if (r == writeIdx.load(std::memory_order_acquire)) { return false; }
+		item = items[r & (N - 1)];
+		readIdx.store(r + 1, std::memory_order_release);
+		return true;
+	}
+
+	uint32_t size() const {
+		return writeIdx.load(std::memory_order_acquire) - readIdx.load(std::memory_order_acquire);
+	}
+
+	uint64_t droppedCount() const {
+		return dropped.load(std::memory_order_relaxed);
+	}
+
+private:
+	// Keep both indices on their own cache line so the two threads don't fight over it
+	alignas(64) std::atomic<uint32_t> writeIdx{ 0 };
+	alignas(64) std::atomic<uint32_t> readIdx{ 0 };
+	std::atomic<uint64_t> dropped{ 0 };
+	T items[N];
+};
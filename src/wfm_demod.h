@@ -1,7 +1,9 @@
 #pragma once
 #include "demod.h"
-#include <dsp/demod/broadcast_fm.h>
+#include "broadcast_fm.h"
 #include "rds_demod.h"
+#include "rds_diversity.h"
+#include "coop_executor.h"
 #include <gui/widgets/symbol_diagram.h>
 #include <fstream>
 #include <iomanip>
@@ -15,15 +17,19 @@ namespace demod {
 
     class WFM : public Demodulator {
     public:
-        WFM() : diag(0.5, 4096)  {}
+        WFM() : diag(0.5, RDSDemod::DIAG_SIZE)  {}
 
-        WFM(std::string name, ConfigManager* config, dsp::stream<dsp::complex_t>* input, double bandwidth, double audioSR) : diag(0.5, 4096) {
+        WFM(std::string name, ConfigManager* config, dsp::stream<dsp::complex_t>* input, double bandwidth, double audioSR) : diag(0.5, RDSDemod::DIAG_SIZE) {
             init(name, config, input, bandwidth, audioSR);
         }
 
         ~WFM() {
             stop();
             gui::waterfall.onFFTRedraw.unbindHandler(&fftRedrawHandler);
+            dsp::buffer::free(coopRDS);
+            dsp::buffer::free(coopSoft);
+            dsp::buffer::free(coopBits);
+            dsp::buffer::free(coopWords);
         }
 
         void init(std::string name, ConfigManager* config, dsp::stream<dsp::complex_t>* input, double bandwidth, double audioSR) {
@@ -34,6 +40,11 @@ namespace demod {
             rdsRegions.define("eu", "Europe", RDS_REGION_EUROPE);
             rdsRegions.define("na", "North America", RDS_REGION_NORTH_AMERICA);
 
+            // Define RDS error correction policies
+            rdsCorrectionPolicies.define("burst", "Burst Correction", rds::CORRECTION_POLICY_BURST);
+            rdsCorrectionPolicies.define("single", "Single Bit Correction", rds::CORRECTION_POLICY_SINGLE_BIT);
+            rdsCorrectionPolicies.define("detect", "Detect Only", rds::CORRECTION_POLICY_DETECT_ONLY);
+
             // Register FFT draw handler
             fftRedrawHandler.handler = fftRedraw;
             fftRedrawHandler.ctx = this;
@@ -41,6 +52,7 @@ namespace demod {
 
             // Default
             std::string rdsRegionStr = "eu";
+            std::string rdsCorrectionStr = "burst";
 
             // Load config
             _config->acquire();
@@ -60,6 +72,27 @@ namespace demod {
             if (config->conf[name].contains("rdsRegion")) {
                 rdsRegionStr = config->conf[name]["rdsRegion"];
             }
+            if (config->conf[name].contains("rdsSoftDecision")) {
+                _rdsSoftDecision = config->conf[name]["rdsSoftDecision"];
+            }
+            if (config->conf[name].contains("rdsMatchedFilter")) {
+                _rdsMatchedFilter = config->conf[name]["rdsMatchedFilter"];
+            }
+            if (config->conf[name].contains("rdsPilotCarrier")) {
+                _rdsPilotCarrier = config->conf[name]["rdsPilotCarrier"];
+            }
+            if (config->conf[name].contains("rdsGearShifting")) {
+                _rdsGearShifting = config->conf[name]["rdsGearShifting"];
+            }
+            if (config->conf[name].contains("rdsDiversity")) {
+                _rdsDiversity = config->conf[name]["rdsDiversity"];
+            }
+            if (config->conf[name].contains("rdsDiversityVariants")) {
+                rdsDiversityVariants = config->conf[name]["rdsDiversityVariants"];
+            }
+            if (config->conf[name].contains("rdsCorrection")) {
+                rdsCorrectionStr = config->conf[name]["rdsCorrection"];
+            }
             _config->release(modified);
 
             // Load RDS region
@@ -72,12 +105,32 @@ namespace demod {
                 rdsRegionId = rdsRegions.valueId(rdsRegion);
             }
 
+            // Load RDS error correction policy
+            if (rdsCorrectionPolicies.keyExists(rdsCorrectionStr)) {
+                rdsCorrectionId = rdsCorrectionPolicies.keyId(rdsCorrectionStr);
+            }
+            else {
+                rdsCorrectionId = rdsCorrectionPolicies.valueId(rds::CORRECTION_POLICY_BURST);
+            }
+            rdsDecode.setCorrectionPolicy(rdsCorrectionPolicies.value(rdsCorrectionId));
+
             // Init DSP
             demod.init(input, bandwidth / 2.0f, getIFSampleRate(), _stereo, _lowPass, _rds);
-            rdsDemod.init(&demod.rdsOut, _rdsInfo);
-            hs.init(&rdsDemod.out, rdsHandler, this);
-            reshape.init(&rdsDemod.soft, 4096, (1187 / 30) - 4096);
-            diagHandler.init(&reshape.out, _diagHandler, this);
+            rdsDemod.init(&demod.rdsOut, _rdsSoftDecision ? RDS_OUTPUT_SOFT : RDS_OUTPUT_PACKED);
+            if (_rdsMatchedFilter) { rdsDemod.setFilterShape(RDS_FILTER_MATCHED); }
+            if (_rdsPilotCarrier) { setPilotCarrier(true); }
+            if (_rdsGearShifting) { rdsDemod.setGearShifting(true); }
+            rdsDiversityVariants = std::clamp<int>(rdsDiversityVariants, 2, RDS_DIVERSITY_MAX_VARIANTS);
+            rdsDiversity.init(&demod.rdsOut, &rdsDecode, rdsDiversityVariants);
+            rdsDiversity.setCarrierRecovery(!_rdsPilotCarrier);
+            hs.init(&rdsDemod.packed, rdsHandler, this);
+            softHs.init(&rdsDemod.symbols, rdsSoftHandler, this);
+
+            // Only touched in single thread mode
+            coopRDS = dsp::buffer::alloc<dsp::complex_t>(STREAM_BUFFER_SIZE);
+            coopSoft = dsp::buffer::alloc<float>(STREAM_BUFFER_SIZE);
+            coopBits = dsp::buffer::alloc<uint8_t>(STREAM_BUFFER_SIZE);
+            coopWords = dsp::buffer::alloc<uint64_t>(STREAM_BUFFER_SIZE / 64 + 1);
 
             // Init RDS display
             diag.lines.push_back(-0.8);
@@ -86,18 +139,24 @@ namespace demod {
 
         void start() {
             demod.start();
-            rdsDemod.start();
-            hs.start();
-            reshape.start();
-            diagHandler.start();
+            if (_rdsDiversity) {
+                rdsDiversity.start();
+            }
+            else {
+                rdsDemod.start();
+                hs.start();
+                softHs.start();
+            }
+            running = true;
         }
 
         void stop() {
             demod.stop();
             rdsDemod.stop();
             hs.stop();
-            reshape.stop();
-            diagHandler.stop();
+            softHs.stop();
+            rdsDiversity.stop();
+            running = false;
         }
 
         void showMenu() {
@@ -122,7 +181,6 @@ namespace demod {
 
             if (!_rds) { ImGui::BeginDisabled(); }
             if (ImGui::Checkbox(("Advanced RDS Info##_radio_wfm_rds_info_" + name).c_str(), &_rdsInfo)) {
-                setAdvancedRds(_rdsInfo);
                 _config->acquire();
                 _config->conf[name]["rdsInfo"] = _rdsInfo;
                 _config->release(true);
@@ -135,29 +193,78 @@ namespace demod {
                 _config->conf[name]["rdsRegion"] = rdsRegions.key(rdsRegionId);
                 _config->release(true);
             }
+            ImGui::LeftLabel("Error Correction");
+            ImGui::FillWidth();
+            if (ImGui::Combo(("##_radio_wfm_rds_correction_" + name).c_str(), &rdsCorrectionId, rdsCorrectionPolicies.txt)) {
+                rdsDecode.setCorrectionPolicy(rdsCorrectionPolicies.value(rdsCorrectionId));
+                _config->acquire();
+                _config->conf[name]["rdsCorrection"] = rdsCorrectionPolicies.key(rdsCorrectionId);
+                _config->release(true);
+            }
+            if (ImGui::Checkbox(("Soft Decision##_radio_wfm_rds_soft_" + name).c_str(), &_rdsSoftDecision)) {
+                setSoftDecision(_rdsSoftDecision);
+                _config->acquire();
+                _config->conf[name]["rdsSoftDecision"] = _rdsSoftDecision;
+                _config->release(true);
+            }
+            if (ImGui::Checkbox(("Matched Filter##_radio_wfm_rds_matched_" + name).c_str(), &_rdsMatchedFilter)) {
+                rdsDemod.setFilterShape(_rdsMatchedFilter ? RDS_FILTER_MATCHED : RDS_FILTER_LOWPASS);
+                _config->acquire();
+                _config->conf[name]["rdsMatchedFilter"] = _rdsMatchedFilter;
+                _config->release(true);
+            }
+            if (ImGui::Checkbox(("Pilot Carrier##_radio_wfm_rds_pilot_" + name).c_str(), &_rdsPilotCarrier)) {
+                setPilotCarrier(_rdsPilotCarrier);
+                _config->acquire();
+                _config->conf[name]["rdsPilotCarrier"] = _rdsPilotCarrier;
+                _config->release(true);
+            }
+            if (ImGui::Checkbox(("Gear Shifting##_radio_wfm_rds_gear_" + name).c_str(), &_rdsGearShifting)) {
+                rdsDemod.setGearShifting(_rdsGearShifting);
+                _config->acquire();
+                _config->conf[name]["rdsGearShifting"] = _rdsGearShifting;
+                _config->release(true);
+            }
+            if (ImGui::Checkbox(("Diversity##_radio_wfm_rds_diversity_" + name).c_str(), &_rdsDiversity)) {
+                setDiversity(_rdsDiversity);
+                _config->acquire();
+                _config->conf[name]["rdsDiversity"] = _rdsDiversity;
+                _config->release(true);
+            }
+            if (_rdsDiversity) {
+                ImGui::SameLine();
+                ImGui::FillWidth();
+                if (ImGui::SliderInt(("##_radio_wfm_rds_diversity_variants_" + name).c_str(), &rdsDiversityVariants, 2, RDS_DIVERSITY_MAX_VARIANTS, "%d variants")) {
+                    rdsDiversity.setVariantCount(rdsDiversityVariants);
+                    _config->acquire();
+                    _config->conf[name]["rdsDiversityVariants"] = rdsDiversityVariants;
+                    _config->release(true);
+                }
+            }
             if (!_rds) { ImGui::EndDisabled(); }
 
             float menuWidth = ImGui::GetContentRegionAvail().x;
 
             if (_rds && _rdsInfo) {
+                rds::RDSState st = rdsDecode.getState();
                 ImGui::BeginTable(("##radio_wfm_rds_info_tbl_" + name).c_str(), 2, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders);
-                if (rdsDecode.piCodeValid()) {
+                if (st.piCodeValid()) {
                     ImGui::TableNextRow();
                     ImGui::TableSetColumnIndex(0);
                     ImGui::TextUnformatted("PI Code");
                     ImGui::TableSetColumnIndex(1);
                     if (rdsRegion == RDS_REGION_NORTH_AMERICA) {
-                        ImGui::Text("%04X (%s)", rdsDecode.getPICode(), rdsDecode.getCallsign().c_str());
+                        ImGui::Text("%04X (%s)", st.piCode, st.callsign);
                     }
                     else {
-                        ImGui::Text("%04X", rdsDecode.getPICode());
+                        ImGui::Text("%04X", st.piCode);
                     }
 
                     ImGui::TableNextRow();
                     ImGui::TableSetColumnIndex(0);
                     ImGui::TextUnformatted("Program Coverage");
                     ImGui::TableSetColumnIndex(1);
-                    ImGui::Text("%s (%d)", rds::AREA_COVERAGE_TO_STR[rdsDecode.getProgramCoverage()], rdsDecode.getProgramCoverage());
+                    ImGui::Text("%s (%d)", rds::AREA_COVERAGE_TO_STR[st.programCoverage], st.programCoverage);
                 }
                 else {
                     ImGui::TableNextRow();
@@ -178,16 +285,16 @@ namespace demod {
                     ImGui::TextUnformatted("------- (--)");
                 }
 
-                if (rdsDecode.programTypeValid()) {
+                if (st.programTypeValid()) {
                     ImGui::TableNextRow();
                     ImGui::TableSetColumnIndex(0);
                     ImGui::TextUnformatted("Program Type");
                     ImGui::TableSetColumnIndex(1);
                     if (rdsRegion == RDS_REGION_NORTH_AMERICA) {
-                        ImGui::Text("%s (%d)", rds::PROGRAM_TYPE_US_TO_STR[rdsDecode.getProgramType()], rdsDecode.getProgramType());
+                        ImGui::Text("%s (%d)", rds::PROGRAM_TYPE_US_TO_STR[st.programType], st.programType);
                     }
                     else {
-                        ImGui::Text("%s (%d)", rds::PROGRAM_TYPE_EU_TO_STR[rdsDecode.getProgramType()], rdsDecode.getProgramType());
+                        ImGui::Text("%s (%d)", rds::PROGRAM_TYPE_EU_TO_STR[st.programType], st.programType);
                     }
                 }
                 else {
@@ -198,14 +305,14 @@ namespace demod {
                     ImGui::TextUnformatted("------- (--)");
                 }
 
-                if (rdsDecode.afValid()) {
+                if (st.afValid()) {
                     ImGui::TableNextRow();
                     ImGui::TableSetColumnIndex(0);
                     ImGui::TextUnformatted("AF");
                     ImGui::TableSetColumnIndex(1);
 
-                    std::array<uint32_t, 25> arr = rdsDecode.getAFs();
-                    uint8_t count = rdsDecode.getAFCount();
+                    std::array<uint32_t, 25> arr = st.afs;
+                    uint8_t count = st.afCount;
 
                     if (count > arr.size()) {
                         count = arr.size();
@@ -231,14 +338,14 @@ namespace demod {
                     ImGui::TextUnformatted("---");
                 }
 
-                if (rdsDecode.odaAIDValid()) {
+                if (st.odaAIDValid()) {
                     ImGui::TableNextRow();
                     ImGui::TableSetColumnIndex(0);
                     ImGui::TextUnformatted("ODA AID");
                     ImGui::TableSetColumnIndex(1);
 
-                    std::array<rds::ODAAID, 8> arr = rdsDecode.getOdaAID();
-                    uint8_t count = rdsDecode.getOdaAIDCount();
+                    std::array<rds::ODAAID, 8> arr = st.odas_aid;
+                    uint8_t count = st.oda_aid_count;
 
                     if (count > arr.size()) {
                         count = arr.size();
@@ -268,12 +375,12 @@ namespace demod {
                     ImGui::TextUnformatted("---");
                 }
 
-                if (rdsDecode.programTypeNameValid()) {
+                if (st.programTypeNameValid()) {
                     ImGui::TableNextRow();
                     ImGui::TableSetColumnIndex(0);
                     ImGui::TextUnformatted("PTYN");
                     ImGui::TableSetColumnIndex(1);
-                    ImGui::Text("%s", rdsDecode.getProgramTypeName().c_str());
+                    ImGui::Text("%s", st.programTypeNameUTF8);
                 }
                 else {
                     ImGui::TableNextRow();
@@ -283,13 +390,13 @@ namespace demod {
                     ImGui::TextUnformatted("---");
                 }
 
-                if (rdsDecode.diValid()) {
+                if (st.diValid()) {
                     ImGui::TableNextRow();
                     ImGui::TableSetColumnIndex(0);
                     ImGui::TextUnformatted("PTY Status");
                     ImGui::TableSetColumnIndex(1);
                     ImGui::Text("%s",
-                        ((rdsDecode.getDi() & 8) == 8) ? "Dynamic PTY":"Static PTY");
+                        ((st.decoderIdent & 8) == 8) ? "Dynamic PTY":"Static PTY");
                 }
                 else {
                     ImGui::TableNextRow();
@@ -299,24 +406,24 @@ namespace demod {
                     ImGui::TextUnformatted("---");
                 }
 
-                if (rdsDecode.tpValid() && rdsDecode.taValid()) {
+                if (st.tpValid() && st.taValid()) {
                     ImGui::TableNextRow();
                     ImGui::TableSetColumnIndex(0);
                     ImGui::TextUnformatted("TP TA");
                     ImGui::TableSetColumnIndex(1);
-                    ImGui::Text("%s %s", rdsDecode.getTp() ? "TP":"", rdsDecode.getTa() ? "TA":"");
-                } else if (rdsDecode.tpValid()) {
+                    ImGui::Text("%s %s", st.trafficProgram ? "TP":"", st.trafficAnnouncement ? "TA":"");
+                } else if (st.tpValid()) {
                     ImGui::TableNextRow();
                     ImGui::TableSetColumnIndex(0);
                     ImGui::TextUnformatted("TP TA");
                     ImGui::TableSetColumnIndex(1);
-                    ImGui::Text("%s", rdsDecode.getTp() ? "TP":"");
-                } else if (rdsDecode.taValid()) {
+                    ImGui::Text("%s", st.trafficProgram ? "TP":"");
+                } else if (st.taValid()) {
                     ImGui::TableNextRow();
                     ImGui::TableSetColumnIndex(0);
                     ImGui::TextUnformatted("TP TA");
                     ImGui::TableSetColumnIndex(1);
-                    ImGui::Text("%s", rdsDecode.getTa() ? "TA":"");
+                    ImGui::Text("%s", st.trafficAnnouncement ? "TA":"");
                 }
                 else {
                     ImGui::TableNextRow();
@@ -326,12 +433,12 @@ namespace demod {
                     ImGui::TextUnformatted("---");
                 }
 
-                if (rdsDecode.eccValid()) {
+                if (st.eccValid()) {
                     ImGui::TableNextRow();
                     ImGui::TableSetColumnIndex(0);
                     ImGui::TextUnformatted("ECC");
                     ImGui::TableSetColumnIndex(1);
-                    ImGui::Text("%02X", rdsDecode.getEcc());
+                    ImGui::Text("%02X", st.ecc);
                 }
                 else {
                     ImGui::TableNextRow();
@@ -341,16 +448,16 @@ namespace demod {
                     ImGui::TextUnformatted("--");
                 }
 
-                if(rdsDecode.CTReceived()) {
+                if(st.CTReceived()) {
                     ImGui::TableNextRow();
                     ImGui::TableSetColumnIndex(0);
                     ImGui::TextUnformatted("Time");
                     ImGui::TableSetColumnIndex(1);
                     ImGui::Text("%02d:%02d (%02d:%02d)",
-                        (rdsDecode.getClockHour() + ((rdsDecode.getClockOffsetSense() ? -1 : 1) * (rdsDecode.getClockOffset() / 2))) % 24,
-                        (rdsDecode.getClockMinute() + ((rdsDecode.getClockOffsetSense() ? -1 : 1) * (rdsDecode.getClockOffset() % 2) * 30)) % 60,
-                        rdsDecode.getClockHour() % 24,
-                        rdsDecode.getClockMinute() % 60
+                        (st.clock_hour + ((st.clock_offset_sense ? -1 : 1) * (st.clock_offset / 2))) % 24,
+                        (st.clock_minute + ((st.clock_offset_sense ? -1 : 1) * (st.clock_offset % 2) * 30)) % 60,
+                        st.clock_hour % 24,
+                        st.clock_minute % 60
                     );
 
                     ImGui::TableNextRow();
@@ -358,9 +465,9 @@ namespace demod {
                     ImGui::TextUnformatted("Date");
                     ImGui::TableSetColumnIndex(1);
                     ImGui::Text("%02d.%02d.%04d (DD.MM.YYYY)",
-                        rdsDecode.getMJDDay(rdsDecode.getClockMJD()),
-                        rdsDecode.getMJDMonth(rdsDecode.getClockMJD()),
-                        rdsDecode.getMJDYear(rdsDecode.getClockMJD())
+                        rds::Decoder::getMJDDay(st.clock_mjd),
+                        rds::Decoder::getMJDMonth(st.clock_mjd),
+                        rds::Decoder::getMJDYear(st.clock_mjd)
                     );
                 } else {
                     ImGui::TableNextRow();
@@ -376,13 +483,95 @@ namespace demod {
                     ImGui::Text("--.--.---- (DD.MM.YYYY)");
                 }
 
+                const rds::BlockStats& stats = st.blockStats;
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::TextUnformatted("Blocks");
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%llu (%llu corrected, %llu bits, %llu failed)",
+                    (unsigned long long)stats.blocks,
+                    (unsigned long long)stats.corrected,
+                    (unsigned long long)stats.correctedBits,
+                    (unsigned long long)stats.uncorrectable
+                );
+
+                static const char* SYNC_STATE_NAMES[] = { "Searching", "Acquiring", "Stable" };
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::TextUnformatted("Sync");
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%s for %.1f s (%u changes)",
+                    SYNC_STATE_NAMES[st.syncState],
+                    rds::bitsToMs(st.time - st.syncStateSince) / 1000.0,
+                    st.syncTransitions
+                );
+
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::TextUnformatted("First PI");
+                ImGui::TableSetColumnIndex(1);
+                if (st.firstPI) {
+                    ImGui::Text("after %.0f ms", st.timeToFirstPIMs());
+                }
+                else {
+                    ImGui::TextUnformatted("-");
+                }
+
+                if (_rdsDiversity) {
+                    rds::DiversityStats div = rdsDiversity.getStats();
+                    for (int v = 0; v < rdsDiversity.getVariantCount(); v++) {
+                        ImGui::TableNextRow();
+                        ImGui::TableSetColumnIndex(0);
+                        ImGui::TextUnformatted(RDS_DIVERSITY_VARIANTS[v].name);
+                        ImGui::TableSetColumnIndex(1);
+                        ImGui::Text("%llu won (%llu alone), %llu valid",
+                            (unsigned long long)div.wins[v],
+                            (unsigned long long)div.soleWins[v],
+                            (unsigned long long)div.variantValid[v]
+                        );
+                    }
+                }
+
+                if (_rdsGearShifting && !_rdsDiversity) {
+                    ImGui::TableNextRow();
+                    ImGui::TableSetColumnIndex(0);
+                    ImGui::TextUnformatted("Loops");
+                    ImGui::TableSetColumnIndex(1);
+                    ImGui::TextUnformatted(rdsDemod.getGear() == RDS_GEAR_TRACK ? "Tracking" : "Acquiring");
+                }
+
+                if (_rdsPilotCarrier) {
+                    ImGui::TableNextRow();
+                    ImGui::TableSetColumnIndex(0);
+                    ImGui::TextUnformatted("Carrier");
+                    ImGui::TableSetColumnIndex(1);
+                    ImGui::TextUnformatted(demod.isPilotLocked() ? "Pilot" : "Costas");
+                }
+
+                if (_rdsSoftDecision) {
+                    ImGui::TableNextRow();
+                    ImGui::TableSetColumnIndex(0);
+                    ImGui::TextUnformatted("Soft Recovered");
+                    ImGui::TableSetColumnIndex(1);
+                    ImGui::Text("%llu (%llu bits flipped)",
+                        (unsigned long long)stats.softRecovered,
+                        (unsigned long long)stats.softFlippedBits
+                    );
+                }
 
                 ImGui::EndTable();
 
                 if(ImGui::Button("Reset", ImVec2(menuWidth, 0))) {
                     rdsDecode.reset();
+                    if (_rdsDiversity) { rdsDiversity.reset(); }
                 }
 
+                // The demodulator only collects symbols for as long as they keep being drawn
+                float* buf = diag.acquireBuffer();
+                if (_rdsDiversity) { rdsDiversity.readDiagram(buf, RDSDemod::DIAG_SIZE); }
+                else { rdsDemod.readDiagram(buf, RDSDemod::DIAG_SIZE); }
+                diag.releaseBuffer();
+
                 ImGui::SetNextItemWidth(menuWidth);
                 diag.draw();
             }
@@ -396,14 +585,22 @@ namespace demod {
             demod.setInput(input);
         }
 
+        // Rebuilds the demodulator's filters, rdsOut stays at 5000 S/s whatever the rate
+        void setIFSampleRate(double samplerate) {
+            if (samplerate == ifSamplerate) { return; }
+            ifSamplerate = samplerate;
+            demod.setSamplerate(ifSamplerate);
+        }
+
         void FrequencyChanged() {
             // TODO: VFO doesnt tell the frequency selected, hereby we have no idea what frequency is selected so we cant tell if it changed, thanks Ryzerth 🤦
             rdsDecode.reset();
+            if (_rdsDiversity) { rdsDiversity.reset(); }
         }
 
         // ============= INFO =============
 
-        double getIFSampleRate() { return 250000.0; }
+        double getIFSampleRate() { return ifSamplerate; }
         double getAFSampleRate() { return getIFSampleRate(); }
         double getDefaultBandwidth() { return 150000.0; }
         double getMinBandwidth() { return 50000.0; }
@@ -413,6 +610,40 @@ namespace demod {
         int getDefaultDeemphasisMode() { return DEEMP_MODE_50US; }
         dsp::stream<dsp::stereo_t>* getOutput() { return &demod.out; }
 
+        // Only seen in stereo unless pilot detection is on, mono doesn't run the pilot PLL otherwise
+        bool hasPilot() { return demod.isPilotLocked(); }
+        void setPilotDetection(bool enabled) { demod.setPilotDetection(enabled); }
+        float getRDSQuality() {
+            if (!_rds) { return 0.0f; }
+            return _rdsDiversity ? rdsDiversity.getSymbolQuality() : rdsDemod.getSymbolQuality();
+        }
+        rds::RDSState getRDSState() { return rdsDecode.getState(); }
+
+        int process(int count, dsp::complex_t* in, dsp::stereo_t* out) {
+            int rdsCount = 0;
+            count = coopStep(&demod, [&]() { return demod.process(count, in, out, rdsCount, coopRDS); });
+            if (!rdsCount) { return count; }
+
+            if (_rdsDiversity) {
+                rdsDiversity.process(rdsCount, coopRDS);
+                return count;
+            }
+
+            // Same as rdsDemod's run() followed by the handler that would have received its output
+            coopStep(&rdsDemod, [&]() {
+                int bits = rdsDemod.processBuffer(rdsCount, coopRDS, coopSoft, coopBits);
+                if (rdsDemod.getOutputMode() == RDS_OUTPUT_SOFT) {
+                    rdsDecode.processSoft(coopSoft, bits);
+                }
+                else {
+                    rdsDecode.processPacked(coopWords, rdsDemod.pack(bits, coopBits, coopWords));
+                }
+                return bits;
+            });
+            updateLoopGear();
+            return count;
+        }
+
         // ============= DEDICATED FUNCTIONS =============
 
         void setStereo(bool stereo) {
@@ -420,40 +651,83 @@ namespace demod {
             demod.setStereo(_stereo);
         }
 
-        void setAdvancedRds(bool enabled) {
-            rdsDemod.setSoftEnabled(enabled);
-            _rdsInfo = enabled;
+        void setAudioEnabled(bool enabled) {
+            demod.setAudio(enabled);
+        }
+
+        void setSoftDecision(bool enabled) {
+            _rdsSoftDecision = enabled;
+            rdsDemod.setOutputMode(_rdsSoftDecision ? RDS_OUTPUT_SOFT : RDS_OUTPUT_PACKED);
+        }
+
+        // The first Costas loop moves into the demodulator, which only runs it while there's no pilot to lock to
+        void setPilotCarrier(bool enabled) {
+            _rdsPilotCarrier = enabled;
+            demod.setRDSCarrier(_rdsPilotCarrier ? RDS_CARRIER_PILOT : RDS_CARRIER_COSTAS);
+            rdsDemod.setCarrierRecovery(!_rdsPilotCarrier);
+            rdsDiversity.setCarrierRecovery(!_rdsPilotCarrier);
         }
 
+        // The variants take over demod.rdsOut from the single demodulator and feed rdsDecode themselves
+        void setDiversity(bool enabled) {
+            _rdsDiversity = enabled;
+            rdsDecode.reset();
+            if (_rdsDiversity) { rdsDiversity.reset(); }
+            else { rdsDemod.reset(); }
+            if (!running) { return; }
+            if (_rdsDiversity) {
+                rdsDemod.stop();
+                hs.stop();
+                softHs.stop();
+                rdsDiversity.start();
+            }
+            else {
+                rdsDiversity.stop();
+                rdsDemod.start();
+                hs.start();
+                softHs.start();
+            }
+        }
+
+
     private:
-        static void rdsHandler(uint8_t* data, int count, void* ctx) {
+        static void rdsHandler(uint64_t* data, int count, void* ctx) {
             WFM* _this = (WFM*)ctx;
-            _this->rdsDecode.process(data, count);
+            _this->rdsDecode.processPacked(data, count);
+            _this->updateLoopGear();
         }
 
-        static void _diagHandler(float* data, int count, void* ctx) {
+        static void rdsSoftHandler(float* data, int count, void* ctx) {
             WFM* _this = (WFM*)ctx;
-            float* buf = _this->diag.acquireBuffer();
-            memcpy(buf, data, count * sizeof(float));
-            _this->diag.releaseBuffer();
+            _this->rdsDecode.processSoft(data, count);
+            _this->updateLoopGear();
+        }
+
+        // Narrow the demodulator's loops once the decoder has stable sync, open them up again when it's lost.
+        // Called from the decoder's thread, RDSDemod ignores it while gear shifting is off.
+        void updateLoopGear() {
+            rds::SyncState sync = rdsDecode.getSyncState();
+            if (sync == rds::SYNC_STATE_STABLE) { rdsDemod.requestGear(RDS_GEAR_TRACK); }
+            else if (sync == rds::SYNC_STATE_SEARCHING) { rdsDemod.requestGear(RDS_GEAR_ACQUIRE); }
         }
 
         static void fftRedraw(ImGui::WaterFall::FFTRedrawArgs args, void* ctx) {
             WFM* _this = (WFM*)ctx;
             if (!_this->_rds) { return; }
 
-            std::string ps = _this->rdsDecode.PSNameValid() ? _this->rdsDecode.getPSName() : "-";
-            std::string lps = _this->rdsDecode.LPSNameValid() ? _this->rdsDecode.getLPSName() : "-";
-            std::string rt = _this->rdsDecode.radioTextValid() ? _this->rdsDecode.getRadioText() : "-";
-            std::string rtAB = _this->rdsDecode.radioTextValid() ? _this->rdsDecode.getRadioTextAB() : "-";
-            std::string ert = _this->rdsDecode.ertValid() ? _this->rdsDecode.getERT() : "-";
+            rds::RDSState st = _this->rdsDecode.getState();
+            std::string ps = st.PSNameValid() ? st.psUTF8 : "-";
+            std::string lps = st.LPSNameValid() ? std::string(st.longPS) : "-";
+            std::string rt = st.radioTextValid() ? st.radioTextUTF8 : "-";
+            std::string rtAB = st.radioTextValid() ? (st.lastRTAB ? "B" : "A") : "-";
+            std::string ert = st.ertValid() ? st.ertUTF8 : "-";
 
-            bool rtp_running = _this->rdsDecode.getRTPRunning();
-            bool rtp_toggle = _this->rdsDecode.getRTPToggle();
-            std::string rtp1_type = rtp_running ? rds::RTP_TO_STR[_this->rdsDecode.getRTPContentType1()] : "-";
-            std::string rtp1 = rtp_running ? rt.substr(_this->rdsDecode.getRTPContentType1Start(), _this->rdsDecode.getRTPContentType1Len()) : "-";
-            std::string rtp2_type = rtp_running ? rds::RTP_TO_STR[_this->rdsDecode.getRTPContentType2()] : "-";
-            std::string rtp2 = rtp_running ? rt.substr(_this->rdsDecode.getRTPContentType2Start(), _this->rdsDecode.getRTPContentType2Len()) : "-";
+            bool rtp_running = st.rtp_item_running;
+            bool rtp_toggle = st.rtp_item_toggle;
+            std::string rtp1_type = rtp_running ? rds::RTP_TO_STR[st.rtp_content_type_1] : "-";
+            std::string rtp1 = rtp_running ? rt.substr(st.rtp_content_type_1_start, st.rtp_content_type_1_len + 1) : "-";
+            std::string rtp2_type = rtp_running ? rds::RTP_TO_STR[st.rtp_content_type_2] : "-";
+            std::string rtp2 = rtp_running ? rt.substr(st.rtp_content_type_2_start, st.rtp_content_type_2_len + 1) : "-";
 
             std::ostringstream oss;
             oss << "Radio Data System Information:\n"
@@ -489,28 +763,45 @@ namespace demod {
             args.window->DrawList->AddText(NULL, args.window->DrawList->_Data->FontSize * 1.15, tmin, IM_COL32(255, 255, 255, 255), buf);
         }
 
-        dsp::demod::BroadcastFM demod;
+        BroadcastFM demod;
         RDSDemod rdsDemod;
-        dsp::sink::Handler<uint8_t> hs;
+        RDSDiversity rdsDiversity;
+        dsp::sink::Handler<uint64_t> hs;
+        dsp::sink::Handler<float> softHs;
         EventHandler<ImGui::WaterFall::FFTRedrawArgs> fftRedrawHandler;
 
-        dsp::buffer::Reshaper<float> reshape;
-        dsp::sink::Handler<float> diagHandler;
         ImGui::SymbolDiagram diag;
 
         rds::Decoder rdsDecode;
 
         ConfigManager* _config = NULL;
 
+        double ifSamplerate = 250000.0;
         bool _stereo = false;
         bool _lowPass = true;
         bool _rds = false;
         bool _rdsInfo = false;
+        bool _rdsSoftDecision = false;
+        bool _rdsMatchedFilter = false;
+        bool _rdsPilotCarrier = false;
+        bool _rdsGearShifting = false;
+        bool _rdsDiversity = false;
+        int rdsDiversityVariants = 3;
+        bool running = false;
+
+        // Scratch for process()
+        dsp::complex_t* coopRDS = NULL;
+        float* coopSoft = NULL;
+        uint8_t* coopBits = NULL;
+        uint64_t* coopWords = NULL;
 
         int rdsRegionId = 0;
         RDSRegion rdsRegion = RDS_REGION_EUROPE;
         OptionList<std::string, RDSRegion> rdsRegions;
 
+        int rdsCorrectionId = 0;
+        OptionList<std::string, rds::CorrectionPolicy> rdsCorrectionPolicies;
+
         std::string name;
     };
 }